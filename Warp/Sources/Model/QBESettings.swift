@@ -103,6 +103,22 @@ class QBESettings {
 		}
 	}
 	
+	/** The maximum number of bytes the data cached by cache steps may take up on disk. When more data is cached, the
+	least recently used cached data is removed. */
+	var cacheSizeBudget: Int {
+		get {
+			let budget = defaults.integer(forKey: "cacheSizeBudget")
+			if budget <= 0 {
+				return 4 * 1024 * 1024 * 1024
+			}
+			return budget
+		}
+
+		set {
+			defaults.set(max(64 * 1024 * 1024, newValue), forKey: "cacheSizeBudget")
+		}
+	}
+	
 	func defaultWidthForColumn(_ withName: Column) -> Double? {
 		return defaults.double(forKey: "width.\(withName.name)")
 	}
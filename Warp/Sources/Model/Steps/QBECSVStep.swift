@@ -138,6 +138,10 @@ class QBECSVSourceStep: QBEStep {
 	var interpretLanguage: Language.LanguageIdentifier? = nil
 	var hasHeaders: Bool = true
 
+	/** Whether the file is read by parsing blocks of it concurrently (see CSVStream). This is opt-in. Only used to read
+	the full data set; examples only need the first few rows, which are read sequentially. */
+	var readInParallel: Bool = false
+
 	required init() {
 		let defaultSeparator = QBESettings.sharedInstance.defaultFieldSeparator
 		self.fieldSeparator = defaultSeparator.utf16[defaultSeparator.utf16.startIndex]
@@ -162,6 +166,7 @@ class QBECSVSourceStep: QBEStep {
 		self.fieldSeparator = separator.utf16[separator.utf16.startIndex]
 		self.hasHeaders = aDecoder.decodeBool(forKey: "hasHeaders")
 		self.interpretLanguage = aDecoder.decodeObject(forKey: "interpretLanguage") as? Language.LanguageIdentifier
+		self.readInParallel = aDecoder.containsValue(forKey: "readInParallel") ? aDecoder.decodeBool(forKey: "readInParallel") : false
 		super.init(coder: aDecoder)
 	}
 	
@@ -169,10 +174,10 @@ class QBECSVSourceStep: QBEStep {
 		self.file?.url?.stopAccessingSecurityScopedResource()
 	}
 	
-	private func sourceDataset() -> Fallible<Dataset> {
+	private func sourceDataset(parallel: Bool) -> Fallible<Dataset> {
 		if let url = file?.url {
 			let locale: Language? = (interpretLanguage != nil) ? Language(language: interpretLanguage!) : nil
-			let s = CSVStream(url: url as URL, fieldSeparator: fieldSeparator, hasHeaders: hasHeaders, locale: locale)
+			let s = CSVStream(url: url as URL, fieldSeparator: fieldSeparator, hasHeaders: hasHeaders, locale: locale, parallel: parallel)
 			return .success(StreamDataset(source: s))
 		}
 		else {
@@ -181,11 +186,11 @@ class QBECSVSourceStep: QBEStep {
 	}
 	
 	override func fullDataset(_ job: Job, callback: @escaping (Fallible<Dataset>) -> ()) {
-		callback(sourceDataset())
+		callback(sourceDataset(parallel: self.readInParallel))
 	}
 	
 	override func exampleDataset(_ job: Job, maxInputRows: Int, maxOutputRows: Int, callback: @escaping (Fallible<Dataset>) -> ()) {
-		callback(sourceDataset().use{ $0.limit(maxInputRows) })
+		callback(sourceDataset(parallel: false).use{ $0.limit(maxInputRows) })
 	}
 	
 	override func encode(with coder: NSCoder) {
@@ -194,6 +199,7 @@ class QBECSVSourceStep: QBEStep {
 		let separator = String(Character(UnicodeScalar(fieldSeparator)!))
 		coder.encode(separator, forKey: "fieldSeparator")
 		coder.encode(hasHeaders, forKey: "hasHeaders")
+		coder.encode(readInParallel, forKey: "readInParallel")
 		coder.encode(self.file?.url, forKey: "fileURL")
 		coder.encode(self.file?.bookmark, forKey: "fileBookmark")
 		coder.encode(self.interpretLanguage, forKey: "intepretLanguage")
@@ -10,6 +10,7 @@ warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Ge
 You should have received a copy of the GNU General Public License along with this program; if not, write to the Free
 Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. */
 import Foundation
+import CommonCrypto
 import WarpCore
 
 class QBECacheStep: QBEStep, NSSecureCoding {
@@ -18,28 +19,41 @@ class QBECacheStep: QBEStep, NSSecureCoding {
 
 	required init() {
 		super.init()
-		self.evictCache()
+		self.prepareCache()
 	}
 
 	required init(coder aDecoder: NSCoder) {
 		super.init(coder: aDecoder)
-		self.evictCache()
+		self.prepareCache()
 	}
 
 	deinit {
 		self.cachedDataset?.cancel()
 	}
 
+	/** Discards the cached data, including data cached for the same source data in earlier sessions, so that the data is
+	read from the source again. */
 	func evictCache() {
+		self.mutex.locked {
+			if let fingerprint = self.previous?.cacheFingerprint {
+				QBESQLiteCachedDataset.remove(fingerprint: fingerprint)
+			}
+			self.prepareCache()
+		}
+	}
+
+	private func prepareCache() {
 		self.mutex.locked {
 			self.cachedDataset?.cancel()
 			self.cachedDataset = Future<Fallible<Dataset>>({ [weak self] (job, callback) in
 				if let prev = self?.previous {
+					let fingerprint = prev.cacheFingerprint
+
 					prev.fullDataset(job) { result in
 						switch result {
 						case .success(let fullData):
 							var cd: QBESQLiteCachedDataset? = nil
-							cd = QBESQLiteCachedDataset(source: fullData, job: job, completion: { result in
+							cd = QBESQLiteCachedDataset(source: fullData, fingerprint: fingerprint, job: job, completion: { result in
 								switch result {
 								case .failure(let e):
 									callback(.failure(e))
@@ -75,10 +89,10 @@ class QBECacheStep: QBEStep, NSSecureCoding {
 	override func exampleDataset(_ job: Job, maxInputRows: Int, maxOutputRows: Int, callback: @escaping (Fallible<Dataset>) -> ()) {
 		self.mutex.locked { () -> () in
 			if let r = self.cachedDataset?.result, case .failure(_) = r {
-				self.evictCache()
+				self.prepareCache()
 			}
 			else if let cd = self.cachedDataset, cd.cancelled && cd.result == nil {
-				self.evictCache()
+				self.prepareCache()
 			}
 
 			// Make sure that cancelling job does not lead to cancellation of the caching effort by using a separate job
@@ -101,10 +115,10 @@ class QBECacheStep: QBEStep, NSSecureCoding {
 	override func fullDataset(_ job: Job, callback: @escaping (Fallible<Dataset>) -> ()) {
 		self.mutex.locked {
 			if let r = self.cachedDataset?.result, case .failure(_) = r {
-				self.evictCache()
+				self.prepareCache()
 			}
 			else if let cd = self.cachedDataset, cd.cancelled && cd.result == nil {
-				self.evictCache()
+				self.prepareCache()
 			}
 
 			// Make sure that cancelling job does not lead to cancellation of the caching effort by using a separate job
@@ -120,3 +134,170 @@ class QBECacheStep: QBEStep, NSSecureCoding {
 		callback(.success(data))
 	}
 }
+
+extension QBEStep {
+	/** A fingerprint of the data produced by this step (and the steps before it), which is used to reuse data cached in an
+	earlier session (see QBESQLiteCachedDataset). The fingerprint is a hash of the configuration of the chain of steps up
+	to and including this step (including chains these steps depend on, e.g. for joins) in canonical form, and of the
+	size and modification date of each local file referenced by them. Steps after this step and alternatives are not
+	included. */
+	var cacheFingerprint: String {
+		var excluded = Set<ObjectIdentifier>()
+		var step: QBEStep? = self.next
+		while let s = step {
+			excluded.insert(ObjectIdentifier(s))
+			step = s.next
+		}
+
+		step = self
+		while let s = step {
+			for alternative in s.alternatives ?? [] {
+				excluded.insert(ObjectIdentifier(alternative))
+			}
+			step = s.previous
+		}
+
+		let fingerprinter = QBEStepFingerprinter(excluding: excluded)
+		var data = Data(fingerprinter.canonical(self).utf8)
+		for file in fingerprinter.files {
+			data.append(contentsOf: Array(file.utf8))
+		}
+
+		var digest = [UInt8](repeating: 0, count: Int(CC_SHA256_DIGEST_LENGTH))
+		data.withUnsafeBytes { (bytes: UnsafeRawBufferPointer) -> () in
+			_ = CC_SHA256(bytes.baseAddress, CC_LONG(bytes.count), &digest)
+		}
+		return digest.map { String(format: "%02x", $0) }.joined()
+	}
+}
+
+/** Encodes steps in a canonical text form for the cache fingerprint. The output of NSKeyedArchiver cannot be used for
+this, because it writes the entries of dictionaries (e.g. the renames of QBERenameStep) in hash order, which differs
+between launches. This coder writes the keys of each encoded object and dictionary in sorted order. It leaves out the
+indicated steps, and records the size and modification date of local files referenced by the encoded steps. */
+private class QBEStepFingerprinter: NSCoder {
+	private let excluded: Set<ObjectIdentifier>
+	private(set) var files: [String] = []
+
+	/** Objects that have already been encoded, and the number by which later occurrences refer to them. */
+	private var encoded: [ObjectIdentifier: Int] = [:]
+
+	/** The fields of the objects currently being encoded (innermost last). */
+	private var fields: [[String: String]] = []
+
+	init(excluding excluded: Set<ObjectIdentifier>) {
+		self.excluded = excluded
+		super.init()
+	}
+
+	override var allowsKeyedCoding: Bool {
+		return true
+	}
+
+	/** Returns the canonical form of the object. */
+	func canonical(_ object: Any?) -> String {
+		guard let object = object else {
+			return "nil"
+		}
+
+		if let step = object as? QBEStep, self.excluded.contains(ObjectIdentifier(step)) {
+			return "nil"
+		}
+
+		switch object {
+		case is NSNull:
+			return "null"
+
+		case let string as String:
+			return "s\(string.utf8.count):\(string)"
+
+		case let number as NSNumber:
+			return "n\(String(cString: number.objCType)):\(number.stringValue)"
+
+		case let data as Data:
+			return "d\(data.base64EncodedString())"
+
+		case let date as Date:
+			return "t\(date.timeIntervalSinceReferenceDate)"
+
+		case let url as URL:
+			if url.isFileURL {
+				let attributes = try? FileManager.default.attributesOfItem(atPath: url.path)
+				let size = (attributes?[FileAttributeKey.size] as? NSNumber)?.int64Value ?? -1
+				let modified = (attributes?[FileAttributeKey.modificationDate] as? Date)?.timeIntervalSinceReferenceDate ?? 0.0
+				self.files.append("\(url.path):\(size):\(modified)\n")
+			}
+			return "u\(url.absoluteString.utf8.count):\(url.absoluteString)"
+
+		case let array as NSArray:
+			return "[" + array.map { self.canonical($0) }.joined(separator: ",") + "]"
+
+		case let dictionary as NSDictionary:
+			// Values are encoded in key order too, so that references to objects encoded earlier are numbered consistently
+			let keys = dictionary.allKeys.map { (key: self.canonical($0), object: $0) }.sorted { $0.key < $1.key }
+			let entries = keys.map { key in return "\(key.key)=\(self.canonical(dictionary.object(forKey: key.object)))" }
+			return "{" + entries.joined(separator: ",") + "}"
+
+		case let set as NSSet:
+			return "<" + set.map { self.canonical($0) }.sorted().joined(separator: ",") + ">"
+
+		case let coding as NSObject & NSCoding:
+			let identifier = ObjectIdentifier(coding)
+			if let reference = self.encoded[identifier] {
+				return "@\(reference)"
+			}
+
+			let reference = self.encoded.count
+			self.encoded[identifier] = reference
+			self.fields.append([:])
+			coding.encode(with: self)
+			let objectFields = self.fields.removeLast()
+			let entries = objectFields.map { (key, value) in return "\(key)=\(value)" }.sorted()
+			return "#\(reference):\(type(of: coding))(" + entries.joined(separator: ",") + ")"
+
+		default:
+			return "v\(String(reflecting: object))"
+		}
+	}
+
+	private func set(_ value: String, forKey key: String) {
+		self.fields[self.fields.count - 1][key] = value
+	}
+
+	override func encode(_ object: Any?, forKey key: String) {
+		self.set(self.canonical(object), forKey: key)
+	}
+
+	override func encodeConditionalObject(_ object: Any?, forKey key: String) {
+		self.set(self.canonical(object), forKey: key)
+	}
+
+	override func encode(_ value: Bool, forKey key: String) {
+		self.set("b\(value)", forKey: key)
+	}
+
+	override func encode(_ value: Int, forKey key: String) {
+		self.set("i\(value)", forKey: key)
+	}
+
+	override func encode(_ value: Int32, forKey key: String) {
+		self.set("i\(value)", forKey: key)
+	}
+
+	override func encode(_ value: Int64, forKey key: String) {
+		self.set("i\(value)", forKey: key)
+	}
+
+	override func encode(_ value: Float, forKey key: String) {
+		self.set("f\(value)", forKey: key)
+	}
+
+	override func encode(_ value: Double, forKey key: String) {
+		self.set("f\(value)", forKey: key)
+	}
+
+	override func encodeBytes(_ bytes: UnsafePointer<UInt8>?, length: Int, forKey key: String) {
+		let data = bytes.map { Data(bytes: $0, count: length) } ?? Data()
+		self.set("d\(data.base64EncodedString())", forKey: key)
+	}
+}
@@ -128,12 +128,10 @@ private class QBESQLiteWriterSession {
 
 			job!.time("SQLite insert", items: r.count, itemType: "rows") {
 				if let statement = self.insertStatement {
-					for row in r {
-						if case .failure(let m) = statement.run(row) {
-							self.completion!(.failure(m))
-							self.completion = nil
-							return
-						}
+					if case .failure(let m) = statement.run(batch: r) {
+						self.completion!(.failure(m))
+						self.completion = nil
+						return
 					}
 				}
 			}
@@ -221,34 +219,252 @@ class QBESQLiteWriter: NSObject, QBEFileWriter, NSCoding {
 	}
 }
 
+/** The database in which data sets are cached (see QBESQLiteCachedDataset). The database is kept in the caches directory
+of the application, so that cached data can be reused in later sessions. Tables that can be reused are registered in an
+index table under a fingerprint of the data they contain (see QBEStep.cacheFingerprint). When the cached tables take up
+more space than allowed (QBESettings.cacheSizeBudget), the least recently used tables are removed. Tables that are not
+registered (i.e. that were being written when the application quit) are removed when the database is opened.
+
+If the database cannot be opened, a temporary database is used instead, in which case nothing is reused. */
 private class QBESQLiteSharedCacheDatabase {
+	private static let indexTableName = "warp_cache_index"
+
 	let connection: SQLiteConnection
+	let isPersistent: Bool
+	private let mutex = Mutex()
+
+	/** The number of data sets currently reading from each table. Tables in use are not removed. */
+	private var tablesInUse: [String: Int] = [:]
 
 	init() {
-		connection = SQLiteConnection(path: "", readOnly: false)!
-		/** Because this database is created anew, we can set its encoding. As the code reading strings from SQLite
-		uses UTF-8, set the database's encoding to UTF-8 so that no unnecessary conversions have to take place. */
-
-		connection.query("PRAGMA encoding = \"UTF-8\"").require { e in
-			e.run().require {
-				connection.query("PRAGMA synchronous = OFF").require { r in
-					r.run().require {
-						connection.query("PRAGMA journal_mode = MEMORY").require { s in
-							s.run().require {
-							}
-						}
-					}
+		if let url = QBESQLiteSharedCacheDatabase.url {
+			// A cache database that cannot be opened (e.g. because it is corrupt) is simply removed and created anew
+			for _ in 0..<2 {
+				if let c = SQLiteConnection(path: url.path, readOnly: false), QBESQLiteSharedCacheDatabase.prepare(c, persistent: true) {
+					self.connection = c
+					self.isPersistent = true
+					self.removeUnregisteredTables()
+					return
+				}
+				trace("Could not open the cache database at \(url.path), removing it")
+				for suffix in ["", "-wal", "-shm"] {
+					try? FileManager.default.removeItem(atPath: url.path + suffix)
+				}
+			}
+		}
+
+		self.connection = SQLiteConnection(path: "", readOnly: false)!
+		self.isPersistent = false
+		_ = QBESQLiteSharedCacheDatabase.prepare(self.connection, persistent: false)
+	}
+
+	private static var url: URL? {
+		guard let caches = FileManager.default.urls(for: .cachesDirectory, in: .userDomainMask).first else {
+			return nil
+		}
+
+		let directory = caches.appendingPathComponent(Bundle.main.bundleIdentifier ?? "Warp", isDirectory: true).appendingPathComponent("DataCache", isDirectory: true)
+		do {
+			try FileManager.default.createDirectory(at: directory, withIntermediateDirectories: true, attributes: nil)
+		}
+		catch {
+			return nil
+		}
+		return directory.appendingPathComponent("cache.sqlite", isDirectory: false)
+	}
+
+	private static func prepare(_ connection: SQLiteConnection, persistent: Bool) -> Bool {
+		/** As the code reading strings from SQLite uses UTF-8, set the database's encoding to UTF-8 so that no unnecessary
+		conversions have to take place (this only has an effect when the database is created). Space left by removed tables
+		is reclaimed using incremental vacuuming, which needs to be enabled before any tables are created.
+
+		A persistent cache is read again in later sessions, so it is written using a write-ahead log, which keeps the file
+		consistent when the app crashes (or the system loses power) halfway through a write. A temporary cache does not
+		outlive the process, so it is written without these guarantees. */
+		var statements = ["PRAGMA encoding = \"UTF-8\"", "PRAGMA auto_vacuum = INCREMENTAL"]
+		if persistent {
+			statements.append(contentsOf: ["PRAGMA journal_mode = WAL", "PRAGMA synchronous = NORMAL"])
+			statements.append("CREATE TABLE IF NOT EXISTS \(indexTableName) (fingerprint TEXT PRIMARY KEY, table_name TEXT NOT NULL, size INTEGER NOT NULL, last_used REAL NOT NULL)")
+		}
+		else {
+			statements.append(contentsOf: ["PRAGMA synchronous = OFF", "PRAGMA journal_mode = MEMORY"])
+		}
+
+		for sql in statements {
+			if case .failure(let m) = execute(sql, on: connection) {
+				trace("Could not prepare cache database: \(m)")
+				return false
+			}
+		}
+		return true
+	}
+
+	private static func execute(_ sql: String, on connection: SQLiteConnection) -> Fallible<Void> {
+		switch connection.query(sql) {
+		case .success(let statement):
+			return statement.run()
+
+		case .failure(let e):
+			return .failure(e)
+		}
+	}
+
+	private func literal(_ value: Value) -> String {
+		return self.connection.dialect.expressionToSQL(Literal(value), alias: "", foreignAlias: nil, inputValue: nil)!
+	}
+
+	private func table(_ tableName: String) -> String {
+		return self.connection.dialect.tableIdentifier(tableName, schema: nil, database: nil)
+	}
+
+	private func rows(_ sql: String) -> [Tuple] {
+		switch self.connection.query(sql) {
+		case .success(let result):
+			return result.sequence().compactMap { row -> Tuple? in
+				if case .success(let r) = row {
+					return r
+				}
+				return nil
+			}
+
+		case .failure(let e):
+			trace("Cache database query failed: \(e)")
+			return []
+		}
+	}
+
+	private func run(_ sql: String) {
+		if case .failure(let m) = QBESQLiteSharedCacheDatabase.execute(sql, on: self.connection) {
+			trace("Cache database statement failed: \(m)")
+		}
+	}
+
+	private func removeUnregisteredTables() {
+		self.mutex.locked {
+			let tables = self.rows("SELECT name FROM sqlite_master WHERE type='table' AND name LIKE 'cache\\_%' ESCAPE '\\' AND name NOT IN (SELECT table_name FROM \(QBESQLiteSharedCacheDatabase.indexTableName))")
+			for row in tables {
+				if let name = row[0].stringValue {
+					self.run("DROP TABLE \(self.table(name))")
+				}
+			}
+			self.run("PRAGMA incremental_vacuum")
+		}
+	}
+
+	/** Returns the name of a table that contains the data set with the indicated fingerprint, if it was cached before. The
+	table is in use until it is released. */
+	func lookup(_ fingerprint: String) -> String? {
+		if !self.isPersistent {
+			return nil
+		}
+
+		return self.mutex.locked {
+			let index = QBESQLiteSharedCacheDatabase.indexTableName
+			guard let tableName = self.rows("SELECT table_name FROM \(index) WHERE fingerprint=\(self.literal(Value(fingerprint)))").first?[0].stringValue else {
+				return nil
+			}
+
+			if self.rows("SELECT name FROM sqlite_master WHERE type='table' AND name=\(self.literal(Value(tableName)))").isEmpty {
+				self.run("DELETE FROM \(index) WHERE fingerprint=\(self.literal(Value(fingerprint)))")
+				return nil
+			}
+
+			self.run("UPDATE \(index) SET last_used=\(Date().timeIntervalSinceReferenceDate) WHERE fingerprint=\(self.literal(Value(fingerprint)))")
+			self.tablesInUse[tableName] = (self.tablesInUse[tableName] ?? 0) + 1
+			return tableName
+		}
+	}
+
+	/** Marks a (newly created) table as being in use. */
+	func acquire(_ tableName: String) {
+		self.mutex.locked {
+			self.tablesInUse[tableName] = (self.tablesInUse[tableName] ?? 0) + 1
+		}
+	}
+
+	/** Indicates the table is no longer used by a data set. Tables that are not registered are removed. */
+	func release(_ tableName: String) {
+		self.mutex.locked {
+			let count = (self.tablesInUse[tableName] ?? 1) - 1
+			self.tablesInUse[tableName] = count > 0 ? count : nil
+
+			if count <= 0 && !self.isRegistered(tableName) {
+				self.run("DROP TABLE IF EXISTS \(self.table(tableName))")
+			}
+		}
+	}
+
+	private func isRegistered(_ tableName: String) -> Bool {
+		if !self.isPersistent {
+			return false
+		}
+		return !self.rows("SELECT fingerprint FROM \(QBESQLiteSharedCacheDatabase.indexTableName) WHERE table_name=\(self.literal(Value(tableName)))").isEmpty
+	}
+
+	/** Registers a completely written table as containing the data set with the indicated fingerprint, so that it can be
+	reused later. Any table previously registered for the fingerprint is removed (when not in use). */
+	func register(_ tableName: String, fingerprint: String, columns: OrderedSet<Column>) {
+		if !self.isPersistent || columns.isEmpty {
+			return
+		}
+
+		// Approximate the size of the table by the total size of its values
+		let lengths = columns.map { column -> String in
+			let identifier = self.connection.dialect.columnIdentifier(column, table: nil, schema: nil, database: nil)
+			return "IFNULL(LENGTH(CAST(\(identifier) AS BLOB)),0)"
+		}.joined(separator: "+")
+		let size = self.rows("SELECT TOTAL(\(lengths)) FROM \(self.table(tableName))").first?[0].doubleValue ?? 0.0
+
+		self.mutex.locked {
+			self.remove(fingerprint)
+			self.run("INSERT INTO \(QBESQLiteSharedCacheDatabase.indexTableName) (fingerprint, table_name, size, last_used) VALUES (\(self.literal(Value(fingerprint))), \(self.literal(Value(tableName))), \(Int(size)), \(Date().timeIntervalSinceReferenceDate))")
+			self.evict(budget: QBESettings.sharedInstance.cacheSizeBudget)
+		}
+	}
+
+	/** Removes the data set with the indicated fingerprint from the cache, so that it will not be reused. */
+	func remove(_ fingerprint: String) {
+		if !self.isPersistent {
+			return
+		}
+
+		self.mutex.locked {
+			let index = QBESQLiteSharedCacheDatabase.indexTableName
+			for row in self.rows("SELECT table_name FROM \(index) WHERE fingerprint=\(self.literal(Value(fingerprint)))") {
+				self.run("DELETE FROM \(index) WHERE fingerprint=\(self.literal(Value(fingerprint)))")
+				if let tableName = row[0].stringValue, self.tablesInUse[tableName] == nil {
+					self.run("DROP TABLE IF EXISTS \(self.table(tableName))")
 				}
 			}
 		}
 	}
+
+	/** Removes the least recently used tables that are not in use until the tables take up less than the budget (in
+	bytes). */
+	private func evict(budget: Int) {
+		let index = QBESQLiteSharedCacheDatabase.indexTableName
+		let entries = self.rows("SELECT fingerprint, table_name, size FROM \(index) ORDER BY last_used ASC")
+		var total = entries.reduce(0) { $0 + ($1[2].intValue ?? 0) }
+
+		for entry in entries where total > budget {
+			if let fingerprint = entry[0].stringValue, let tableName = entry[1].stringValue, self.tablesInUse[tableName] == nil {
+				self.run("DELETE FROM \(index) WHERE fingerprint=\(self.literal(Value(fingerprint)))")
+				self.run("DROP TABLE IF EXISTS \(self.table(tableName))")
+				total -= entry[2].intValue ?? 0
+			}
+		}
+		self.run("PRAGMA incremental_vacuum")
+	}
 }
 
 /**
 Cache a given Dataset data set in a SQLite table. Loading the data set into SQLite is performed asynchronously in the
 background, and the SQLite-cached data set is swapped with the original one at completion transparently. The cache is
-placed in a shared, temporary 'cache' database (sharedCacheDatabase) so that cached tables can efficiently be joined by
-SQLite. Users of this class can set a completion callback if they want to wait until caching has finished. */
+placed in a shared 'cache' database (sharedCacheDatabase) so that cached tables can efficiently be joined by SQLite.
+Users of this class can set a completion callback if they want to wait until caching has finished.
+
+When a fingerprint is given, a table cached earlier (possibly in a previous session) for the same fingerprint is used
+instead of reading the source data set, and the newly cached table is registered under the fingerprint for later reuse. */
 class QBESQLiteCachedDataset: ProxyDataset {
 	private static var sharedCacheDatabase = QBESQLiteSharedCacheDatabase()
 
@@ -258,11 +474,35 @@ class QBESQLiteCachedDataset: ProxyDataset {
 	private let mutex = Mutex()
 	private let cacheJob: Job
 	
-	init(source: Dataset, job: Job? = nil, completion: ((Fallible<QBESQLiteCachedDataset>) -> ())? = nil) {
-		database = QBESQLiteCachedDataset.sharedCacheDatabase.connection
-		tableName = "cache_\(String.randomStringWithLength(32))"
+	init(source: Dataset, fingerprint: String? = nil, job: Job? = nil, completion: ((Fallible<QBESQLiteCachedDataset>) -> ())? = nil) {
+		let cache = QBESQLiteCachedDataset.sharedCacheDatabase
+		database = cache.connection
 		self.cacheJob = job ?? Job(.background)
+
+		if let fp = fingerprint, let existingTableName = cache.lookup(fp) {
+			tableName = existingTableName
+			super.init(data: source)
+
+			switch SQLiteDataset.create(self.database, tableName: existingTableName) {
+			case .success(let cached):
+				self.cacheJob.log("Reusing cached table \(existingTableName)")
+				self.data = cached
+				self.isCached = true
+				self.cacheJob.async {
+					completion?(.success(self))
+				}
+
+			case .failure(let e):
+				self.cacheJob.async {
+					completion?(.failure(e))
+				}
+			}
+			return
+		}
+
+		tableName = "cache_\(String.randomStringWithLength(32))"
 		super.init(data: source)
+		cache.acquire(tableName)
 		
 		QBESQLiteWriterSession(data: source, toDatabase: database, tableName: tableName).start(cacheJob) { (result) -> () in
 			switch result {
@@ -276,6 +516,10 @@ class QBESQLiteCachedDataset: ProxyDataset {
 							self.data = SQLiteDataset(db: self.database, fragment: SQLFragment(table: self.tableName, schema: nil, database: nil, dialect: self.database.dialect), columns: cns)
 							self.isCached = true
 						}
+
+						if let fp = fingerprint {
+							cache.register(self.tableName, fingerprint: fp, columns: cns)
+						}
 						completion?(.success(self))
 
 					case .failure(let error):
@@ -288,16 +532,17 @@ class QBESQLiteCachedDataset: ProxyDataset {
 		}
 	}
 
+	/** Removes the data set cached under the indicated fingerprint, so that it is not reused. */
+	static func remove(fingerprint: String) {
+		self.sharedCacheDatabase.remove(fingerprint)
+	}
+
 	deinit {
 		self.mutex.locked {
 			if !self.isCached {
 				cacheJob.cancel()
 			}
-			else {
-				if case .failure(let m) = self.database.query("DROP TABLE \(self.database.dialect.tableIdentifier(self.tableName, schema: nil, database: nil))") {
-					trace("failure dropping table in deinitializer: \(m)")
-				}
-			}
+			QBESQLiteCachedDataset.sharedCacheDatabase.release(self.tableName)
 		}
 	}
 }
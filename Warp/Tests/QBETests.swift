@@ -1,6 +1,6 @@
 import XCTest
 import WarpCore
-import WarpConduit
+@testable import WarpConduit
 @testable import Warp
 
 class QBETests: XCTestCase {
@@ -55,6 +55,111 @@ class QBETests: XCTestCase {
 		return true
 	}
 
+	func testCacheFingerprint() {
+		// Dictionaries with the same contents may be enumerated in a different order; the fingerprint should not change
+		var forward: [Column: Column] = [:]
+		var backward: [Column: Column] = [:]
+		backward.reserveCapacity(1000)
+		for i in 0..<50 {
+			forward[Column("c\(i)")] = Column("r\(i)")
+			backward[Column("c\(49 - i)")] = Column("r\(49 - i)")
+		}
+
+		let a = QBERenameStep(previous: nil, renames: forward)
+		let b = QBERenameStep(previous: nil, renames: backward)
+		XCTAssertEqual(a.cacheFingerprint, b.cacheFingerprint, "Fingerprint does not depend on dictionary order")
+
+		// Steps after the step are not included
+		let next = QBERenameStep(previous: a, renames: [Column("x"): Column("y")])
+		XCTAssertEqual(a.cacheFingerprint, b.cacheFingerprint, "Fingerprint does not depend on later steps")
+		XCTAssertNotEqual(next.cacheFingerprint, a.cacheFingerprint, "Fingerprint depends on configuration")
+	}
+
+	private static func tokenize(_ text: String, maxRecords: Int = Int.max) -> [[String]] {
+		var batch = CSVBatch()
+		let tokenizer = CSVTokenizer(delimiter: UInt8(ascii: ";"))
+		let bytes = Array(text.utf8)
+		_ = bytes.withUnsafeBufferPointer { tokenizer.tokenize($0, maxRecords: maxRecords, into: &batch) }
+		return (0..<batch.recordCount).map { batch.strings(record: $0, encoding: .utf8) }
+	}
+
+	private static func readCSV(_ data: Data) -> (records: [[String]], encoding: String.Encoding) {
+		let url = URL(fileURLWithPath: NSTemporaryDirectory()).appendingPathComponent("warp-csv-\(UUID().uuidString).csv")
+		try! data.write(to: url)
+		defer {
+			try? FileManager.default.removeItem(at: url)
+		}
+
+		let reader = try! CSVReader(url: url, delimiter: UInt8(ascii: ";"), chunkSize: CSVStream.defaultBlockSize)
+		var batch = CSVBatch()
+		_ = reader.read(Int.max, into: &batch)
+		return ((0..<batch.recordCount).map { batch.strings(record: $0, encoding: reader.encoding) }, reader.encoding)
+	}
+
+	func testCSVTokenizer() {
+		// Records end with CR, LF or CRLF; empty lines are skipped and the last record need not end with a newline
+		XCTAssertEqual(QBETests.tokenize("a;b\r\nc;d\re;f\n\n\r\ng;h"), [["a", "b"], ["c", "d"], ["e", "f"], ["g", "h"]])
+		XCTAssertEqual(QBETests.tokenize(";;\n"), [["", "", ""]], "Empty fields")
+
+		// Quoted fields may contain delimiters, newlines and doubled quotes
+		XCTAssertEqual(QBETests.tokenize("\"a;\r\nb\";\"c\"\"d\";\"\"\n"), [["a;\r\nb", "c\"d", ""]])
+
+		// Whitespace around a quoted field is kept
+		XCTAssertEqual(QBETests.tokenize(" \t\"x;y\" ;z"), [[" \tx;y ", "z"]])
+
+		// An unterminated quoted field extends to the end of the data
+		XCTAssertEqual(QBETests.tokenize("a;\"bc\nd"), [["a", "bc\nd"]])
+		XCTAssertEqual(QBETests.tokenize("a;\"bc\"\""), [["a", "bc\""]])
+
+		// Delimiters and newlines are found at every position within the eight-byte words that are scanned at once
+		for length in 0..<20 {
+			let field = String(repeating: "x", count: length)
+			XCTAssertEqual(QBETests.tokenize("\(field);é\(field)\n\(field)!"), [[field, "é\(field)"], ["\(field)!"]], "Field of length \(length)")
+		}
+
+		// Reading stops after maxRecords records
+		var batch = CSVBatch()
+		let bytes = Array("1\n2\n3".utf8)
+		let (consumed, records) = bytes.withUnsafeBufferPointer { CSVTokenizer(delimiter: UInt8(ascii: ";")).tokenize($0, maxRecords: 2, into: &batch) }
+		XCTAssert(records == 2 && consumed == 3, "Tokenizer stops after the requested number of records")
+
+		// Integers are read directly from the bytes; other fields are interpreted as strings
+		var numbers = CSVBatch()
+		let numberBytes = Array("-12;007;;-;12345678901234567890;1.5".utf8)
+		_ = numberBytes.withUnsafeBufferPointer { CSVTokenizer(delimiter: UInt8(ascii: ";")).tokenize($0, maxRecords: Int.max, into: &numbers) }
+		let row = numbers.rows(columnCount: 6, locale: nil, encoding: .utf8)[0]
+		let isInt = { (value: Value, expected: Int) -> Bool in
+			if case .int(let i) = value {
+				return i == expected
+			}
+			return false
+		}
+		XCTAssert(isInt(row[0], -12), "Negative integer")
+		XCTAssert(isInt(row[1], 7), "Integer with leading zeroes")
+		XCTAssert(row[2].isEmpty, "Empty field")
+		XCTAssertEqual(row[3], Language.valueForExchangedString("-"), "A lone minus sign is not an integer")
+		XCTAssertEqual(row[4], Language.valueForExchangedString("12345678901234567890"), "Integers that may overflow are not read directly")
+		if case .int = row[4] {
+			XCTFail("Integers that may overflow should not be read as integer")
+		}
+		XCTAssertEqual(row[5], Language.valueForExchangedString("1.5"))
+
+		// Encodings are detected from the byte order mark; UTF-16 is converted to UTF-8
+		let utf8 = QBETests.readCSV(Data([0xEF, 0xBB, 0xBF]) + "a;é\n1;2".data(using: .utf8)!)
+		XCTAssertEqual(utf8.records, [["a", "é"], ["1", "2"]], "UTF-8 byte order mark is skipped")
+
+		let utf16LE = QBETests.readCSV(Data([0xFF, 0xFE]) + "a;é\r\n1;2".data(using: .utf16LittleEndian)!)
+		XCTAssertEqual(utf16LE.records, [["a", "é"], ["1", "2"]], "UTF-16 (little endian) is read")
+
+		let utf16BE = QBETests.readCSV(Data([0xFE, 0xFF]) + "a;é\n1;2".data(using: .utf16BigEndian)!)
+		XCTAssertEqual(utf16BE.records, [["a", "é"], ["1", "2"]], "UTF-16 (big endian) is read")
+
+		// Files without byte order mark that are not valid UTF-8 are read as Mac OS Roman
+		let roman = QBETests.readCSV("a;é\n".data(using: .macOSRoman)!)
+		XCTAssert(roman.encoding == .macOSRoman, "Encoding falls back to Mac OS Roman")
+		XCTAssertEqual(roman.records, [["a", "é"]])
+	}
+
 	func testCSV() {
 		let locale = Language()
 		let job = Job(.userInitiated)
@@ -143,5 +248,206 @@ class QBETests: XCTestCase {
 				}
 			}
 		}
+
+		// Test escapes in CSV when parsing blocks in parallel
+		let csv5 = CSVStream(url: url4!, fieldSeparator: ";".utf16.first!, hasHeaders: true, locale: locale, parallel: true)
+
+		asyncTest { callback in
+			StreamDataset(source: csv5).raster(job) { result in
+				result.require { raster in
+					XCTAssert(raster.columns == ["a;a","b","c"], "Wrong columns")
+					XCTAssert(QBETests.rasterEquals(raster, grid: [
+						[Value.int(1), Value.string("a;\nb"), Value.int(3)],
+						[4,5,6].map { Value.int($0) }
+					]), "Raster invalid")
+
+					callback()
+				}
+			}
+		}
+
+		// Blocks that end inside quoted fields (with newlines, delimiters and escaped quotes) when parsing in parallel
+		var text = "a;b;c\n"
+		var expected: [[Value]] = []
+		for i in 0..<200 {
+			text += "\(i);\"line \(i)\nwith ;\"\"quotes\"\" and\r\nmore\";x\(i)" + (i % 2 == 0 ? "\n" : "\r\n")
+			expected.append([Value.int(i), Value.string("line \(i)\nwith ;\"quotes\" and\r\nmore"), Value.string("x\(i)")])
+		}
+		let blocksURL = URL(fileURLWithPath: NSTemporaryDirectory()).appendingPathComponent("warp-csv-blocks-\(UUID().uuidString).csv")
+		try! text.data(using: .utf8)!.write(to: blocksURL)
+		defer {
+			try? FileManager.default.removeItem(at: blocksURL)
+		}
+
+		for blockSize in [1, 7, 16, 100, 4096] {
+			let blocksCSV = CSVStream(url: blocksURL, fieldSeparator: ";".utf16.first!, hasHeaders: true, locale: locale, parallel: true, blockSize: blockSize)
+
+			asyncTest { callback in
+				StreamDataset(source: blocksCSV).raster(job) { result in
+					result.require { raster in
+						XCTAssert(raster.rowCount == expected.count, "All records read with block size \(blockSize)")
+						XCTAssert(QBETests.rasterEquals(raster, grid: expected), "Records split correctly with block size \(blockSize)")
+						callback()
+					}
+				}
+			}
+		}
+
+		/* A quote in the middle of a field that is not quoted is read as part of the field. Counting it as the start of a
+		quoted field would cut the next (multi-line) quoted field in two, so the rest of the file is read sequentially. */
+		var strayText = "a;b\n"
+		var strayExpected: [[Value]] = []
+		for i in 0..<20 {
+			strayText += "\(i);plain \(i)\n"
+			strayExpected.append([Value.int(i), Value.string("plain \(i)")])
+		}
+		strayText += "20;x\"y\n21;\"multi\nline;with \"\" quote\r\nand more\"\n"
+		strayExpected.append([Value.int(20), Value.string("x\"y")])
+		strayExpected.append([Value.int(21), Value.string("multi\nline;with \" quote\r\nand more")])
+		for i in 22..<40 {
+			strayText += "\(i);\"quoted\n\(i)\"\n"
+			strayExpected.append([Value.int(i), Value.string("quoted\n\(i)")])
+		}
+
+		let strayURL = URL(fileURLWithPath: NSTemporaryDirectory()).appendingPathComponent("warp-csv-stray-\(UUID().uuidString).csv")
+		try! strayText.data(using: .utf8)!.write(to: strayURL)
+		defer {
+			try? FileManager.default.removeItem(at: strayURL)
+		}
+
+		for blockSize in [1, 7, 16, 100, 4096] {
+			let strayCSV = CSVStream(url: strayURL, fieldSeparator: ";".utf16.first!, hasHeaders: true, locale: locale, parallel: true, blockSize: blockSize)
+
+			asyncTest { callback in
+				StreamDataset(source: strayCSV).raster(job) { result in
+					result.require { raster in
+						XCTAssert(raster.rowCount == strayExpected.count, "All records read with a stray quote and block size \(blockSize)")
+						XCTAssert(QBETests.rasterEquals(raster, grid: strayExpected), "Quoted field after a stray quote is not split with block size \(blockSize)")
+						callback()
+					}
+				}
+			}
+		}
+
+		// The reader refuses to cut a block once it encounters the stray quote
+		let strayReader = try! CSVReader(url: strayURL, delimiter: UInt8(ascii: ";"), chunkSize: 16)
+		var blocks = 0
+		while strayReader.readBlock() != nil {
+			blocks += 1
+		}
+		XCTAssert(blocks > 0 && !strayReader.isAtEnd, "Blocks are cut up to the stray quote")
+	}
+
+	/** Reads the JSON text through a JSONStream and calls back with the resulting raster. */
+	private func readJSON(_ text: String, check: @escaping (Raster) -> ()) {
+		let url = URL(fileURLWithPath: NSTemporaryDirectory()).appendingPathComponent("warp-json-\(UUID().uuidString).json")
+		try! text.data(using: .utf8)!.write(to: url)
+		defer {
+			try? FileManager.default.removeItem(at: url)
+		}
+
+		asyncTest { callback in
+			StreamDataset(source: JSONStream(url: url)).raster(Job(.userInitiated)) { result in
+				result.require { raster in
+					check(raster)
+					callback()
+				}
+			}
+		}
+	}
+
+	/** Compares values including their type (Value's == operator considers e.g. 1 and "1" to be equal). */
+	private static func assertIdentical(_ raster: Raster, _ grid: [[Value]], _ message: String) {
+		XCTAssertEqual(raster.rowCount, grid.count, message)
+		for row in 0..<min(raster.rowCount, grid.count) {
+			XCTAssertEqual(raster[row].values.map { $0.debugDescription }, grid[row].map { $0.debugDescription }, message)
+		}
+	}
+
+	func testJSON() {
+		// Escapes and surrogate pairs
+		readJSON("[{\"s\": \"a\\\"b\\\\c\\/d\\b\\f\\n\\r\\t\\u00e9\", \"e\\u0301\": \"\\ud83d\\ude00\", \"lone\": \"\\ude00\\ud83d\"}]") { raster in
+			XCTAssert(raster.columns == ["s", "e\u{301}", "lone"], "Escapes in keys")
+			QBETests.assertIdentical(raster, [[
+				Value.string("a\"b\\c/d\u{8}\u{C}\n\r\t\u{E9}"),
+				Value.string("\u{1F600}"),
+				Value.string("\u{FFFD}\u{FFFD}")
+			]], "Escapes and surrogate pairs")
+		}
+
+		// Numbers with an integer value are read as integers; numbers that may not fit are parsed as double
+		readJSON("[1, -0, 1.5, 1e3, 2.0, 1E-2, 123456789012345678, -12345678901234567890, 1e300, true, false, null]") { raster in
+			XCTAssert(raster.columns == ["items"], "Array of values is read as a single column")
+			QBETests.assertIdentical(raster, [
+				[Value.int(1)], [Value.int(0)], [Value.double(1.5)], [Value.int(1000)], [Value.int(2)], [Value.double(0.01)],
+				[Value.int(123456789012345678)], [Value.double(-12345678901234567890.0)], [Value.double(1e300)],
+				[Value.bool(true)], [Value.bool(false)], [Value.empty]
+			], "Numbers and literals")
+		}
+
+		// Newline-delimited JSON; elements that are not objects result in empty rows
+		readJSON("{\"a\": 1}\n{\"b\": [2, {\"c\": 3}], \"a\": 4}\n\n5\r\n{\"a\": \"x\"}") { raster in
+			XCTAssert(raster.columns == ["a", "b"], "Columns in order of appearance")
+			QBETests.assertIdentical(raster, [
+				[Value.int(1), Value.empty],
+				[Value.int(4), Value.list([Value.int(2), Value.list([Value.string("c"), Value.int(3)])])],
+				[Value.empty, Value.empty],
+				[Value.string("x"), Value.empty]
+			], "Newline-delimited JSON")
+		}
+
+		// Columns are determined from the first 1000 elements; keys that first appear later are ignored
+		let elements = (0..<1500).map { i -> String in
+			switch i {
+			case 999: return "{\"a\": \(i), \"b\": true}"
+			case 1200: return "{\"a\": \(i), \"late\": true}"
+			default: return "{\"a\": \(i)}"
+			}
+		}
+		readJSON("[" + elements.joined(separator: ",\n") + "]") { raster in
+			XCTAssert(raster.columns == ["a", "b"], "Columns are inferred from the sample")
+			XCTAssertEqual(raster.rowCount, 1500, "All elements are read")
+			XCTAssert((0..<raster.rowCount).allSatisfy { raster[$0].values[0] == Value.int($0) }, "Elements are read in order")
+			XCTAssertEqual(raster[999].values[1].debugDescription, Value.bool(true).debugDescription)
+			XCTAssertEqual(raster[1200].values[1].debugDescription, Value.empty.debugDescription)
+		}
+
+		// An empty array has no columns; a single value results in a 'data' column
+		readJSON(" [ ] ") { raster in
+			XCTAssert(raster.columns.isEmpty && raster.rowCount == 0, "Empty array")
+		}
+
+		readJSON("\"hello\"") { raster in
+			XCTAssert(raster.columns == ["data"], "Single value")
+			QBETests.assertIdentical(raster, [[Value.string("hello")]], "Single value")
+		}
+
+		// A single object is a single value as well; its keys and values are returned as a list
+		readJSON("{\"a\": 1, \"b\": [2]}\n") { raster in
+			XCTAssert(raster.columns == ["data"], "Single object")
+			QBETests.assertIdentical(raster, [[Value.list([Value.string("a"), Value.int(1), Value.string("b"), Value.list([Value.int(2)])])]], "Single object")
+		}
+
+		// Whitespace after a top-level array is allowed, anything else is an error
+		readJSON("[1, 2]\r\n ") { raster in
+			QBETests.assertIdentical(raster, [[Value.int(1)], [Value.int(2)]], "Whitespace after array")
+		}
+
+		for text in ["[1, 2] 3", "[]x", "[{\"a\": 1}]\n{\"a\": 2}"] {
+			let url = URL(fileURLWithPath: NSTemporaryDirectory()).appendingPathComponent("warp-json-\(UUID().uuidString).json")
+			try! text.data(using: .utf8)!.write(to: url)
+			defer {
+				try? FileManager.default.removeItem(at: url)
+			}
+
+			asyncTest { callback in
+				StreamDataset(source: JSONStream(url: url)).raster(Job(.userInitiated)) { result in
+					if case .success(_) = result {
+						XCTFail("Content after the top-level array should be an error: \(text)")
+					}
+					callback()
+				}
+			}
+		}
 	}
 }
@@ -0,0 +1,446 @@
+/* Copyright (c) 2014-2016 Pixelspark, Tommy van der Vorst
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+import Foundation
+import WarpCore
+
+/** A set of records read from a CSV file. The (unescaped) bytes of all fields are stored contiguously in a single
+buffer; fields are identified by their end offsets in that buffer, and records by the number of fields read up to and
+including the record. No objects are created for individual fields until they are converted to values. */
+internal struct CSVBatch {
+	fileprivate(set) var bytes: [UInt8] = []
+	fileprivate(set) var fieldEnds: [Int] = []
+	fileprivate(set) var recordEnds: [Int] = []
+
+	var recordCount: Int {
+		return self.recordEnds.count
+	}
+
+	private func fieldRange(_ field: Int) -> Range<Int> {
+		return (field == 0 ? 0 : self.fieldEnds[field - 1])..<self.fieldEnds[field]
+	}
+
+	private func fieldsOfRecord(_ record: Int) -> Range<Int> {
+		return (record == 0 ? 0 : self.recordEnds[record - 1])..<self.recordEnds[record]
+	}
+
+	/** Returns the fields of the indicated record as strings. */
+	func strings(record: Int, encoding: String.Encoding) -> [String] {
+		return self.bytes.withUnsafeBufferPointer { buffer in
+			return self.fieldsOfRecord(record).map { CSVBatch.string(UnsafeBufferPointer(rebasing: buffer[self.fieldRange($0)]), encoding: encoding) }
+		}
+	}
+
+	/** Converts all records to rows of exactly `columnCount` values. Rows with more fields are truncated; rows with less
+	fields are padded with empty values. Fields are interpreted as in the indicated locale, or as exchanged strings when
+	no locale is given. */
+	func rows(columnCount: Int, locale: Language?, encoding: String.Encoding) -> [Tuple] {
+		return self.bytes.withUnsafeBufferPointer { buffer -> [Tuple] in
+			var rows: [Tuple] = []
+			rows.reserveCapacity(self.recordCount)
+
+			for record in 0..<self.recordCount {
+				let fields = self.fieldsOfRecord(record)
+				var row: Tuple = []
+				row.reserveCapacity(columnCount)
+
+				for field in fields.prefix(columnCount) {
+					row.append(CSVBatch.value(UnsafeBufferPointer(rebasing: buffer[self.fieldRange(field)]), locale: locale, encoding: encoding))
+				}
+
+				while row.count < columnCount {
+					row.append(Value.empty)
+				}
+				rows.append(row)
+			}
+			return rows
+		}
+	}
+
+	private static func string(_ bytes: UnsafeBufferPointer<UInt8>, encoding: String.Encoding) -> String {
+		if encoding == .utf8 {
+			return String(decoding: bytes, as: UTF8.self)
+		}
+		return String(bytes: bytes, encoding: encoding) ?? ""
+	}
+
+	/** Interprets a field as value. Integers (an optional minus sign followed by digits) are read directly from the
+	bytes; other fields are decoded to a string and interpreted by the locale. */
+	private static func value(_ bytes: UnsafeBufferPointer<UInt8>, locale: Language?, encoding: String.Encoding) -> Value {
+		if bytes.isEmpty {
+			return Value.empty
+		}
+
+		let negative = bytes[0] == CSVTokenizer.minus
+		let digits = negative ? bytes.count - 1 : bytes.count
+		if digits > 0 && digits <= 18 {
+			var n = 0
+			var isInteger = true
+			for i in (negative ? 1 : 0)..<bytes.count {
+				let b = bytes[i]
+				if b < CSVTokenizer.zero || b > CSVTokenizer.nine {
+					isInteger = false
+					break
+				}
+				n = n * 10 + Int(b - CSVTokenizer.zero)
+			}
+
+			if isInteger {
+				return Value.int(negative ? -n : n)
+			}
+		}
+
+		let s = string(bytes, encoding: encoding)
+		return locale != nil ? locale!.valueForLocalString(s) : Language.valueForExchangedString(s)
+	}
+}
+
+/** Splits CSV data into records and fields at the byte level. This works for UTF-8 and any other encoding in which the
+delimiter, quote and newline characters are single bytes that do not occur inside multi-byte characters.
+
+Fields may be enclosed in double quotes, in which case they may contain delimiters and newlines; a double quote inside a
+quoted field is escaped by doubling it. Whitespace around a quoted field is kept. Both CR and LF end a record, and empty
+lines are skipped. Unquoted fields are found by scanning eight bytes at a time for the delimiter and newline characters;
+quoted fields by searching for the next quote with memchr. */
+internal struct CSVTokenizer {
+	static let quote = UInt8(ascii: "\"")
+	static let cr = UInt8(ascii: "\r")
+	static let lf = UInt8(ascii: "\n")
+	static let space = UInt8(ascii: " ")
+	static let tab = UInt8(ascii: "\t")
+	static let minus = UInt8(ascii: "-")
+	static let zero = UInt8(ascii: "0")
+	static let nine = UInt8(ascii: "9")
+
+	let delimiter: UInt8
+	private let delimiterPattern: UInt64
+	private static let crPattern = CSVTokenizer.pattern(CSVTokenizer.cr)
+	private static let lfPattern = CSVTokenizer.pattern(CSVTokenizer.lf)
+
+	init(delimiter: UInt8) {
+		self.delimiter = delimiter
+		self.delimiterPattern = CSVTokenizer.pattern(delimiter)
+	}
+
+	/** Reads records from the data and appends them to the batch, until `maxRecords` records have been read or the end
+	of the data is reached. The data should end at a record boundary (the last record need not end with a newline); a
+	quoted field that is not closed extends to the end of the data. Returns the number of bytes consumed and the number
+	of records read. */
+	func tokenize(_ data: UnsafeBufferPointer<UInt8>, maxRecords: Int, into batch: inout CSVBatch) -> (consumed: Int, records: Int) {
+		guard let base = data.baseAddress else {
+			return (0, 0)
+		}
+
+		let end = data.count
+		var p = 0
+		var records = 0
+
+		while records < maxRecords {
+			// Skip (empty) lines
+			while p < end && (base[p] == CSVTokenizer.lf || base[p] == CSVTokenizer.cr) {
+				p += 1
+			}
+			if p >= end {
+				break
+			}
+
+			fields: while true {
+				// Leading whitespace is part of the field, but may precede a quoted field
+				var q = p
+				while q < end && (base[q] == CSVTokenizer.space || base[q] == CSVTokenizer.tab) && base[q] != self.delimiter {
+					q += 1
+				}
+
+				if q < end && base[q] == CSVTokenizer.quote {
+					batch.bytes.append(contentsOf: UnsafeBufferPointer(start: base + p, count: q - p))
+					p = q + 1
+
+					while p < end {
+						guard let found = memchr(base + p, Int32(CSVTokenizer.quote), end - p) else {
+							batch.bytes.append(contentsOf: UnsafeBufferPointer(start: base + p, count: end - p))
+							p = end
+							break
+						}
+
+						let length = UnsafeRawPointer(base + p).distance(to: UnsafeRawPointer(found))
+						batch.bytes.append(contentsOf: UnsafeBufferPointer(start: base + p, count: length))
+						p += length + 1
+
+						if p < end && base[p] == CSVTokenizer.quote {
+							// Escaped (doubled) quote
+							batch.bytes.append(CSVTokenizer.quote)
+							p += 1
+						}
+						else {
+							break
+						}
+					}
+
+					// Anything between the closing quote and the next delimiter or newline is kept as well
+					let stop = self.scan(base, from: p, to: end)
+					batch.bytes.append(contentsOf: UnsafeBufferPointer(start: base + p, count: stop - p))
+					p = stop
+				}
+				else {
+					let stop = self.scan(base, from: p, to: end)
+					batch.bytes.append(contentsOf: UnsafeBufferPointer(start: base + p, count: stop - p))
+					p = stop
+				}
+
+				batch.fieldEnds.append(batch.bytes.count)
+
+				if p >= end {
+					break fields
+				}
+				else if base[p] == self.delimiter {
+					p += 1
+				}
+				else {
+					// Newline; it is skipped when looking for the next record
+					break fields
+				}
+			}
+
+			batch.recordEnds.append(batch.fieldEnds.count)
+			records += 1
+		}
+
+		return (p, records)
+	}
+
+	/** Whether a quote at `position` opens a quoted field, i.e. whether only spaces and tabs precede it since the start of
+	the data or the last delimiter or newline. Elsewhere, a quote is read as part of the field (see tokenize). */
+	func opensField(_ base: UnsafePointer<UInt8>, at position: Int) -> Bool {
+		var i = position
+		while i > 0 && (base[i - 1] == CSVTokenizer.space || base[i - 1] == CSVTokenizer.tab) && base[i - 1] != self.delimiter {
+			i -= 1
+		}
+		return i == 0 || base[i - 1] == self.delimiter || base[i - 1] == CSVTokenizer.cr || base[i - 1] == CSVTokenizer.lf
+	}
+
+	/** Whether a quote at `position` that is not an escaped quote inside a quoted field is followed by another quote
+	(escaping it), or only by spaces and tabs before the next delimiter or newline. In the latter case the tokenizer
+	reads the rest of the field as is, including any quotes in it. */
+	func closesField(_ base: UnsafePointer<UInt8>, at position: Int, end: Int) -> Bool {
+		var i = position + 1
+		if i < end && base[i] == CSVTokenizer.quote {
+			return true
+		}
+		while i < end && (base[i] == CSVTokenizer.space || base[i] == CSVTokenizer.tab) && base[i] != self.delimiter {
+			i += 1
+		}
+		return i >= end || base[i] == self.delimiter || base[i] == CSVTokenizer.cr || base[i] == CSVTokenizer.lf
+	}
+
+	/** Returns the position of the first delimiter or newline at or after `start`, or `end` if there is none. */
+	private func scan(_ base: UnsafePointer<UInt8>, from start: Int, to end: Int) -> Int {
+		var i = start
+		while i + 8 <= end {
+			var word: UInt64 = 0
+			memcpy(&word, base + i, 8)
+			word = UInt64(littleEndian: word)
+
+			let matches = CSVTokenizer.matches(word, self.delimiterPattern) | CSVTokenizer.matches(word, CSVTokenizer.crPattern) | CSVTokenizer.matches(word, CSVTokenizer.lfPattern)
+			if matches != 0 {
+				return i + (matches.trailingZeroBitCount >> 3)
+			}
+			i += 8
+		}
+
+		while i < end {
+			let b = base[i]
+			if b == self.delimiter || b == CSVTokenizer.cr || b == CSVTokenizer.lf {
+				return i
+			}
+			i += 1
+		}
+		return end
+	}
+
+	private static func pattern(_ byte: UInt8) -> UInt64 {
+		return UInt64(byte) &* 0x0101010101010101
+	}
+
+	/** Returns a word in which the high bit is set for bytes in `word` that equal the byte repeated in `pattern`. Only
+	the lowest set bit is guaranteed to be exact, which is all `scan` needs. */
+	@inline(__always) private static func matches(_ word: UInt64, _ pattern: UInt64) -> UInt64 {
+		let x = word ^ pattern
+		return (x &- 0x0101010101010101) & ~x & 0x8080808080808080
+	}
+}
+
+/** Reads records from a CSV file, and tokenizes them using CSVTokenizer. The file is memory-mapped (see MappedFile), so
+that the tokenizer reads directly from the mapped pages. The encoding of the file is detected from its byte order mark.
+Files without one are read as UTF-8 when the first chunk is valid UTF-8, and as Mac OS Roman otherwise. UTF-16 and
+UTF-32 files are converted to UTF-8 in memory first. */
+internal final class CSVReader {
+	/** The number of bytes at the start of the file that are inspected to detect its encoding. */
+	static let detectionSize = 1024 * 1024
+
+	/** The minimum size of a block returned by readBlock. */
+	let chunkSize: Int
+
+	let tokenizer: CSVTokenizer
+	private let file: MappedFile
+	private let bytes: UnsafeBufferPointer<UInt8>
+	private var converted: UnsafeMutableBufferPointer<UInt8>? = nil
+	private var position = 0
+	private(set) var encoding: String.Encoding = .utf8
+
+	init(url: URL, delimiter: UInt8, chunkSize: Int) throws {
+		self.chunkSize = max(1, chunkSize)
+		self.tokenizer = CSVTokenizer(delimiter: delimiter)
+		self.file = try MappedFile(url: url)
+
+		let byteOrderMarks: [([UInt8], String.Encoding)] = [
+			([0x00, 0x00, 0xFE, 0xFF], .utf32BigEndian),
+			([0xFF, 0xFE, 0x00, 0x00], .utf32LittleEndian),
+			([0xFE, 0xFF], .utf16BigEndian),
+			([0xFF, 0xFE], .utf16LittleEndian)
+		]
+
+		let mapped = self.file.bytes
+		let first = UnsafeBufferPointer(rebasing: mapped[0..<min(CSVReader.detectionSize, mapped.count)])
+
+		if let (bom, encoding) = byteOrderMarks.first(where: { first.starts(with: $0.0) }) {
+			// Multi-byte encodings cannot be tokenized at the byte level; convert the whole file to UTF-8
+			guard let string = String(bytes: mapped.dropFirst(bom.count), encoding: encoding) else {
+				throw CSVReaderError.invalidEncoding
+			}
+			let utf8 = Array(string.utf8)
+			let converted = UnsafeMutableBufferPointer<UInt8>.allocate(capacity: utf8.count)
+			_ = converted.initialize(from: utf8)
+			self.converted = converted
+			self.bytes = UnsafeBufferPointer(converted)
+			return
+		}
+
+		self.bytes = mapped
+
+		if first.starts(with: [0xEF, 0xBB, 0xBF]) {
+			self.position = 3
+		}
+		else if !(0..<min(4, first.count + 1)).contains(where: { String(bytes: first.dropLast($0), encoding: .utf8) != nil }) {
+			self.encoding = .macOSRoman
+		}
+	}
+
+	deinit {
+		self.converted?.deallocate()
+	}
+
+	/** The (approximate) number of bytes of the file that have been read so far. */
+	var bytesRead: Int {
+		if self.converted != nil {
+			return self.bytes.isEmpty ? 0 : Int(Double(self.position) / Double(self.bytes.count) * Double(self.file.count))
+		}
+		return self.position
+	}
+
+	/** Reads at most `maxRecords` records into the batch. Returns false when the end of the file has been reached. */
+	func read(_ maxRecords: Int, into batch: inout CSVBatch) -> Bool {
+		let (consumed, _) = self.tokenizer.tokenize(UnsafeBufferPointer(rebasing: self.bytes[self.position...]), maxRecords: maxRecords, into: &batch)
+		self.position += consumed
+		return !self.isAtEnd
+	}
+
+	/** Whether all data in the file has been read. */
+	var isAtEnd: Bool {
+		return self.position >= self.bytes.count
+	}
+
+	/** Returns the next block of whole records, which can be tokenized independently of the rest of the file. Blocks are
+	at least `chunkSize` bytes long, except for the last one. The block points into the mapped file, and remains valid for
+	as long as the reader exists. Returns nil when the end of the file has been reached, or when no block boundary can be
+	found that is known to be safe. In the latter case the reader does not advance, and the rest of the file should be
+	read sequentially (see read).
+
+	A block ends after the first newline at or after `chunkSize` bytes that is not inside a quoted field. As each block
+	starts at a record boundary, whether a position is inside a quoted field follows from the number of quotes between
+	the start of the block and that position. This only requires finding quotes and newlines (rather than tokenizing the
+	data), so that blocks can be cut much faster than they can be parsed. Counting quotes only matches the tokenizer
+	when every quote opens a field, closes one or is escaped (see CSVTokenizer.opensField and closesField). A quote
+	elsewhere (e.g. in the middle of a field that is not quoted) is read as part of the field by the tokenizer, so
+	counting it could put the boundary inside a quoted field. */
+	func readBlock() -> UnsafeBufferPointer<UInt8>? {
+		if self.isAtEnd {
+			return nil
+		}
+
+		let base = self.bytes.baseAddress! + self.position
+		let available = self.bytes.count - self.position
+		var inQuotes = false
+		var previousQuote = -2
+
+		// Toggles inQuotes for a quote at the position, or returns false if the quote may not be read as counted
+		let quote = { (position: Int) -> Bool in
+			if inQuotes {
+				if !self.tokenizer.closesField(base, at: position, end: available) {
+					return false
+				}
+			}
+			else if position != previousQuote + 1 && !self.tokenizer.opensField(base, at: position) {
+				return false
+			}
+			inQuotes = !inQuotes
+			previousQuote = position
+			return true
+		}
+
+		// Count the quotes in the first chunkSize bytes to find out whether the boundary falls inside a quoted field
+		var offset = min(self.chunkSize, available)
+		var p = 0
+		while p < offset, let found = memchr(base + p, Int32(CSVTokenizer.quote), offset - p) {
+			let position = UnsafeRawPointer(base).distance(to: UnsafeRawPointer(found))
+			if !quote(position) {
+				return nil
+			}
+			p = position + 1
+		}
+
+		// Find the first newline outside quotes from there
+		while offset < available {
+			let b = base[offset]
+			if b == CSVTokenizer.quote {
+				if !quote(offset) {
+					return nil
+				}
+			}
+			else if !inQuotes && (b == CSVTokenizer.lf || b == CSVTokenizer.cr) {
+				offset += 1
+				break
+			}
+			offset += 1
+		}
+
+		let block = UnsafeBufferPointer(start: base, count: offset)
+		self.position += offset
+
+		// Have the kernel read in the next block while this one is being parsed
+		if self.converted == nil {
+			self.file.willNeed(self.position..<(self.position + self.chunkSize))
+		}
+		return block
+	}
+
+	enum CSVReaderError: Error, CustomStringConvertible {
+		case invalidEncoding
+
+		var description: String {
+			switch self {
+			case .invalidEncoding: return "The file could not be read in the encoding indicated by its byte order mark"
+			}
+		}
+	}
+}
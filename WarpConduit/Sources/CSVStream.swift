@@ -15,15 +15,26 @@ OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
 import Foundation
 import WarpCore
 
-public final class CSVStream: NSObject, WarpCore.Stream, CHCSVParserDelegate {
-	let parser: CHCSVParser
+/** Streams rows from a CSV file. The file is memory-mapped and tokenized at the byte level by CSVReader; the conversion
+of fields to values happens asynchronously, so that the reader can continue with the next batch meanwhile.
+
+In parallel mode, each call to fetch only cuts the next block of whole records from the file (see CSVReader.readBlock)
+and tokenizes it asynchronously, so that concurrent fetches ('wavefronts') parse blocks on different cores. Blocks are
+claimed in the order in which fetch is called, which allows StreamPuller to reassemble them in order. Blocks are at
+least `blockSize` bytes long. When a block boundary cannot be found safely (e.g. because of a quote in the middle of a
+field), the rest of the file is read sequentially. */
+public final class CSVStream: NSObject, WarpCore.Stream {
 	let url: URL
 
+	private var reader: CSVReader? = nil
+	private var error: String? = nil
 	private var columns: OrderedSet<Column> = []
 	private var finished: Bool = false
-	private var templateRow: [String?] = []
-	private var row: [String?] = []
-	private var rows: [[String?]] = []
+	private var pending = CSVBatch()
+
+	/** Set in parallel mode when the file cannot be cut into blocks safely (see CSVReader.readBlock), after which the
+	remaining records are read sequentially. */
+	private var readsSequentially = false
 	private var queue: DispatchQueue
 	private var rowsRead: Int = 0
 	private var totalBytes: Int = 0
@@ -31,16 +42,24 @@ public final class CSVStream: NSObject, WarpCore.Stream, CHCSVParserDelegate {
 	let hasHeaders: Bool
 	let fieldSeparator: unichar
 	let locale: Language?
+	let parallel: Bool
+	let blockSize: Int
+	private let sizer = BatchSizer()
+
+	/** The default (minimum) size in bytes of the blocks that are parsed concurrently in parallel mode. */
+	public static let defaultBlockSize = 1024 * 1024
 
 	#if DEBUG
 	private var totalTime: TimeInterval = 0.0
 	#endif
 
-	public init(url: URL, fieldSeparator: unichar, hasHeaders: Bool, locale: Language?) {
+	public init(url: URL, fieldSeparator: unichar, hasHeaders: Bool, locale: Language?, parallel: Bool = false, blockSize: Int = CSVStream.defaultBlockSize) {
 		self.url = url
 		self.hasHeaders = hasHeaders
 		self.fieldSeparator = fieldSeparator
 		self.locale = locale
+		self.parallel = parallel
+		self.blockSize = blockSize
 
 		// Get total file size
 		let p = url.path
@@ -52,62 +71,91 @@ public final class CSVStream: NSObject, WarpCore.Stream, CHCSVParserDelegate {
 			totalBytes = 0
 		}
 
-		// Create a queue and initialize the parser
+		// Create a queue and initialize the reader
 		queue = DispatchQueue(label: "nl.pixelspark.qbe.QBECSVStreamQueue", qos: .userInitiated, attributes: [], target: nil)
-		parser = CHCSVParser(contentsOfDelimitedURL: url as NSURL as URL, delimiter: fieldSeparator)
-		parser.sanitizesFields = true
 		super.init()
 
-		parser.delegate = self
-		parser._beginDocument()
-		finished = !parser._parseRecord()
-
-		if hasHeaders {
-			// Load column names, avoiding duplicate names
-			let columns = row.map({Column($0 ?? "")})
-			self.columns = []
+		if fieldSeparator >= 128 {
+			self.error = "The field separator must be an ASCII character"
+			self.finished = true
+			return
+		}
 
-			for columnName in columns {
-				if self.columns.contains(columnName) {
-					let count = self.columns.reduce(0, { (n, item) in return n + (item == columnName ? 1 : 0) })
-					self.columns.append(Column("\(columnName.name)_\(Column.defaultNameForIndex(count).name)"))
-				}
-				else {
-					self.columns.append(columnName)
+		do {
+			let reader = try CSVReader(url: url, delimiter: UInt8(fieldSeparator), chunkSize: blockSize)
+			self.reader = reader
+
+			// Read the first record, which contains the column names or determines the number of columns
+			var first = CSVBatch()
+			self.finished = !reader.read(1, into: &first)
+			let fields = first.recordCount > 0 ? first.strings(record: 0, encoding: reader.encoding) : []
+
+			if hasHeaders {
+				// Load column names, avoiding duplicate names
+				self.columns = []
+
+				for columnName in fields.map({ Column($0) }) {
+					if self.columns.contains(columnName) {
+						let count = self.columns.reduce(0, { (n, item) in return n + (item == columnName ? 1 : 0) })
+						self.columns.append(Column("\(columnName.name)_\(Column.defaultNameForIndex(count).name)"))
+					}
+					else {
+						self.columns.append(columnName)
+					}
 				}
 			}
+			else {
+				for i in 0..<fields.count {
+					columns.append(Column.defaultNameForIndex(i))
+				}
 
-			rows.removeAll(keepingCapacity: true)
-		}
-		else {
-			for i in 0..<row.count {
-				columns.append(Column.defaultNameForIndex(i))
+				// The first record is data, and will be returned by the first call to fetch
+				self.pending = first
 			}
 		}
-
-		templateRow = Array<String?>(repeating: nil, count: columns.count)
+		catch {
+			self.error = String(describing: error)
+			self.finished = true
+		}
 	}
 
 	public func columns(_ job: Job, callback: @escaping (Fallible<OrderedSet<Column>>) -> ()) {
+		if let e = self.error {
+			callback(.failure(e))
+			return
+		}
 		callback(.success(columns))
 	}
 
 	public func fetch(_ job: Job, consumer: @escaping Sink) {
+		if let e = self.error {
+			consumer(.failure(e), .finished)
+			return
+		}
+
+		if self.parallel {
+			self.fetchBlock(job, consumer: consumer)
+			return
+		}
+
 		queue.sync {
-			job.time("Parse CSV", items: StreamDefaultBatchSize, itemType: "row") {
+			var batch = self.pending
+			self.pending = CSVBatch()
+			let batchSize = self.sizer.size
+			let readStarted = CFAbsoluteTimeGetCurrent()
+
+			job.time("Parse CSV", items: batchSize, itemType: "row") {
 				#if DEBUG
 					let startTime = NSDate.timeIntervalSinceReferenceDate
 				#endif
-				var fetched = 0
-				while !self.finished && (fetched < StreamDefaultBatchSize) && !job.isCancelled {
-					self.finished = !self.parser._parseRecord()
-					fetched += 1
+				if let reader = self.reader, !self.finished && !job.isCancelled {
+					self.finished = !reader.read(max(0, batchSize - batch.recordCount), into: &batch)
 				}
 
 				// Calculate progress
-				self.rowsRead += fetched
-				if self.totalBytes > 0 {
-					let progress = Double(self.parser.totalBytesRead) / Double(self.totalBytes)
+				self.rowsRead += batch.recordCount
+				if self.totalBytes > 0, let reader = self.reader {
+					let progress = Double(reader.bytesRead) / Double(self.totalBytes)
 					job.reportProgress(progress, forKey: self.hashValue);
 				}
 				#if DEBUG
@@ -115,36 +163,64 @@ public final class CSVStream: NSObject, WarpCore.Stream, CHCSVParserDelegate {
 				#endif
 			}
 
-			let r = Array(self.rows)
-			self.rows.removeAll(keepingCapacity: true)
-
 			let finished = self.finished
+			let columnCount = self.columns.count
+			let encoding = self.reader?.encoding ?? .utf8
+			let readDuration = CFAbsoluteTimeGetCurrent() - readStarted
 
 			job.async {
-				/* Convert the read string values to Values. Do this asynchronously because Language.valueForLocalString
-				may take a lot of time, and we really want the CSV parser to continue meanwhile */
-				let v = r.map { row -> [Value] in
-					var values = row.map { field -> Value in
-						if let value = field {
-							return self.locale != nil ? self.locale!.valueForLocalString(value) : Language.valueForExchangedString(value)
-						}
-						return Value.empty
-					}
+				/* Convert the fields to Values. Do this asynchronously because Language.valueForLocalString may take a 
+				lot of time, and we really want the CSV reader to continue meanwhile */
+				let convertStarted = CFAbsoluteTimeGetCurrent()
+				let v = batch.rows(columnCount: columnCount, locale: self.locale, encoding: encoding)
+				self.sizer.observe(v, duration: readDuration + CFAbsoluteTimeGetCurrent() - convertStarted)
+				consumer(.success(v), finished ? .finished : .hasMore)
+			}
+		}
+	}
 
-					// If the row contains more fields than we want, chop off the last ones
-					if values.count > self.columns.count {
-						values = Array(values[0..<self.columns.count])
-					}
-					else {
-						// If there are less fields in the row then there are columns, pad with nils
-						while values.count < self.columns.count {
-							values.append(Value.empty)
+	private func fetchBlock(_ job: Job, consumer: @escaping Sink) {
+		queue.sync {
+			var first = self.pending
+			self.pending = CSVBatch()
+
+			var block: UnsafeBufferPointer<UInt8>? = nil
+			if let reader = self.reader, !self.finished && !job.isCancelled {
+				if !self.readsSequentially, let b = reader.readBlock() {
+					block = b
+					self.finished = reader.isAtEnd
+				}
+				else if !reader.isAtEnd {
+					// No block boundary could be found that is known to be safe; read the rest of the file sequentially
+					self.readsSequentially = true
+					self.finished = !reader.read(max(0, self.sizer.size - first.recordCount), into: &first)
+				}
+				else {
+					self.finished = true
+				}
+
+				if self.totalBytes > 0 {
+					job.reportProgress(Double(reader.bytesRead) / Double(self.totalBytes), forKey: self.hashValue)
+				}
+			}
+
+			let finished = self.finished
+			let columnCount = self.columns.count
+			let encoding = self.reader?.encoding ?? .utf8
+			let reader = self.reader
+
+			job.async {
+				var batch = first
+				if let b = block, let r = reader {
+					// The block points into the file mapped by the reader, which must be kept alive until it is parsed
+					job.time("Parse CSV block", items: b.count, itemType: "bytes") {
+						withExtendedLifetime(r) {
+							_ = r.tokenizer.tokenize(b, maxRecords: Int.max, into: &batch)
 						}
 					}
-
-					return values
 				}
 
+				let v = batch.rows(columnCount: columnCount, locale: self.locale, encoding: encoding)
 				consumer(.success(v), finished ? .finished : .hasMore)
 			}
 		}
@@ -152,30 +228,13 @@ public final class CSVStream: NSObject, WarpCore.Stream, CHCSVParserDelegate {
 
 	#if DEBUG
 	deinit {
-		if self.totalTime > 0 {
-			trace("Read \(self.parser.totalBytesRead) in \(self.totalTime) ~= \((Double(self.parser.totalBytesRead) / 1024.0 / 1024.0)/self.totalTime) MiB/s")
+		if self.totalTime > 0, let bytesRead = self.reader?.bytesRead {
+			trace("Read \(bytesRead) in \(self.totalTime) ~= \((Double(bytesRead) / 1024.0 / 1024.0)/self.totalTime) MiB/s")
 		}
 	}
 	#endif
 
-	public func parser(_ parser: CHCSVParser, didBeginLine line: UInt) {
-		row = templateRow
-	}
-
-	public func parser(_ parser: CHCSVParser, didEndLine line: UInt) {
-		rows.append(row)
-	}
-
-	public func parser(_ parser: CHCSVParser, didReadField field: String, at index: Int) {
-		if index >= row.count {
-			row.append(field)
-		}
-		else {
-			row[index] = field
-		}
-	}
-
 	public func clone() -> WarpCore.Stream {
-		return CSVStream(url: url, fieldSeparator: fieldSeparator, hasHeaders: self.hasHeaders, locale: self.locale)
+		return CSVStream(url: url, fieldSeparator: fieldSeparator, hasHeaders: self.hasHeaders, locale: self.locale, parallel: self.parallel, blockSize: self.blockSize)
 	}
 }
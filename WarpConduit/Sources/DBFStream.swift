@@ -15,114 +15,337 @@ OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
 import Foundation
 import WarpCore
 
-final public class DBFStream: NSObject, WarpCore.Stream {
-	let url: URL
+/** Shapelib reads files through a set of hooks (SAHooks). These hooks read from a memory-mapped file (see MappedFile),
+so that reading a record is a copy from the mapped pages instead of a seek and read system call. Only read access is
+supported. */
+private final class MappedFileCursor {
+	let file: MappedFile
+	var offset = 0
 
-	private var queue = DispatchQueue(label: "nl.pixelspark.Warp.QBEDBFStream")
-	private let handle: DBFHandle?
-	private let recordCount: Int32
-	private let fieldCount: Int32
-	private var columns: OrderedSet<Column>? = nil
-	private var types: [DBFFieldType]? = nil
-	private var position: Int32 = 0
-	private var mutex = Mutex()
+	init(file: MappedFile) {
+		self.file = file
+	}
 
-	public init(url: URL) {
-		self.url = url
-		self.handle = DBFOpen((url as NSURL).fileSystemRepresentation, "rb")
-		if self.handle == nil {
-			self.fieldCount = 0
-			self.recordCount = 0
+	static func from(_ file: SAFile?) -> MappedFileCursor {
+		return Unmanaged<MappedFileCursor>.fromOpaque(UnsafeRawPointer(file!)).takeUnretainedValue()
+	}
+}
+
+private extension SAHooks {
+	static var mappedFileHooks: SAHooks {
+		var hooks = SAHooks()
+
+		hooks.FOpen = { filename, access in
+			guard let filename = filename, let access = access, !String(cString: access).contains("+") && !String(cString: access).contains("w") else {
+				return nil
+			}
+
+			guard let file = try? MappedFile(url: URL(fileURLWithPath: String(cString: filename))) else {
+				return nil
+			}
+			return Unmanaged.passRetained(MappedFileCursor(file: file)).toOpaque().assumingMemoryBound(to: Int32.self)
 		}
-		else {
-			self.recordCount = DBFGetRecordCount(self.handle)
-			self.fieldCount = DBFGetFieldCount(self.handle)
+
+		hooks.FRead = { destination, size, count, file in
+			let cursor = MappedFileCursor.from(file)
+			let bytes = cursor.file.bytes
+			guard let destination = destination, let source = bytes.baseAddress, size > 0 else {
+				return 0
+			}
+
+			let available = max(0, bytes.count - cursor.offset)
+			let items = min(Int(count), available / Int(size))
+			memcpy(destination, source + cursor.offset, items * Int(size))
+			cursor.offset += items * Int(size)
+			return SAOffset(items)
+		}
+
+		hooks.FWrite = { _, _, _, _ in
+			return 0
+		}
+
+		hooks.FSeek = { file, offset, whence in
+			let cursor = MappedFileCursor.from(file)
+
+			// SAOffset is unsigned; offsets relative to the current position or the end may be negative (wrapped around)
+			let delta = Int(bitPattern: offset)
+			let target: (partialValue: Int, overflow: Bool)
+			switch whence {
+			case SEEK_SET: target = (delta, false)
+			case SEEK_CUR: target = cursor.offset.addingReportingOverflow(delta)
+			case SEEK_END: target = cursor.file.count.addingReportingOverflow(delta)
+			default: return SAOffset(bitPattern: -1)
+			}
+
+			if target.overflow || target.partialValue < 0 {
+				return SAOffset(bitPattern: -1)
+			}
+			cursor.offset = target.partialValue
+			return 0
+		}
+
+		hooks.FTell = { file in
+			return SAOffset(MappedFileCursor.from(file).offset)
+		}
+
+		hooks.FFlush = { _ in
+			return 0
 		}
+
+		hooks.FClose = { file in
+			Unmanaged<MappedFileCursor>.fromOpaque(UnsafeRawPointer(file!)).release()
+			return 0
+		}
+
+		hooks.Remove = { _ in
+			return -1
+		}
+
+		hooks.Error = { message in
+			if let m = message {
+				trace("Shapelib: \(String(cString: m))")
+			}
+		}
+
+		hooks.Atof = { string in
+			return atof(string!)
+		}
+
+		return hooks
 	}
+}
 
-	deinit {
-		DBFClose(handle)
+/** Decodes DBF records directly from the memory-mapped file. Shapelib loads a record into a buffer, and then copies (and
+for numbers, parses) a single field each time an attribute is read. Here each record is located once, and all of its
+fields are parsed in place. Values are interpreted the way shapelib does: they are trimmed of spaces, and NULL values are
+recognized as in DBFIsAttributeNULL. As the decoder does not modify any state, records can be decoded concurrently. */
+private struct DBFRecordDecoder {
+	private struct Field {
+		let offset: Int
+		let size: Int
+		let type: DBFFieldType
+		let nativeType: UInt8
 	}
 
-	public func columns(_ job: Job, callback: @escaping (Fallible<OrderedSet<Column>>) -> ()) {
-		if self.columns == nil {
-			let fieldCount = self.fieldCount
-			var fields: OrderedSet<Column> = []
-			var types: [DBFFieldType] = []
-			for i in 0..<fieldCount {
-				var fieldName =  [CChar](repeating: 0, count: 12)
-				let type = DBFGetFieldInfo(handle, i, &fieldName, nil, nil)
-				if let fieldNameString = String(cString: fieldName, encoding: String.Encoding.utf8) {
-					fields.append(Column(fieldNameString))
-					types.append(type)
-				}
+	let columns: OrderedSet<Column>
+	let recordCount: Int
+	private let file: MappedFile
+	private let headerLength: Int
+	private let recordLength: Int
+	private let fields: [Field]
+	private let maximumFieldSize: Int
+
+	init(handle: DBFHandle, file: MappedFile) {
+		let info = handle.pointee
+		var columns: OrderedSet<Column> = []
+		var fields: [Field] = []
+
+		for i in 0..<info.nFields {
+			var fieldName = [CChar](repeating: 0, count: 12)
+			let type = DBFGetFieldInfo(handle, i, &fieldName, nil, nil)
+			if let fieldNameString = String(cString: fieldName, encoding: String.Encoding.utf8) {
+				columns.append(Column(fieldNameString))
+				let index = Int(i)
+				fields.append(Field(offset: Int(info.panFieldOffset[index]), size: Int(info.panFieldSize[index]), type: type, nativeType: UInt8(bitPattern: info.pachFieldType[index])))
 			}
-			self.types = types
-			columns = fields
 		}
 
-		callback(.success(columns!))
+		self.columns = columns
+		self.fields = fields
+		self.file = file
+		self.headerLength = Int(info.nHeaderLength)
+		self.recordLength = Int(info.nRecordLength)
+		self.maximumFieldSize = fields.map { $0.size }.max() ?? 0
+
+		// Files that are cut short are read up to the last complete record
+		let available = self.recordLength > 0 ? max(0, file.count - self.headerLength) / self.recordLength : 0
+		self.recordCount = min(Int(info.nRecords), available)
 	}
 
-	public func fetch(_ job: Job, consumer: @escaping Sink) {
-		(self.queue).async {
-			self.columns(job) { (columns) -> () in
-                let (start, end): (Int32, Int32) = self.mutex.locked { () -> (Int32, Int32) in
-                    let start = self.position
-					let end = min(self.recordCount, start + Int32(StreamDefaultBatchSize))
-					self.position = end
-					return (start, end)
+	/** Decodes the records in the indicated range. Deleted records are skipped. */
+	func rows(_ records: Range<Int>) -> [Tuple] {
+		guard let base = self.file.bytes.baseAddress else {
+			return []
+		}
+
+		var rows: [Tuple] = []
+		rows.reserveCapacity(records.count)
+
+		// Scratch buffer to pass numbers to strtod as NUL-terminated string
+		var scratch = [CChar](repeating: 0, count: self.maximumFieldSize + 1)
+
+		scratch.withUnsafeMutableBufferPointer { scratch in
+			for record in records {
+				let recordBytes = base + self.headerLength + record * self.recordLength
+				if recordBytes[0] == UInt8(ascii: "*") {
+					continue
 				}
 
-				var rows: [Tuple] = []
-				for recordIndex in start..<end {
-					if DBFIsRecordDeleted(self.handle, recordIndex) == 0 {
-						var row: Tuple = []
-						for fieldIndex in 0..<self.fieldCount {
-							if DBFIsAttributeNULL(self.handle, recordIndex, fieldIndex) != 0 {
-								row.append(Value.empty)
-							}
-							else {
-								switch self.types![Int(fieldIndex)].rawValue {
-								case FTString.rawValue:
-									if let s = String(cString: DBFReadStringAttribute(self.handle, recordIndex, fieldIndex), encoding: String.Encoding.utf8) {
-										row.append(Value.string(s))
-									}
-									else {
-										row.append(Value.invalid)
-									}
-
-								case FTInteger.rawValue:
-									row.append(Value.int(Int(DBFReadIntegerAttribute(self.handle, recordIndex, fieldIndex))))
-
-								case FTDouble.rawValue:
-									row.append(Value.double(DBFReadDoubleAttribute(self.handle, recordIndex, fieldIndex)))
-
-								case FTInvalid.rawValue:
-									row.append(Value.invalid)
-
-								case FTLogical.rawValue:
-									// TODO: this needs to be translated to a BoolValue. However, no idea how logical values are stored in DBF..
-									row.append(Value.invalid)
-
-								default:
-									row.append(Value.invalid)
-								}
-							}
-						}
-
-						rows.append(row)
-					}
+				var row: Tuple = []
+				row.reserveCapacity(self.fields.count)
+				for field in self.fields {
+					row.append(self.value(UnsafeBufferPointer(start: recordBytes + field.offset, count: field.size), field: field, scratch: scratch))
 				}
+				rows.append(row)
+			}
+		}
+
+		return rows
+	}
 
+	private static let space = UInt8(ascii: " ")
 
-				job.async {
-					let status = self.mutex.locked { () -> StreamStatus in
-						return (self.position < (self.recordCount-1)) ? .hasMore : .finished
+	private func value(_ bytes: UnsafeBufferPointer<UInt8>, field: Field, scratch: UnsafeMutableBufferPointer<CChar>) -> Value {
+		// Fields end at the first NUL byte (if any), and are trimmed of spaces
+		var end = bytes.firstIndex(of: 0) ?? bytes.count
+		var start = 0
+		while start < end && bytes[start] == DBFRecordDecoder.space {
+			start += 1
+		}
+		while end > start && bytes[end - 1] == DBFRecordDecoder.space {
+			end -= 1
+		}
+		let trimmed = UnsafeBufferPointer(rebasing: bytes[start..<end])
+
+		// Recognize NULL values as DBFIsValueNULL does
+		switch field.nativeType {
+		case UInt8(ascii: "N"), UInt8(ascii: "F"):
+			if trimmed.isEmpty || trimmed[0] == UInt8(ascii: "*") {
+				return Value.empty
+			}
+
+		case UInt8(ascii: "D"):
+			if trimmed.count >= 8 && trimmed.prefix(8).allSatisfy({ $0 == UInt8(ascii: "0") }) {
+				return Value.empty
+			}
+
+		case UInt8(ascii: "L"):
+			if trimmed.isEmpty || trimmed[0] == UInt8(ascii: "?") {
+				return Value.empty
+			}
+
+		default:
+			if trimmed.isEmpty {
+				return Value.empty
+			}
+		}
+
+		switch field.type.rawValue {
+		case FTString.rawValue:
+			if let s = String(bytes: trimmed, encoding: String.Encoding.utf8) {
+				return Value.string(s)
+			}
+			return Value.invalid
+
+		case FTInteger.rawValue:
+			// Integer fields are at most nine digits wide, so the value always fits
+			var integer = 0
+			var negative = false
+			for (index, byte) in trimmed.enumerated() {
+				if index == 0 && (byte == UInt8(ascii: "-") || byte == UInt8(ascii: "+")) {
+					negative = byte == UInt8(ascii: "-")
+				}
+				else if byte >= UInt8(ascii: "0") && byte <= UInt8(ascii: "9") {
+					integer = integer * 10 + Int(byte - UInt8(ascii: "0"))
+				}
+				else {
+					// Not a plain integer (e.g. it has a fraction), parse as number and truncate as shapelib does
+					let number = self.double(trimmed, scratch: scratch)
+					if number.isFinite, let truncated = Int32(exactly: number.rounded(.towardZero)) {
+						return Value.int(Int(truncated))
 					}
-					consumer(.success(Array(rows)), status)
+
+					// Values such as 'nan' or '1e99' do not fit in an integer field
+					return Value.invalid
+				}
+			}
+			return Value.int(negative ? -integer : integer)
+
+		case FTDouble.rawValue:
+			return Value.double(self.double(trimmed, scratch: scratch))
+
+		case FTLogical.rawValue:
+			switch trimmed[0] {
+			case UInt8(ascii: "T"), UInt8(ascii: "t"), UInt8(ascii: "Y"), UInt8(ascii: "y"):
+				return Value.bool(true)
+
+			case UInt8(ascii: "F"), UInt8(ascii: "f"), UInt8(ascii: "N"), UInt8(ascii: "n"):
+				return Value.bool(false)
+
+			default:
+				return Value.invalid
+			}
+
+		default:
+			return Value.invalid
+		}
+	}
+
+	private func double(_ bytes: UnsafeBufferPointer<UInt8>, scratch: UnsafeMutableBufferPointer<CChar>) -> Double {
+		let count = min(bytes.count, scratch.count - 1)
+		for i in 0..<count {
+			scratch[i] = CChar(bitPattern: bytes[i])
+		}
+		scratch[count] = 0
+		return strtod(scratch.baseAddress!, nil)
+	}
+}
+
+/** Reads the records of a DBF file (see DBFRecordDecoder). Each fetch claims the next range of records, and decodes it
+concurrently with other fetches. */
+final public class DBFStream: NSObject, WarpCore.Stream {
+	let url: URL
+
+	private let decoder: Fallible<DBFRecordDecoder>
+	private var position = 0
+	private let mutex = Mutex()
+	private let sizer = BatchSizer()
+
+	public init(url: URL) {
+		self.url = url
+
+		// Shapelib is only used to read the header (field definitions) of the file
+		var hooks = SAHooks.mappedFileHooks
+		if let handle = DBFOpenLL((url as NSURL).fileSystemRepresentation, "rb", &hooks) {
+			do {
+				self.decoder = .success(DBFRecordDecoder(handle: handle, file: try MappedFile(url: url)))
+			}
+			catch {
+				self.decoder = .failure(String(describing: error))
+			}
+			DBFClose(handle)
+		}
+		else {
+			self.decoder = .failure("The DBF file could not be opened".localized)
+		}
+	}
+
+	public func columns(_ job: Job, callback: @escaping (Fallible<OrderedSet<Column>>) -> ()) {
+		callback(self.decoder.use { $0.columns })
+	}
+
+	public func fetch(_ job: Job, consumer: @escaping Sink) {
+		switch self.decoder {
+		case .success(let decoder):
+			let (start, end) = self.mutex.locked { () -> (Int, Int) in
+				let start = self.position
+				let end = min(decoder.recordCount, start + self.sizer.size)
+				self.position = end
+				return (start, end)
+			}
+
+			job.async {
+				var rows: [Tuple] = []
+				let started = CFAbsoluteTimeGetCurrent()
+				job.time("DBF read", items: end - start, itemType: "rows") {
+					rows = decoder.rows(start..<end)
 				}
+				self.sizer.observe(rows, duration: CFAbsoluteTimeGetCurrent() - started)
+				consumer(.success(rows), end < decoder.recordCount ? .hasMore : .finished)
 			}
+
+		case .failure(let e):
+			consumer(.failure(e), .finished)
 		}
 	}
 
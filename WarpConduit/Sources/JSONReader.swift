@@ -0,0 +1,415 @@
+/* Copyright (c) 2014-2016 Pixelspark, Tommy van der Vorst
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+import Foundation
+import WarpCore
+
+/** An element read by JSONReader. Objects are returned as their keys and values (in the order in which they appear in
+the file), so that they can be mapped to columns without creating a dictionary for each element. */
+internal enum JSONElement {
+	case object([(String, Value)])
+	case value(Value)
+}
+
+/** Incrementally reads the elements of a JSON file. When the file contains a single top-level array, the elements of
+that array are returned one by one. Otherwise, each top-level value is returned as an element, so that files containing
+newline-delimited JSON (one value per line) can be read as well.
+
+The file is memory-mapped and parsed directly from the mapped pages, so that memory usage does not depend on the size of
+the file. Objects and arrays nested in elements are converted to lists, in the same way Value(jsonObject:) does. */
+internal final class JSONReader {
+	private let file: MappedFile
+	private let bytes: UnsafeBufferPointer<UInt8>
+	let isArray: Bool
+	private(set) var position = 0
+	private(set) var isFinished = false
+
+	init(url: URL) throws {
+		self.file = try MappedFile(url: url)
+		self.bytes = self.file.bytes
+
+		// Skip the UTF-8 byte order mark, if present
+		if self.bytes.count >= 3 && self.bytes[0] == 0xEF && self.bytes[1] == 0xBB && self.bytes[2] == 0xBF {
+			self.position = 3
+		}
+
+		self.skipWhitespace()
+		self.isArray = self.position < self.bytes.count && self.bytes[self.position] == JSONReader.openBracket
+		if self.isArray {
+			self.position += 1
+			self.skipWhitespace()
+			if self.position < self.bytes.count && self.bytes[self.position] == JSONReader.closeBracket {
+				self.position += 1
+				try self.finishArray()
+			}
+		}
+	}
+
+	/** Called after the closing bracket of the top-level array has been read. Anything but whitespace after it is an
+	error (rather than being ignored). */
+	private func finishArray() throws {
+		self.isFinished = true
+		self.skipWhitespace()
+		if self.position < self.bytes.count {
+			throw JSONReaderError.unexpected(self.position)
+		}
+	}
+
+	var count: Int {
+		return self.bytes.count
+	}
+
+	/** Reads the next element, or returns nil when all elements have been read. */
+	func next() throws -> JSONElement? {
+		if self.isFinished {
+			return nil
+		}
+
+		self.skipWhitespace()
+		if self.position >= self.bytes.count {
+			if self.isArray {
+				throw JSONReaderError.unexpectedEnd
+			}
+			self.isFinished = true
+			return nil
+		}
+
+		let element: JSONElement
+		if self.bytes[self.position] == JSONReader.openBrace {
+			element = .object(try self.readObject())
+		}
+		else {
+			element = .value(try self.readValue())
+		}
+
+		if self.isArray {
+			// Elements are separated by commas, and the array ends with a closing bracket
+			self.skipWhitespace()
+			guard self.position < self.bytes.count else {
+				throw JSONReaderError.unexpectedEnd
+			}
+
+			switch self.bytes[self.position] {
+			case JSONReader.comma:
+				self.position += 1
+
+			case JSONReader.closeBracket:
+				self.position += 1
+				try self.finishArray()
+
+			default:
+				throw JSONReaderError.unexpected(self.position)
+			}
+		}
+
+		return element
+	}
+
+	private static let openBrace = UInt8(ascii: "{")
+	private static let closeBrace = UInt8(ascii: "}")
+	private static let openBracket = UInt8(ascii: "[")
+	private static let closeBracket = UInt8(ascii: "]")
+	private static let comma = UInt8(ascii: ",")
+	private static let colon = UInt8(ascii: ":")
+	private static let quote = UInt8(ascii: "\"")
+	private static let backslash = UInt8(ascii: "\\")
+
+	private func skipWhitespace() {
+		while self.position < self.bytes.count {
+			switch self.bytes[self.position] {
+			case 0x20, 0x09, 0x0A, 0x0D:
+				self.position += 1
+
+			default:
+				return
+			}
+		}
+	}
+
+	private func expect(_ byte: UInt8) throws {
+		self.skipWhitespace()
+		guard self.position < self.bytes.count else {
+			throw JSONReaderError.unexpectedEnd
+		}
+		guard self.bytes[self.position] == byte else {
+			throw JSONReaderError.unexpected(self.position)
+		}
+		self.position += 1
+	}
+
+	/** Reads an object, and returns its keys and values. */
+	private func readObject() throws -> [(String, Value)] {
+		try self.expect(JSONReader.openBrace)
+		var pairs: [(String, Value)] = []
+
+		self.skipWhitespace()
+		if self.position < self.bytes.count && self.bytes[self.position] == JSONReader.closeBrace {
+			self.position += 1
+			return pairs
+		}
+
+		while true {
+			self.skipWhitespace()
+			let key = try self.readString()
+			try self.expect(JSONReader.colon)
+			pairs.append((key, try self.readValue()))
+
+			self.skipWhitespace()
+			guard self.position < self.bytes.count else {
+				throw JSONReaderError.unexpectedEnd
+			}
+
+			let byte = self.bytes[self.position]
+			self.position += 1
+			if byte == JSONReader.closeBrace {
+				return pairs
+			}
+			else if byte != JSONReader.comma {
+				throw JSONReaderError.unexpected(self.position - 1)
+			}
+		}
+	}
+
+	private func readArray() throws -> [Value] {
+		try self.expect(JSONReader.openBracket)
+		var values: [Value] = []
+
+		self.skipWhitespace()
+		if self.position < self.bytes.count && self.bytes[self.position] == JSONReader.closeBracket {
+			self.position += 1
+			return values
+		}
+
+		while true {
+			values.append(try self.readValue())
+
+			self.skipWhitespace()
+			guard self.position < self.bytes.count else {
+				throw JSONReaderError.unexpectedEnd
+			}
+
+			let byte = self.bytes[self.position]
+			self.position += 1
+			if byte == JSONReader.closeBracket {
+				return values
+			}
+			else if byte != JSONReader.comma {
+				throw JSONReaderError.unexpected(self.position - 1)
+			}
+		}
+	}
+
+	private func readValue() throws -> Value {
+		self.skipWhitespace()
+		guard self.position < self.bytes.count else {
+			throw JSONReaderError.unexpectedEnd
+		}
+
+		switch self.bytes[self.position] {
+		case JSONReader.quote:
+			return Value.string(try self.readString())
+
+		case JSONReader.openBrace:
+			// Objects are represented as lists of alternating keys and values
+			return Value.list(try self.readObject().flatMap { [Value.string($0.0), $0.1] })
+
+		case JSONReader.openBracket:
+			return Value.list(try self.readArray())
+
+		case UInt8(ascii: "t"):
+			try self.readLiteral("true")
+			return Value.bool(true)
+
+		case UInt8(ascii: "f"):
+			try self.readLiteral("false")
+			return Value.bool(false)
+
+		case UInt8(ascii: "n"):
+			try self.readLiteral("null")
+			return Value.empty
+
+		default:
+			return try self.readNumber()
+		}
+	}
+
+	private func readLiteral(_ literal: StaticString) throws {
+		let count = literal.utf8CodeUnitCount
+		guard self.position + count <= self.bytes.count else {
+			throw JSONReaderError.unexpectedEnd
+		}
+
+		let expected = UnsafeBufferPointer(start: literal.utf8Start, count: count)
+		for i in 0..<count where self.bytes[self.position + i] != expected[i] {
+			throw JSONReaderError.unexpected(self.position + i)
+		}
+		self.position += count
+	}
+
+	/** Reads a number. Numbers that have an integer value are returned as integer (also when written with a fraction or
+	exponent), others as double. */
+	private func readNumber() throws -> Value {
+		let start = self.position
+		var isInteger = true
+		var integer = 0
+		var negative = false
+		var digits = 0
+
+		if self.position < self.bytes.count && self.bytes[self.position] == UInt8(ascii: "-") {
+			negative = true
+			self.position += 1
+		}
+
+		scan: while self.position < self.bytes.count {
+			let byte = self.bytes[self.position]
+			switch byte {
+			case UInt8(ascii: "0")...UInt8(ascii: "9"):
+				integer = integer &* 10 &+ Int(byte - UInt8(ascii: "0"))
+				digits += 1
+
+			case UInt8(ascii: "."), UInt8(ascii: "e"), UInt8(ascii: "E"), UInt8(ascii: "+"), UInt8(ascii: "-"):
+				isInteger = false
+
+			default:
+				break scan
+			}
+			self.position += 1
+		}
+
+		if self.position == start || (negative && self.position == start + 1) {
+			throw JSONReaderError.unexpected(start)
+		}
+
+		// Up to 18 digits always fit in an integer
+		if isInteger && digits <= 18 {
+			return Value.int(negative ? -integer : integer)
+		}
+
+		let text = String(decoding: UnsafeBufferPointer(rebasing: self.bytes[start..<self.position]), as: UTF8.self)
+		guard let d = Double(text) else {
+			throw JSONReaderError.unexpected(start)
+		}
+
+		if d == d.rounded() && abs(d) < 9.0e18 {
+			return Value.int(Int(d))
+		}
+		return Value(d)
+	}
+
+	private func readString() throws -> String {
+		guard self.position < self.bytes.count, self.bytes[self.position] == JSONReader.quote else {
+			throw self.position < self.bytes.count ? JSONReaderError.unexpected(self.position) : JSONReaderError.unexpectedEnd
+		}
+		self.position += 1
+		let start = self.position
+
+		// Fast path: strings without escapes are decoded directly from the file
+		while self.position < self.bytes.count {
+			let byte = self.bytes[self.position]
+			if byte == JSONReader.quote {
+				let string = String(decoding: UnsafeBufferPointer(rebasing: self.bytes[start..<self.position]), as: UTF8.self)
+				self.position += 1
+				return string
+			}
+			else if byte == JSONReader.backslash {
+				break
+			}
+			self.position += 1
+		}
+
+		var unescaped = Array(self.bytes[start..<self.position])
+		while self.position < self.bytes.count {
+			let byte = self.bytes[self.position]
+			self.position += 1
+
+			if byte == JSONReader.quote {
+				return String(decoding: unescaped, as: UTF8.self)
+			}
+			else if byte != JSONReader.backslash {
+				unescaped.append(byte)
+				continue
+			}
+
+			guard self.position < self.bytes.count else {
+				throw JSONReaderError.unexpectedEnd
+			}
+
+			let escaped = self.bytes[self.position]
+			self.position += 1
+			switch escaped {
+			case UInt8(ascii: "\""), UInt8(ascii: "\\"), UInt8(ascii: "/"): unescaped.append(escaped)
+			case UInt8(ascii: "b"): unescaped.append(0x08)
+			case UInt8(ascii: "f"): unescaped.append(0x0C)
+			case UInt8(ascii: "n"): unescaped.append(0x0A)
+			case UInt8(ascii: "r"): unescaped.append(0x0D)
+			case UInt8(ascii: "t"): unescaped.append(0x09)
+
+			case UInt8(ascii: "u"):
+				var scalar = try self.readHexQuad()
+
+				// Characters outside the basic multilingual plane are written as a pair of UTF-16 surrogates
+				if scalar >= 0xD800 && scalar < 0xDC00 && self.position + 1 < self.bytes.count && self.bytes[self.position] == JSONReader.backslash && self.bytes[self.position + 1] == UInt8(ascii: "u") {
+					self.position += 2
+					let low = try self.readHexQuad()
+					if low >= 0xDC00 && low < 0xE000 {
+						scalar = 0x10000 + ((scalar - 0xD800) << 10) + (low - 0xDC00)
+					}
+					else {
+						scalar = 0xFFFD
+					}
+				}
+
+				unescaped.append(contentsOf: String(Character(Unicode.Scalar(scalar) ?? "\u{FFFD}")).utf8)
+
+			default:
+				throw JSONReaderError.unexpected(self.position - 1)
+			}
+		}
+
+		throw JSONReaderError.unexpectedEnd
+	}
+
+	private func readHexQuad() throws -> UInt32 {
+		guard self.position + 4 <= self.bytes.count else {
+			throw JSONReaderError.unexpectedEnd
+		}
+
+		var value: UInt32 = 0
+		for _ in 0..<4 {
+			let byte = self.bytes[self.position]
+			let digit: UInt8
+			switch byte {
+			case UInt8(ascii: "0")...UInt8(ascii: "9"): digit = byte - UInt8(ascii: "0")
+			case UInt8(ascii: "a")...UInt8(ascii: "f"): digit = byte - UInt8(ascii: "a") + 10
+			case UInt8(ascii: "A")...UInt8(ascii: "F"): digit = byte - UInt8(ascii: "A") + 10
+			default: throw JSONReaderError.unexpected(self.position)
+			}
+			value = value * 16 + UInt32(digit)
+			self.position += 1
+		}
+		return value
+	}
+
+	enum JSONReaderError: Error, CustomStringConvertible {
+		case unexpectedEnd
+		case unexpected(Int)
+
+		var description: String {
+			switch self {
+			case .unexpectedEnd: return "The JSON data ends unexpectedly"
+			case .unexpected(let position): return "The JSON data is invalid at position \(position)"
+			}
+		}
+	}
+}
@@ -15,146 +15,188 @@ OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
 import Foundation
 import WarpCore
 
-private enum JSONFileType {
-	case arrayOfObjects(columns: [Column])
-	case arrayOfValues(column: Column)
-	case singleValue(column: Column)
-
-	init(data: Any) {
-		// Is this an array?
-		if let d = data as? Array<Any> {
-			if d.isEmpty {
-				self = .arrayOfObjects(columns: [])
-			}
-			else {
-				// Is the first element an object? Then take its columns
-				if let value = d.first as? [String: Any] {
-					self = .arrayOfObjects(columns: Array(value.keys).map { Column($0) })
-				}
-				else {
-					self = .arrayOfValues(column: Column("items"))
+/** Reads rows from a JSON file (see JSONStream). How elements are converted to rows is decided from a sample of the first
+elements, which are kept and returned before any further elements are read:
+
+- When the first element is an object, the keys of the objects in the sample (in the order in which they first appear)
+  become the columns. Keys that only appear after the sample are ignored, and elements that are not objects result in
+  rows without values.
+- When the first element is not an object, there is a single column 'items' containing the elements.
+- When the file contains an empty array, there are no columns.
+- When the file contains a single value other than an array, there is a single row with a column 'data'. This includes
+  a single object (its keys and values become a list), which means newline-delimited JSON consisting of a single object
+  is read this way as well.
+
+Content after the closing bracket of a top-level array (other than whitespace) is an error. */
+private final class JSONRowReader {
+	/** The number of elements read to determine the columns. */
+	static let sampleSize = 1000
+
+	let columns: OrderedSet<Column>
+	private let reader: JSONReader
+	private let isObjects: Bool
+	private let columnIndices: [String: Int]
+	private var sample: ArraySlice<JSONElement>
+	private var error: String? = nil
+	private let queue = DispatchQueue(label: "nl.pixelspark.Warp.JSONStream", attributes: [])
+	private let sizer = BatchSizer()
+
+	init(url: URL) throws {
+		let reader = try JSONReader(url: url)
+		var sample: [JSONElement] = []
+		while sample.count < JSONRowReader.sampleSize, let element = try reader.next() {
+			sample.append(element)
+		}
+		self.reader = reader
+		self.sample = ArraySlice(sample)
+
+		let isSingleValue = sample.count == 1 && reader.isFinished && !reader.isArray
+		if isSingleValue {
+			self.isObjects = false
+			self.columns = [Column("data")]
+			self.columnIndices = [:]
+		}
+		else if case .some(.object(_)) = sample.first {
+			var columns = OrderedSet<Column>()
+			var indices: [String: Int] = [:]
+			for case .object(let pairs) in sample {
+				for (key, _) in pairs where indices[key] == nil {
+					indices[key] = columns.count
+					columns.append(Column(key))
 				}
 			}
+			self.isObjects = true
+			self.columns = columns
+			self.columnIndices = indices
 		}
-		else {
-			self = .singleValue(column: Column("data"))
+		else if sample.isEmpty && reader.isArray {
+			// An empty array has no columns
+			self.isObjects = true
+			self.columns = []
+			self.columnIndices = [:]
 		}
-	}
-
-	var columns: OrderedSet<Column> {
-		switch self {
-		case .arrayOfObjects(columns: let c): return OrderedSet(c)
-		case .arrayOfValues(column: let c): return [c]
-		case .singleValue(column: let c): return [c]
+		else {
+			self.isObjects = false
+			self.columns = [Column("items")]
+			self.columnIndices = [:]
 		}
 	}
 
-	func rowCount(for data: Any) -> Int? {
-		switch self {
-		case .arrayOfObjects(columns: _):
-			if let d = data as? Array<Any> {
-				return d.count
+	func fetch(_ job: Job, consumer: @escaping Sink) {
+		self.queue.async {
+			var rows: Fallible<[Tuple]> = .success([])
+			let batchSize = self.sizer.size
+			let started = CFAbsoluteTimeGetCurrent()
+			job.time("JSON read", items: batchSize, itemType: "rows") {
+				rows = self.rows(batchSize)
+			}
+			if case .success(let r) = rows {
+				self.sizer.observe(r, duration: CFAbsoluteTimeGetCurrent() - started)
 			}
-			return nil
 
-		case .arrayOfValues(column: _):
-			if let d = data as? Array<Any> {
-				return d.count
+			let finished = self.sample.isEmpty && self.reader.isFinished
+			if self.reader.count > 0 {
+				job.reportProgress(Double(self.reader.position) / Double(self.reader.count), forKey: Unmanaged.passUnretained(self).toOpaque().hashValue)
 			}
-			return nil
 
-		case .singleValue(column: _):
-			return 1
+			job.async {
+				switch rows {
+				case .success(let r):
+					consumer(.success(r), finished ? .finished : .hasMore)
+
+				case .failure(let e):
+					consumer(.failure(e), .finished)
+				}
+			}
 		}
 	}
 
-	func sequence(for data: Any) -> AnySequence<Row>? {
-		switch self {
-		case .singleValue(column: _):
-			let a = [Row([Value(jsonObject: data)], columns: self.columns)]
-			return AnySequence(a)
-
-		case .arrayOfObjects(columns: _):
-			if let d = data as? Array<Any> {
-				return AnySequence(d.lazy.map { r in
-					let cols = self.columns
-					var templateRow = Row(Array(repeating: Value.empty, count: cols.count), columns: cols)
-					if let row = r as? [String: Any] {
-						for col in cols {
-							if let value = row[col.name] {
-								templateRow[col] = Value(jsonObject: value)
-							}
-						}
-					}
-					return templateRow
-				})
+	private func rows(_ count: Int) -> Fallible<[Tuple]> {
+		if let e = self.error {
+			return .failure(e)
+		}
+
+		var rows: [Tuple] = []
+		rows.reserveCapacity(count)
+
+		do {
+			while rows.count < count {
+				let element: JSONElement
+				if let e = self.sample.popFirst() {
+					element = e
+				}
+				else if let e = try self.reader.next() {
+					element = e
+				}
+				else {
+					break
+				}
+				rows.append(self.row(element))
 			}
-		case .arrayOfValues(column: _):
-			let cols = self.columns
+		}
+		catch {
+			self.error = String(describing: error)
+			return .failure(self.error!)
+		}
+
+		return .success(rows)
+	}
 
-			if let d = data as? Array<Any> {
-				return AnySequence(d.lazy.map { r in
-					return Row([Value(jsonObject: r)], columns: cols)
-				})
+	private func row(_ element: JSONElement) -> Tuple {
+		if self.isObjects {
+			var row = Tuple(repeating: Value.empty, count: self.columns.count)
+			if case .object(let pairs) = element {
+				for (key, value) in pairs {
+					if let index = self.columnIndices[key] {
+						row[index] = value
+					}
+				}
 			}
+			return row
 		}
 
-		return nil
+		switch element {
+		case .object(let pairs):
+			return [Value.list(pairs.flatMap { [Value.string($0.0), $0.1] })]
+
+		case .value(let value):
+			return [value]
+		}
 	}
 }
 
-/** Reads a JSON file. Depending on the top level object type, the stream decides how to convert the data to the tabular
-structure expected (see JSONFileType above for the different options).
-
-Currently this reads the whole file at once - not very efficient for very large JSON files.
-TODO: switch to a streaming parser (e.g. YAJL). */
+/** Reads a JSON file, containing either a top-level array or newline-delimited JSON values. Elements are parsed while
+rows are fetched, so that the first rows are available right away, and memory usage does not depend on the size of the
+file (see JSONReader). How elements are converted to rows is determined by a sample of the first elements (see
+JSONRowReader). */
 public final class JSONStream: WarpCore.Stream {
 	let url: URL
-	private let stream: Future<Fallible<WarpCore.Stream>>
-	private var finished: Bool = false
-
-	private let mutex = Mutex()
+	private let reader: Future<Fallible<JSONRowReader>>
 
 	public init(url: URL) {
 		self.url = url
 
-		self.stream = Future({ (job, callback) -> () in
+		self.reader = Future({ (job, callback) -> () in
 			do {
-				let data = try Data(contentsOf: url)
-				let js = try JSONSerialization.jsonObject(with: data, options: .allowFragments)
-				let type = JSONFileType(data: js)
-				if let seq = type.sequence(for: js) {
-					let wrappedSequence = AnySequence(seq.lazy.map { r in return Fallible.success(r.values) })
-					let stream = SequenceStream(wrappedSequence, columns: type.columns, rowCount: type.rowCount(for: js))
-					callback(.success(stream))
-				}
-				else {
-					callback(.failure("Unsupported file structure"))
-				}
+				callback(.success(try JSONRowReader(url: url)))
 			}
 			catch {
-				callback(.failure(error.localizedDescription))
+				callback(.failure(String(describing: error)))
 			}
 		})
 	}
 
 	public func columns(_ job: Job, callback: @escaping (Fallible<OrderedSet<Column>>) -> ()) {
-		self.stream.get(job) { result in
-			switch result {
-			case .success(let stream):
-				stream.columns(job, callback: callback)
-
-			case .failure(let e):
-				callback(.failure(e))
-			}
+		self.reader.get(job) { result in
+			callback(result.use { $0.columns })
 		}
 	}
 
 	public func fetch(_ job: Job, consumer: @escaping Sink) {
-		self.stream.get(job) { result in
+		self.reader.get(job) { result in
 			switch result {
-			case .success(let stream):
-				stream.fetch(job, consumer: consumer)
+			case .success(let reader):
+				reader.fetch(job, consumer: consumer)
 
 			case .failure(let e):
 				consumer(.failure(e), .finished)
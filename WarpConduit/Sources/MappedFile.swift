@@ -0,0 +1,108 @@
+/* Copyright (c) 2014-2016 Pixelspark, Tommy van der Vorst
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+import Foundation
+
+/** A read-only, memory-mapped view of a file. Readers can parse the bytes of the file directly from the mapped pages,
+without copying them into intermediate buffers first; the kernel reads pages in as they are touched. The mapping is
+advised to be read sequentially, so that pages are read ahead and can be dropped soon after they have been parsed.
+
+The bytes remain valid for as long as the MappedFile exists. The file is assumed not to be modified while it is mapped
+(the contents of pages that have not been read yet would change along with the file). */
+internal final class MappedFile {
+	let url: URL
+	let bytes: UnsafeBufferPointer<UInt8>
+	private let descriptor: Int32
+
+	init(url: URL) throws {
+		self.url = url
+		self.descriptor = open((url as NSURL).fileSystemRepresentation, O_RDONLY)
+		if self.descriptor < 0 {
+			throw MappedFileError.cannotOpen(String(cString: strerror(errno)))
+		}
+
+		var info = stat()
+		if fstat(self.descriptor, &info) != 0 {
+			let message = String(cString: strerror(errno))
+			close(self.descriptor)
+			throw MappedFileError.cannotOpen(message)
+		}
+
+		// Empty files cannot be mapped
+		let length = Int(info.st_size)
+		if length == 0 {
+			self.bytes = UnsafeBufferPointer(start: nil, count: 0)
+			return
+		}
+
+		guard let address = mmap(nil, length, PROT_READ, MAP_PRIVATE, self.descriptor, 0), address != UnsafeMutableRawPointer(bitPattern: -1) else {
+			let message = String(cString: strerror(errno))
+			close(self.descriptor)
+			throw MappedFileError.cannotMap(message)
+		}
+
+		_ = madvise(address, length, MADV_SEQUENTIAL)
+		self.bytes = UnsafeBufferPointer(start: address.assumingMemoryBound(to: UInt8.self), count: length)
+	}
+
+	deinit {
+		if let address = self.bytes.baseAddress {
+			munmap(UnsafeMutableRawPointer(mutating: address), self.bytes.count)
+		}
+		close(self.descriptor)
+	}
+
+	var count: Int {
+		return self.bytes.count
+	}
+
+	/** The contents of the file as Data, without copying. The Data object keeps the mapping alive. */
+	var data: Data {
+		guard let address = self.bytes.baseAddress else {
+			return Data()
+		}
+
+		return Data(bytesNoCopy: UnsafeMutableRawPointer(mutating: address), count: self.bytes.count, deallocator: .custom({ _, _ in
+			withExtendedLifetime(self) {}
+		}))
+	}
+
+	/** Indicates that the bytes in the indicated range will be needed soon, so that the kernel can start reading them in
+	(e.g. while the previous range is being parsed). */
+	func willNeed(_ range: Range<Int>) {
+		guard let address = self.bytes.baseAddress else {
+			return
+		}
+
+		// madvise requires a page-aligned address
+		let pageSize = Int(getpagesize())
+		let start = (max(0, range.lowerBound) / pageSize) * pageSize
+		let end = min(self.bytes.count, range.upperBound)
+		if start < end {
+			_ = madvise(UnsafeMutableRawPointer(mutating: address + start), end - start, MADV_WILLNEED)
+		}
+	}
+
+	enum MappedFileError: Error, CustomStringConvertible {
+		case cannotOpen(String)
+		case cannotMap(String)
+
+		var description: String {
+			switch self {
+			case .cannotOpen(let message): return "The file could not be opened: \(message)"
+			case .cannotMap(let message): return "The file could not be mapped into memory: \(message)"
+			}
+		}
+	}
+}
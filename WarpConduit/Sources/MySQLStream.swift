@@ -72,7 +72,17 @@ private final class MySQLDialect: StandardSQLDialect {
 }
 
 /** A MySQL result set (MYSQL_RES in the API) */
-internal final class MySQLResult: Sequence, IteratorProtocol {
+/** A result from which rows can be read in batches (see MySQLResultStream). */
+fileprivate protocol MySQLBatchResult: AnyObject {
+	var columns: OrderedSet<Column> { get }
+
+	/** Reads at most `count` rows on the queue of the connection, and calls the callback with the rows read (on that
+	queue). When less than `count` rows are returned, the end of the result has been reached. Calls are performed in the
+	order in which they are made. */
+	func rows(_ count: Int, callback: @escaping (Fallible<[Tuple]>) -> ())
+}
+
+internal final class MySQLResult: Sequence, IteratorProtocol, MySQLBatchResult {
 	typealias Element = Fallible<Tuple>
 	typealias Iterator = MySQLResult
 
@@ -86,7 +96,7 @@ internal final class MySQLResult: Sequence, IteratorProtocol {
 		// Get column names from result set
 		var resultSet: Fallible<MySQLResult> = .failure("Unknown error")
 
-		MySQLClient.sharedClient.queue.sync {
+		connection.sync { () -> () in
 			let realResult = MySQLResult(result: result, connection: connection)
 
 			let colCount = mysql_field_count(connection.connection)
@@ -144,9 +154,8 @@ internal final class MySQLResult: Sequence, IteratorProtocol {
 		_finish(true)
 
 		let result = self.result
-		MySQLClient.sharedClient.queue.sync {
+		self.connection.sync {
 			mysql_free_result(result)
-			return
 		}
 	}
 
@@ -160,104 +169,492 @@ internal final class MySQLResult: Sequence, IteratorProtocol {
 	}
 
 	func row() -> [Value]? {
+		return self.connection.sync {
+			return self.fetchRow()
+		}
+	}
+
+	func rows(_ count: Int, callback: @escaping (Fallible<[Tuple]>) -> ()) {
+		self.connection.queue.async {
+			var rows: [Tuple] = []
+			rows.reserveCapacity(count)
+			while rows.count < count, let row = self.fetchRow() {
+				rows.append(row)
+			}
+
+			if rows.count < count && self.connection.isError {
+				callback(.failure(self.connection.lastError))
+			}
+			else {
+				callback(.success(rows))
+			}
+		}
+	}
+
+	/** Reads the next row. Must be called on the queue of the connection. */
+	private func fetchRow() -> [Value]? {
 		var rowDataset: [Value]? = nil
 
-		MySQLClient.sharedClient.queue.sync {
-			if let row = mysql_fetch_row(self.result) {
-				let lengths = mysql_fetch_lengths(self.result)
-				rowDataset = []
-				rowDataset!.reserveCapacity(self.columns.count)
+		if let row = mysql_fetch_row(self.result) {
+			let lengths = mysql_fetch_lengths(self.result)
+			rowDataset = []
+			rowDataset!.reserveCapacity(self.columns.count)
 
-				for cn in 0..<self.columns.count {
-					let val = row[cn]
-					if val == nil {
-						rowDataset!.append(Value.empty)
-					}
-					else {
-						// Is this a date field?
-						let type = self.columnTypes[cn]
-						if type.type.rawValue == MYSQL_TYPE_TIME.rawValue
-							|| type.type.rawValue == MYSQL_TYPE_DATE.rawValue
-							|| type.type.rawValue == MYSQL_TYPE_DATETIME.rawValue
-							|| type.type.rawValue == MYSQL_TYPE_TIMESTAMP.rawValue {
-
-							/* Only MySQL TIMESTAMP values are actual dates in UTC. The rest can be anything, in any time
-							zone, so we cannot convert these to Value.date. */
-							if let ptr = val, let str = String(cString: ptr, encoding: String.Encoding.utf8) {
-								if type.type.rawValue == MYSQL_TYPE_TIMESTAMP.rawValue {
-									// Datetime string is formatted as YYYY-MM-dd HH:mm:ss and is in UTC
-									let dateFormatter = DateFormatter()
-									dateFormatter.dateFormat = "yyyy-MM-dd HH:mm:ss"
-									dateFormatter.timeZone = TimeZone(abbreviation: "UTC")
-									if let d = dateFormatter.date(from: str) {
-										rowDataset!.append(Value(d))
-									}
-									else {
-										rowDataset!.append(Value.invalid)
-									}
-								}
-								else {
-									rowDataset!.append(Value.string(str))
-								}
+			for cn in 0..<self.columns.count {
+				let val = row[cn]
+				if val == nil {
+					rowDataset!.append(Value.empty)
+				}
+				else {
+					// Is this a date field?
+					let type = self.columnTypes[cn]
+					if type.type.rawValue == MYSQL_TYPE_TIME.rawValue
+						|| type.type.rawValue == MYSQL_TYPE_DATE.rawValue
+						|| type.type.rawValue == MYSQL_TYPE_DATETIME.rawValue
+						|| type.type.rawValue == MYSQL_TYPE_TIMESTAMP.rawValue {
+
+						/* Only MySQL TIMESTAMP values are actual dates in UTC. The rest can be anything, in any time
+						zone, so we cannot convert these to Value.date. */
+						if let ptr = val, let str = String(cString: ptr, encoding: String.Encoding.utf8) {
+							if type.type.rawValue == MYSQL_TYPE_TIMESTAMP.rawValue {
+								// Datetime string is formatted as YYYY-MM-dd HH:mm:ss and is in UTC
+								rowDataset!.append(MySQLTime.parse(str.utf8))
 							}
 							else {
-								rowDataset!.append(Value.invalid)
+								rowDataset!.append(Value.string(str))
 							}
 						}
-						else if type.type.rawValue == MYSQL_TYPE_TINY.rawValue
-							|| type.type.rawValue == MYSQL_TYPE_SHORT.rawValue
-							|| type.type.rawValue == MYSQL_TYPE_LONG.rawValue
-							|| type.type.rawValue == MYSQL_TYPE_INT24.rawValue
-							|| type.type.rawValue == MYSQL_TYPE_LONGLONG.rawValue {
-							if let ptr = val, let str = String(cString: ptr, encoding: String.Encoding.utf8), let nt = Int(str) {
-								rowDataset!.append(Value.int(nt))
-							}
-							else {
-								rowDataset!.append(Value.invalid)
-							}
-
+						else {
+							rowDataset!.append(Value.invalid)
 						}
-						else if type.type.rawValue == MYSQL_TYPE_DECIMAL.rawValue
-							|| type.type.rawValue == MYSQL_TYPE_NEWDECIMAL.rawValue
-							|| type.type.rawValue == MYSQL_TYPE_DOUBLE.rawValue
-							|| type.type.rawValue == MYSQL_TYPE_FLOAT.rawValue {
-							if let ptr = val, let str = String(cString: ptr, encoding: String.Encoding.utf8) {
-								if let dbl = str.toDouble() {
-									rowDataset!.append(Value.double(dbl))
-								}
-								else {
-									rowDataset!.append(Value.invalid)
-								}
+					}
+					else if type.type.rawValue == MYSQL_TYPE_TINY.rawValue
+						|| type.type.rawValue == MYSQL_TYPE_SHORT.rawValue
+						|| type.type.rawValue == MYSQL_TYPE_LONG.rawValue
+						|| type.type.rawValue == MYSQL_TYPE_INT24.rawValue
+						|| type.type.rawValue == MYSQL_TYPE_LONGLONG.rawValue {
+						if let ptr = val, let str = String(cString: ptr, encoding: String.Encoding.utf8), let nt = Int(str) {
+							rowDataset!.append(Value.int(nt))
+						}
+						else {
+							rowDataset!.append(Value.invalid)
+						}
+
+					}
+					else if type.type.rawValue == MYSQL_TYPE_DECIMAL.rawValue
+						|| type.type.rawValue == MYSQL_TYPE_NEWDECIMAL.rawValue
+						|| type.type.rawValue == MYSQL_TYPE_DOUBLE.rawValue
+						|| type.type.rawValue == MYSQL_TYPE_FLOAT.rawValue {
+						if let ptr = val, let str = String(cString: ptr, encoding: String.Encoding.utf8) {
+							if let dbl = str.toDouble() {
+								rowDataset!.append(Value.double(dbl))
 							}
 							else {
 								rowDataset!.append(Value.invalid)
 							}
 						}
-						else if type.type.rawValue == MYSQL_TYPE_TINY_BLOB.rawValue
-							|| type.type.rawValue == MYSQL_TYPE_MEDIUM_BLOB.rawValue
-							|| type.type.rawValue == MYSQL_TYPE_LONG_BLOB.rawValue
-							|| type.type.rawValue == MYSQL_TYPE_BLOB.rawValue {
-							if let ptr = val, let length = lengths?[cn] {
-								rowDataset!.append(Value.blob(Data(bytes: ptr, count: Int(length))))
-							}
+						else {
+							rowDataset!.append(Value.invalid)
+						}
+					}
+					else if type.type.rawValue == MYSQL_TYPE_TINY_BLOB.rawValue
+						|| type.type.rawValue == MYSQL_TYPE_MEDIUM_BLOB.rawValue
+						|| type.type.rawValue == MYSQL_TYPE_LONG_BLOB.rawValue
+						|| type.type.rawValue == MYSQL_TYPE_BLOB.rawValue {
+						if let ptr = val, let length = lengths?[cn] {
+							rowDataset!.append(Value.blob(Data(bytes: ptr, count: Int(length))))
+						}
+					}
+					else {
+						if let ptr = val, let str = String(cString: ptr, encoding: String.Encoding.utf8) {
+							rowDataset!.append(Value.string(str))
 						}
 						else {
-							if let ptr = val, let str = String(cString: ptr, encoding: String.Encoding.utf8) {
-								rowDataset!.append(Value.string(str))
-							}
-							else {
-								rowDataset!.append(Value.invalid)
-							}
+							rowDataset!.append(Value.invalid)
 						}
 					}
 				}
 			}
+		}
+		else {
+			self.finished = true
+		}
+
+		return rowDataset
+	}
+}
+
+/** Conversion of MySQL date and time values. */
+fileprivate enum MySQLTime {
+	/** Returns the date for a time in UTC, or Value.invalid for dates MySQL uses to indicate 'no date' (0000-00-00). */
+	static func date(year: Int, month: Int, day: Int, hour: Int, minute: Int, second: Int, microsecond: Int) -> Value {
+		if month < 1 || month > 12 || day < 1 || day > 31 {
+			return Value.invalid
+		}
+
+		// Days since 1970-01-01 in the proleptic Gregorian calendar (see http://howardhinnant.github.io/date_algorithms.html)
+		let y = month <= 2 ? year - 1 : year
+		let era = (y >= 0 ? y : y - 399) / 400
+		let yearOfEra = y - era * 400
+		let dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1
+		let dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear
+		let days = era * 146097 + dayOfEra - 719468
+
+		let seconds = Double(days * 86400 + hour * 3600 + minute * 60 + second) + Double(microsecond) / 1_000_000.0
+		return Value.date(seconds - Date.timeIntervalBetween1970AndReferenceDate)
+	}
+
+	static func date(_ time: MYSQL_TIME) -> Value {
+		return date(year: Int(time.year), month: Int(time.month), day: Int(time.day), hour: Int(time.hour), minute: Int(time.minute), second: Int(time.second), microsecond: Int(time.second_part))
+	}
+
+	/** Parses a date formatted as YYYY-MM-DD HH:MM:SS (optionally followed by a fraction of a second) in UTC. */
+	static func parse<T: Collection>(_ bytes: T) -> Value where T.Element == UInt8 {
+		var fields = [0, 0, 0, 0, 0, 0, 0]
+		var fractionDigits = 0
+		var field = 0
+
+		for byte in bytes {
+			if byte >= 48 && byte <= 57 {
+				fields[field] = fields[field] * 10 + Int(byte - 48)
+				if field == 6 {
+					fractionDigits += 1
+				}
+			}
+			else if field < 6 {
+				field += 1
+			}
 			else {
-				self.finished = true
+				return Value.invalid
 			}
 		}
 
-		return rowDataset
+		if field < 5 || fractionDigits > 6 {
+			return Value.invalid
+		}
+
+		var microsecond = fields[6]
+		for _ in fractionDigits..<6 {
+			microsecond *= 10
+		}
+		return date(year: fields[0], month: fields[1], day: fields[2], hour: fields[3], minute: fields[4], second: fields[5], microsecond: microsecond)
+	}
+
+	/** Formats a DATE, DATETIME or TIME value the way the server does in the text protocol. */
+	static func string(_ time: MYSQL_TIME, type: enum_field_types, decimals: Int) -> String {
+		var text: String
+		if type.rawValue == MYSQL_TYPE_TIME.rawValue {
+			// Days may be reported separately from the hours
+			let hours = Int(time.hour) + Int(time.day) * 24
+			text = String(format: "%@%02ld:%02u:%02u", time.neg != 0 ? "-" : "", hours, time.minute, time.second)
+		}
+		else if type.rawValue == MYSQL_TYPE_DATE.rawValue {
+			return String(format: "%04u-%02u-%02u", time.year, time.month, time.day)
+		}
+		else {
+			text = String(format: "%04u-%02u-%02u %02u:%02u:%02u", time.year, time.month, time.day, time.hour, time.minute, time.second)
+		}
+
+		if decimals > 0 && decimals <= 6 {
+			let fraction = String(format: "%06lu", time.second_part)
+			text += "." + String(fraction.prefix(decimals))
+		}
+		return text
+	}
+}
+
+/** The result of a prepared statement, which is read using the binary protocol. Result buffers of the appropriate type
+are bound once for each column, so that the library decodes integers, floating point numbers and dates directly into
+them, and rows are converted to values without parsing text. Values longer than the bound buffer are fetched separately.
+
+Rows are still streamed from the server as they are read (the result is not stored on the client first), but they are
+read in batches on the queue of the connection (see MySQLBatchResult). */
+fileprivate final class MySQLStatementResult: MySQLBatchResult {
+	private enum Kind {
+		case integer
+		case unsignedInteger
+		case double
+		case decimal
+		case timestamp
+		case time
+		case blob
+		case string
+	}
+
+	/** The size of the buffer bound for string and blob columns. */
+	static let bufferSize = 1024
+
+	private let connection: MySQLConnection
+	private let statement: UnsafeMutablePointer<MYSQL_STMT>
+	let columns: OrderedSet<Column>
+	private let kinds: [Kind]
+	private let types: [enum_field_types]
+	private let decimals: [Int]
+	private let binds: UnsafeMutablePointer<MYSQL_BIND>
+	private let lengths: UnsafeMutablePointer<UInt>
+	private let nulls: UnsafeMutablePointer<my_bool>
+	private let errors: UnsafeMutablePointer<my_bool>
+	private let buffers: [UnsafeMutableRawPointer]
+	private(set) var finished = false
+
+	/** Prepares and executes the statement. Must be called on the queue of the connection. */
+	fileprivate static func execute(_ sql: String, connection: MySQLConnection) -> Fallible<MySQLStatementResult> {
+		guard let statement = mysql_stmt_init(connection.connection) else {
+			return .failure(connection.lastError)
+		}
+
+		let error = { () -> Fallible<MySQLStatementResult> in
+			let message = String(cString: mysql_stmt_error(statement), encoding: String.Encoding.utf8) ?? "(unknown)"
+			mysql_stmt_close(statement)
+			return .failure(message)
+		}
+
+		let utf8 = Array(sql.utf8)
+		let prepared = utf8.withUnsafeBufferPointer { buffer in
+			return buffer.withMemoryRebound(to: Int8.self) { chars in
+				return mysql_stmt_prepare(statement, chars.baseAddress, UInt(chars.count))
+			}
+		}
+
+		if prepared != 0 || mysql_stmt_execute(statement) != 0 {
+			return error()
+		}
+
+		guard let metadata = mysql_stmt_result_metadata(statement) else {
+			return error()
+		}
+		defer { mysql_free_result(metadata) }
+
+		var columns: OrderedSet<Column> = []
+		var fields: [MYSQL_FIELD] = []
+		for _ in 0..<mysql_num_fields(metadata) {
+			guard let field = mysql_fetch_field(metadata) else {
+				mysql_stmt_close(statement)
+				return .failure(NSLocalizedString("MySQL returned an invalid column.", comment: ""))
+			}
+
+			guard let name = String(bytesNoCopy: field.pointee.name, length: Int(field.pointee.name_length), encoding: String.Encoding.utf8, freeWhenDone: false) else {
+				mysql_stmt_close(statement)
+				return .failure(NSLocalizedString("The MySQL data contains an invalid column name.", comment: ""))
+			}
+
+			columns.append(Column(String(name)))
+			fields.append(field.pointee)
+		}
+
+		// From here on, the result owns the statement and closes it when it is deallocated
+		let result = MySQLStatementResult(connection: connection, statement: statement, columns: columns, fields: fields)
+		if mysql_stmt_bind_result(statement, result.binds) != 0 {
+			return .failure(String(cString: mysql_stmt_error(statement), encoding: String.Encoding.utf8) ?? "(unknown)")
+		}
+		return .success(result)
+	}
+
+	private init(connection: MySQLConnection, statement: UnsafeMutablePointer<MYSQL_STMT>, columns: OrderedSet<Column>, fields: [MYSQL_FIELD]) {
+		self.connection = connection
+		self.statement = statement
+		self.columns = columns
+		self.types = fields.map { $0.type }
+		self.decimals = fields.map { Int($0.decimals) }
+
+		self.kinds = fields.map { field -> Kind in
+			switch field.type.rawValue {
+			case MYSQL_TYPE_TINY.rawValue, MYSQL_TYPE_SHORT.rawValue, MYSQL_TYPE_LONG.rawValue, MYSQL_TYPE_INT24.rawValue, MYSQL_TYPE_LONGLONG.rawValue:
+				return (field.flags & UInt32(UNSIGNED_FLAG)) != 0 ? .unsignedInteger : .integer
+
+			case MYSQL_TYPE_DOUBLE.rawValue, MYSQL_TYPE_FLOAT.rawValue:
+				return .double
+
+			case MYSQL_TYPE_DECIMAL.rawValue, MYSQL_TYPE_NEWDECIMAL.rawValue:
+				return .decimal
+
+			case MYSQL_TYPE_TIMESTAMP.rawValue:
+				return .timestamp
+
+			case MYSQL_TYPE_TIME.rawValue, MYSQL_TYPE_DATE.rawValue, MYSQL_TYPE_DATETIME.rawValue:
+				return .time
+
+			case MYSQL_TYPE_TINY_BLOB.rawValue, MYSQL_TYPE_MEDIUM_BLOB.rawValue, MYSQL_TYPE_LONG_BLOB.rawValue, MYSQL_TYPE_BLOB.rawValue:
+				return .blob
+
+			default:
+				return .string
+			}
+		}
+
+		let count = fields.count
+		self.binds = UnsafeMutablePointer<MYSQL_BIND>.allocate(capacity: count)
+		self.binds.initialize(repeating: MYSQL_BIND(), count: count)
+		self.lengths = UnsafeMutablePointer<UInt>.allocate(capacity: count)
+		self.lengths.initialize(repeating: 0, count: count)
+		self.nulls = UnsafeMutablePointer<my_bool>.allocate(capacity: count)
+		self.nulls.initialize(repeating: 0, count: count)
+		self.errors = UnsafeMutablePointer<my_bool>.allocate(capacity: count)
+		self.errors.initialize(repeating: 0, count: count)
+
+		var buffers: [UnsafeMutableRawPointer] = []
+		for (index, kind) in self.kinds.enumerated() {
+			let bufferType: enum_field_types
+			let size: Int
+
+			switch kind {
+			case .integer, .unsignedInteger:
+				bufferType = MYSQL_TYPE_LONGLONG
+				size = MemoryLayout<Int64>.size
+
+			case .double:
+				bufferType = MYSQL_TYPE_DOUBLE
+				size = MemoryLayout<Double>.size
+
+			case .timestamp, .time:
+				bufferType = fields[index].type
+				size = MemoryLayout<MYSQL_TIME>.size
+
+			case .blob:
+				bufferType = MYSQL_TYPE_BLOB
+				size = MySQLStatementResult.bufferSize
+
+			case .decimal, .string:
+				bufferType = MYSQL_TYPE_STRING
+				size = MySQLStatementResult.bufferSize
+			}
+
+			// One extra byte, so that decimals can be terminated and passed to strtod
+			let buffer = UnsafeMutableRawPointer.allocate(byteCount: size + 1, alignment: 8)
+			buffers.append(buffer)
+
+			self.binds[index].buffer_type = bufferType
+			self.binds[index].buffer = buffer
+			self.binds[index].buffer_length = UInt(size)
+			self.binds[index].length = self.lengths + index
+			self.binds[index].is_null = self.nulls + index
+			self.binds[index].error = self.errors + index
+			self.binds[index].is_unsigned = kind == .unsignedInteger ? 1 : 0
+		}
+		self.buffers = buffers
+	}
+
+	deinit {
+		let statement = self.statement
+		self.connection.sync { () -> () in
+			_ = mysql_stmt_free_result(statement)
+			_ = mysql_stmt_close(statement)
+		}
+
+		for buffer in self.buffers {
+			buffer.deallocate()
+		}
+		self.binds.deallocate()
+		self.lengths.deallocate()
+		self.nulls.deallocate()
+		self.errors.deallocate()
+	}
+
+	func rows(_ count: Int, callback: @escaping (Fallible<[Tuple]>) -> ()) {
+		self.connection.queue.async {
+			var rows: [Tuple] = []
+			rows.reserveCapacity(count)
+
+			while rows.count < count && !self.finished {
+				let status = mysql_stmt_fetch(self.statement)
+				if status == 0 || status == MYSQL_DATA_TRUNCATED {
+					rows.append(self.row())
+				}
+				else if status == MYSQL_NO_DATA {
+					self.finished = true
+				}
+				else {
+					self.finished = true
+					callback(.failure(String(cString: mysql_stmt_error(self.statement), encoding: String.Encoding.utf8) ?? "(unknown)"))
+					return
+				}
+			}
+
+			callback(.success(rows))
+		}
+	}
+
+	/** Converts the values in the bound buffers to a row. */
+	private func row() -> Tuple {
+		var row: Tuple = []
+		row.reserveCapacity(self.kinds.count)
+
+		for (index, kind) in self.kinds.enumerated() {
+			if self.nulls[index] != 0 {
+				row.append(Value.empty)
+				continue
+			}
+
+			let buffer = self.buffers[index]
+			let length = Int(self.lengths[index])
+
+			switch kind {
+			case .integer:
+				row.append(Value.int(Int(buffer.load(as: Int64.self))))
+
+			case .unsignedInteger:
+				let value = buffer.load(as: UInt64.self)
+				row.append(value <= UInt64(Int.max) ? Value.int(Int(value)) : Value.invalid)
+
+			case .double:
+				row.append(Value.double(buffer.load(as: Double.self)))
+
+			case .decimal:
+				if length > MySQLStatementResult.bufferSize {
+					row.append(Value.invalid)
+				}
+				else {
+					buffer.storeBytes(of: 0, toByteOffset: length, as: UInt8.self)
+					let chars = buffer.assumingMemoryBound(to: Int8.self)
+					var end: UnsafeMutablePointer<Int8>? = nil
+					let value = strtod(chars, &end)
+					row.append((length > 0 && end == chars + length) ? Value.double(value) : Value.invalid)
+				}
+
+			case .timestamp:
+				row.append(MySQLTime.date(buffer.load(as: MYSQL_TIME.self)))
+
+			case .time:
+				row.append(Value.string(MySQLTime.string(buffer.load(as: MYSQL_TIME.self), type: self.types[index], decimals: self.decimals[index])))
+
+			case .blob, .string:
+				let data: Data
+				if length > MySQLStatementResult.bufferSize {
+					data = self.fetchColumn(index, length: length)
+				}
+				else {
+					data = Data(bytes: buffer, count: length)
+				}
+
+				if kind == .blob {
+					row.append(Value.blob(data))
+				}
+				else if let s = String(data: data, encoding: String.Encoding.utf8) {
+					row.append(Value.string(s))
+				}
+				else {
+					row.append(Value.invalid)
+				}
+			}
+		}
+
+		return row
+	}
+
+	/** Fetches a value that did not fit in the bound buffer. */
+	private func fetchColumn(_ index: Int, length: Int) -> Data {
+		var data = Data(count: length)
+		var bind = self.binds[index]
+		var fetchedLength: UInt = 0
+		data.withUnsafeMutableBytes { (bytes: UnsafeMutableRawBufferPointer) in
+			bind.buffer = bytes.baseAddress
+			bind.buffer_length = UInt(length)
+			withUnsafeMutablePointer(to: &fetchedLength) { fetchedLengthPointer in
+				bind.length = fetchedLengthPointer
+				_ = mysql_stmt_fetch_column(self.statement, &bind, UInt32(index), 0)
+			}
+		}
+		return data
 	}
 }
 
@@ -349,19 +746,21 @@ public class MySQLDatabase: SQLDatabase {
 	}
 }
 
-/** Instantiates the MySQL client library. Note that when the library indicates it is threadsafe, we use a concurrent
-queue to execute operations, whereas otherwise the queue will be serial. With a serial queue, operations like connecting
-may take a long time and stall other operations. Note that we also maintain a per-connection serial queue, which targets
-the client queue. */
+/** Instantiates the MySQL client library. Each connection has its own serial queue, on which all operations on the
+connection are performed. When the library indicates it is threadsafe, these queues are independent, so that different
+connections can be used in parallel. Otherwise, the connection queues target a shared serial queue, so that all
+operations are serialized. */
 fileprivate class MySQLClient {
 	fileprivate static var sharedClient = MySQLClient()
 	fileprivate let queue: DispatchQueue
+	fileprivate let isThreadSafe: Bool
 
 	fileprivate init() {
 		/* Mysql_library_init is what we should call, but as it is #defined to mysql_server_init, Swift doesn't see it.
 		So we just call mysql_server_int. */
 		if mysql_server_init(0, nil, nil) == 0 {
-			if mysql_thread_safe() == 1 {
+			isThreadSafe = mysql_thread_safe() == 1
+			if isThreadSafe {
 				queue = DispatchQueue(label: "MySQLConnection.Queue", qos: .default, attributes: [.concurrent], autoreleaseFrequency: .inherit, target: nil)
 			}
 			else {
@@ -373,6 +772,11 @@ fileprivate class MySQLClient {
 			fatalError("Error initializing MySQL library")
 		}
 	}
+
+	/** Creates the serial queue for a new connection. */
+	fileprivate func connectionQueue() -> DispatchQueue {
+		return DispatchQueue(label: "MySQLConnection", qos: .default, attributes: [], autoreleaseFrequency: .inherit, target: self.isThreadSafe ? nil : self.queue)
+	}
 }
 
 public struct MySQLConstraint {
@@ -388,28 +792,40 @@ public struct MySQLConstraint {
 }
 
 /** Implements a connection to a MySQL database (corresponding to a MYSQL object in the MySQL library). The connection 
-ensures that any operations are serialized (for now using a global queue for all MySQL operations). */
+ensures that any operations are serialized, using a queue for each connection (see MySQLClient). */
 public class MySQLConnection: SQLConnection {
 
 	fileprivate(set) var database: MySQLDatabase
 	fileprivate var connection: UnsafeMutablePointer<MYSQL>?
 	fileprivate(set) weak var result: MySQLResult?
+	fileprivate weak var statement: MySQLStatementResult?
 	fileprivate let queue: DispatchQueue
+	private static let queueKey = DispatchSpecificKey<UnsafeMutableRawPointer>()
 
 	fileprivate init(database: MySQLDatabase, connection: UnsafeMutablePointer<MYSQL>) {
 		self.database = database
 		self.connection = connection
-		self.queue = DispatchQueue(label: "MySQLConnection", qos: .default, attributes: [], autoreleaseFrequency: .inherit, target: MySQLClient.sharedClient.queue)
+		self.queue = MySQLClient.sharedClient.connectionQueue()
+		self.queue.setSpecific(key: MySQLConnection.queueKey, value: UnsafeMutableRawPointer(connection))
 	}
 
 	deinit {
 		if connection != nil {
-			self.queue.sync {
+			self.sync {
 				mysql_close(self.connection)
 			}
 		}
 	}
 
+	/** Performs the block on the queue of this connection. As results may be released on that queue (after reading rows,
+	see MySQLResult.rows), the block is performed directly when already on the queue. */
+	fileprivate func sync<T>(_ block: () -> T) -> T {
+		if let c = self.connection, DispatchQueue.getSpecific(key: MySQLConnection.queueKey) == UnsafeMutableRawPointer(c) {
+			return block()
+		}
+		return self.queue.sync(execute: block)
+	}
+
 	public func run(_ sql: [String], job: Job, callback: (Fallible<Void>) -> ()) {
 		for query in sql {
 			switch self.query(query) {
@@ -425,6 +841,17 @@ public class MySQLConnection: SQLConnection {
 		callback(.success(()))
 	}
 
+	public func bulkLoader(table: String, schema: String?, columns: [Column], job: Job) -> SQLBulkLoader? {
+		if columns.isEmpty {
+			return nil
+		}
+
+		let dialect = self.database.dialect
+		let fields = columns.map { dialect.columnIdentifier($0, table: nil, schema: nil, database: nil) }.joined(separator: ", ")
+		let tableIdentifier = dialect.tableIdentifier(table, schema: schema, database: self.database.databaseName)
+		return MySQLInsertLoader(connection: self, insertStatement: "INSERT INTO \(tableIdentifier) (\(fields)) VALUES ", columnCount: columns.count)
+	}
+
 	func clone() -> Fallible<MySQLConnection> {
 		return self.database.connect()
 	}
@@ -516,7 +943,7 @@ public class MySQLConnection: SQLConnection {
 
 	fileprivate func perform(_ block: () -> (Int32)) -> Bool {
 		var success: Bool = false
-		self.queue.sync {
+		self.sync { () -> () in
 			let result = block()
 			if result != 0 {
 				let message = String(cString: mysql_error(self.connection), encoding: String.Encoding.utf8) ?? "(unknown)"
@@ -538,9 +965,28 @@ public class MySQLConnection: SQLConnection {
 		return mysql_errno(self.connection) != 0
 	}
 
+	/** Executes a query that returns a result as prepared statement, so that the result is read using the binary
+	protocol (see MySQLStatementResult). */
+	fileprivate func execute(_ sql: String) -> Fallible<MySQLStatementResult> {
+		if (self.result != nil && !self.result!.finished) || (self.statement != nil && !self.statement!.finished) {
+			fatalError("Cannot start a query when the previous result is not finished yet")
+		}
+
+		#if DEBUG
+			trace("MySQL Statement \(sql)")
+		#endif
+
+		return self.sync {
+			return MySQLStatementResult.execute(sql, connection: self).use { statement -> MySQLStatementResult in
+				self.statement = statement
+				return statement
+			}
+		}
+	}
+
 	/** Returns the result as MySQLResult. This is nil for queries that do not return a result (e.g. UPDATE, SET, etc.). */
 	func query(_ sql: String) -> Fallible<MySQLResult?> {
-		if self.result != nil && !self.result!.finished {
+		if (self.result != nil && !self.result!.finished) || (self.statement != nil && !self.statement!.finished) {
 			fatalError("Cannot start a query when the previous result is not finished yet")
 		}
 		self.result = nil
@@ -567,10 +1013,281 @@ public class MySQLConnection: SQLConnection {
 	}
 }
 
+/** Parameter values for a batch of rows, bound to consecutive placeholders. The values are copied into a single buffer
+on the thread that prepares the batch, so that they remain valid while the batch is inserted on the connection queue. */
+private final class MySQLParameters {
+	let binds: UnsafeMutablePointer<MYSQL_BIND>
+	private let lengths: UnsafeMutablePointer<UInt>
+	private let storage: UnsafeMutableRawPointer
+	private let count: Int
+
+	init(rows: [Tuple]) {
+		let size = rows.reduce(0) { s, row in row.reduce(s) { $0 + MySQLParameters.size(of: $1) } }
+		self.count = rows.reduce(0) { $0 + $1.count }
+		self.storage = UnsafeMutableRawPointer.allocate(byteCount: max(1, size), alignment: 8)
+		self.binds = UnsafeMutablePointer<MYSQL_BIND>.allocate(capacity: self.count)
+		self.binds.initialize(repeating: MYSQL_BIND(), count: self.count)
+		self.lengths = UnsafeMutablePointer<UInt>.allocate(capacity: self.count)
+		self.lengths.initialize(repeating: 0, count: self.count)
+
+		var offset = 0
+		var index = 0
+		for row in rows {
+			for value in row {
+				let buffer = self.storage + offset
+				let length: Int
+
+				switch value {
+				case .int(let i):
+					buffer.storeBytes(of: Int64(i), as: Int64.self)
+					self.binds[index].buffer_type = MYSQL_TYPE_LONGLONG
+					length = MemoryLayout<Int64>.size
+
+				case .bool(let b):
+					buffer.storeBytes(of: Int64(b ? 1 : 0), as: Int64.self)
+					self.binds[index].buffer_type = MYSQL_TYPE_LONGLONG
+					length = MemoryLayout<Int64>.size
+
+				case .double(let d), .date(let d):
+					// Dates are written as number, as the SQL dialect does for date literals
+					buffer.storeBytes(of: d, as: Double.self)
+					self.binds[index].buffer_type = MYSQL_TYPE_DOUBLE
+					length = MemoryLayout<Double>.size
+
+				case .string(let s):
+					length = s.utf8.count
+					UnsafeMutableRawBufferPointer(start: buffer, count: length).copyBytes(from: s.utf8)
+					self.binds[index].buffer_type = MYSQL_TYPE_STRING
+
+				case .blob(let d):
+					length = d.count
+					UnsafeMutableRawBufferPointer(start: buffer, count: length).copyBytes(from: d)
+					self.binds[index].buffer_type = MYSQL_TYPE_BLOB
+
+				case .empty, .invalid, .list(_):
+					// Lists cannot be written as literal either, and are inserted as NULL
+					self.binds[index].buffer_type = MYSQL_TYPE_NULL
+					length = 0
+				}
+
+				self.lengths[index] = UInt(length)
+				self.binds[index].buffer = buffer
+				self.binds[index].buffer_length = UInt(length)
+				self.binds[index].length = self.lengths + index
+				offset += MySQLParameters.size(of: value)
+				index += 1
+			}
+		}
+	}
+
+	deinit {
+		self.binds.deallocate()
+		self.lengths.deallocate()
+		self.storage.deallocate()
+	}
+
+	/** The number of bytes reserved for the value in the buffer (rounded up to keep numbers aligned). */
+	private static func size(of value: Value) -> Int {
+		switch value {
+		case .int(_), .bool(_), .double(_), .date(_): return 8
+		case .string(let s): return (s.utf8.count + 7) & ~7
+		case .blob(let d): return (d.count + 7) & ~7
+		case .empty, .invalid, .list(_): return 0
+		}
+	}
+}
+
+/** Inserts rows using prepared multi-row INSERT statements, to which the values are bound using the binary protocol (so
+that they do not need to be formatted and escaped as SQL, and then parsed again by the server). A statement that inserts
+the maximum number of rows at once is prepared once and reused for all batches. Rows are inserted in large transactions.
+
+Batches are prepared on the calling thread and inserted on the queue of the connection. The callback for a batch is
+called as soon as the previous batch has been inserted, so that the next batch can be prepared in the meantime. */
+private final class MySQLInsertLoader: SQLBulkLoader {
+	/** The maximum number of rows inserted by a single statement. MySQL allows at most 65535 placeholders. */
+	static let maximumRowsPerStatement = 256
+
+	/** The number of rows after which the transaction is committed and a new one is started. */
+	static let transactionSize = 100_000
+
+	private let connection: MySQLConnection
+	private let insertStatement: String
+	private let columnCount: Int
+	private let rowsPerStatement: Int
+
+	// These are only accessed on the queue of the connection
+	private var statement: UnsafeMutablePointer<MYSQL_STMT>? = nil
+	private var inTransaction = false
+	private var rowsInTransaction = 0
+	private var error: String? = nil
+
+	init(connection: MySQLConnection, insertStatement: String, columnCount: Int) {
+		self.connection = connection
+		self.insertStatement = insertStatement
+		self.columnCount = columnCount
+		self.rowsPerStatement = max(1, min(MySQLInsertLoader.maximumRowsPerStatement, 65535 / columnCount))
+	}
+
+	deinit {
+		if let s = self.statement {
+			self.connection.sync { () -> () in
+				_ = mysql_stmt_close(s)
+			}
+		}
+	}
+
+	func append(_ rows: [Tuple], job: Job, callback: @escaping (Fallible<Void>) -> ()) {
+		var parameters: MySQLParameters! = nil
+		job.time("Bind MySQL parameters", items: rows.count, itemType: "row") {
+			parameters = MySQLParameters(rows: rows)
+		}
+		let count = rows.count
+
+		/* Report back once the previous batch has been inserted, so that the next batch can be prepared while this one is
+		being inserted. Errors inserting this batch are reported for the next one. */
+		self.connection.queue.async {
+			let error = self.error
+			job.async {
+				callback(error == nil ? .success(()) : .failure(error!))
+			}
+		}
+
+		self.connection.queue.async {
+			if self.error != nil {
+				return
+			}
+
+			if !self.inTransaction {
+				if !self.execute("START TRANSACTION") {
+					return
+				}
+				self.inTransaction = true
+			}
+
+			var offset = 0
+			while offset < count {
+				let n = min(self.rowsPerStatement, count - offset)
+				guard let statement = self.prepare(rows: n) else {
+					self.rollback()
+					return
+				}
+
+				if mysql_stmt_bind_param(statement, parameters.binds + (offset * self.columnCount)) != 0 || mysql_stmt_execute(statement) != 0 {
+					self.error = String(cString: mysql_stmt_error(statement), encoding: String.Encoding.utf8) ?? "(unknown)"
+				}
+
+				// Only the statement for the maximum number of rows is kept
+				if statement != self.statement {
+					_ = mysql_stmt_close(statement)
+				}
+
+				if self.error != nil {
+					self.rollback()
+					return
+				}
+				offset += n
+			}
+
+			self.rowsInTransaction += count
+			if self.rowsInTransaction >= MySQLInsertLoader.transactionSize {
+				self.commit()
+			}
+		}
+	}
+
+	func finish(_ job: Job, callback: @escaping (Fallible<Void>) -> ()) {
+		self.connection.queue.async {
+			if self.error == nil {
+				self.commit()
+			}
+
+			if let s = self.statement {
+				_ = mysql_stmt_close(s)
+				self.statement = nil
+			}
+
+			let error = self.error
+			job.async {
+				callback(error == nil ? .success(()) : .failure(error!))
+			}
+		}
+	}
+
+	/** Returns a prepared statement that inserts the indicated number of rows. Must be called on the connection queue. */
+	private func prepare(rows: Int) -> UnsafeMutablePointer<MYSQL_STMT>? {
+		if rows == self.rowsPerStatement, let s = self.statement {
+			return s
+		}
+
+		guard let statement = mysql_stmt_init(self.connection.connection) else {
+			self.error = self.connection.lastError
+			return nil
+		}
+
+		let placeholders = "(" + Array(repeating: "?", count: self.columnCount).joined(separator: ",") + ")"
+		let sql = self.insertStatement + Array(repeating: placeholders, count: rows).joined(separator: ",")
+		let utf8 = Array(sql.utf8)
+		let prepared = utf8.withUnsafeBufferPointer { buffer in
+			return buffer.withMemoryRebound(to: Int8.self) { chars in
+				return mysql_stmt_prepare(statement, chars.baseAddress, UInt(chars.count))
+			}
+		}
+
+		if prepared != 0 {
+			self.error = String(cString: mysql_stmt_error(statement), encoding: String.Encoding.utf8) ?? "(unknown)"
+			_ = mysql_stmt_close(statement)
+			return nil
+		}
+
+		if rows == self.rowsPerStatement {
+			self.statement = statement
+		}
+		return statement
+	}
+
+	private func commit() {
+		if self.inTransaction {
+			self.inTransaction = false
+			self.rowsInTransaction = 0
+			_ = self.execute("COMMIT")
+		}
+	}
+
+	private func rollback() {
+		if self.inTransaction {
+			self.inTransaction = false
+			self.rowsInTransaction = 0
+			if mysql_query(self.connection.connection, "ROLLBACK") != 0 {
+				trace("MySQL: rollback of bulk insert failed: \(self.connection.lastError)")
+			}
+		}
+	}
+
+	/** Executes a statement that does not return a result. Must be called on the connection queue. */
+	private func execute(_ sql: String) -> Bool {
+		if mysql_query(self.connection.connection, sql) != 0 {
+			if self.error == nil {
+				self.error = self.connection.lastError
+			}
+			return false
+		}
+		return true
+	}
+}
+
 /** Represents the result of a MySQL query as a Dataset object. */
 public final class MySQLDataset: SQLDataset {
 	private let database: MySQLDatabase
 
+	/** The table this data set reads from, if it reads the whole table (i.e. no operations have been applied). */
+	private let tableName: String?
+
+	/** The maximum number of connections over which a table is read in parallel. */
+	static let maximumPartitionCount = 4
+
+	/** Tables whose primary key spans less values than this (per partition) are not read in parallel. */
+	static let minimumPartitionSize = 50_000
+
 	public static func create(_ database: MySQLDatabase, tableName: String) -> Fallible<MySQLDataset> {
 		let query = "SELECT * FROM \(database.dialect.tableIdentifier(tableName, schema: nil, database: database.databaseName)) LIMIT 1"
 
@@ -598,11 +1315,13 @@ public final class MySQLDataset: SQLDataset {
 
 	fileprivate init(database: MySQLDatabase, fragment: SQLFragment, columns: OrderedSet<Column>) {
 		self.database = database
+		self.tableName = nil
 		super.init(fragment: fragment, columns: columns)
 	}
 
 	fileprivate init(database: MySQLDatabase, table: String, columns: OrderedSet<Column>) {
 		self.database = database
+		self.tableName = table
 		super.init(table: table, schema: nil, database: database.databaseName!, dialect: database.dialect, columns: columns)
 	}
 
@@ -614,8 +1333,81 @@ public final class MySQLDataset: SQLDataset {
 		return MySQLStream(data: self)
 	}
 
-	fileprivate func result() -> Fallible<MySQLResult?> {
-		return self.database.connect().use { $0.query(self.sql.sqlSelect(nil).sql) }
+	/** Executes the query for this data set. When the data set reads a whole table that has an integer primary key, the
+	range of the key is split in several partitions, which are queried over separate connections so that they can be read
+	in parallel. Otherwise, a single result is returned. */
+	fileprivate func results() -> Fallible<[MySQLBatchResult]> {
+		return self.database.connect().use { connection -> Fallible<[MySQLBatchResult]> in
+			let queries = self.partitionQueries(connection) ?? [self.sql.sqlSelect(nil).sql]
+
+			var results: [MySQLBatchResult] = []
+			for (index, query) in queries.enumerated() {
+				let partitionConnection = index == 0 ? Fallible.success(connection) : connection.clone()
+				switch partitionConnection.use({ $0.execute(query) }) {
+				case .success(let result):
+					results.append(result)
+
+				case .failure(let e):
+					return .failure(e)
+				}
+			}
+			return .success(results)
+		}
+	}
+
+	private func partitionQueries(_ connection: MySQLConnection) -> [String]? {
+		let partitionCount = min(MySQLDataset.maximumPartitionCount, ProcessInfo.processInfo.processorCount)
+		guard let table = self.tableName, partitionCount > 1 else {
+			return nil
+		}
+
+		let dialect = self.database.dialect
+		let tableIdentifier = dialect.tableIdentifier(table, schema: nil, database: self.database.databaseName)
+
+		// Find a primary key that consists of a single column
+		var keyColumns: [String] = []
+		switch connection.query("SHOW KEYS FROM \(tableIdentifier) WHERE Key_name = 'PRIMARY'") {
+		case .success(let result):
+			while let row = result?.row() {
+				if row.count > 4, let name = row[4].stringValue {
+					keyColumns.append(name)
+				}
+			}
+
+		case .failure(_):
+			return nil
+		}
+
+		guard keyColumns.count == 1 else {
+			return nil
+		}
+
+		// Determine the range of the key, if it is an integer
+		let key = dialect.columnIdentifier(Column(keyColumns[0]), table: nil, schema: nil, database: nil)
+		guard case .success(let result) = connection.query("SELECT MIN(\(key)), MAX(\(key)) FROM \(tableIdentifier)") else {
+			return nil
+		}
+		let row = result?.row()
+		result?.finish()
+
+		guard let r = row, r.count == 2, let minimum = r[0].intValue, let maximum = r[1].intValue else {
+			return nil
+		}
+
+		let span = maximum - minimum + 1
+		let count = min(partitionCount, span / MySQLDataset.minimumPartitionSize)
+		if count < 2 {
+			return nil
+		}
+
+		let step = span / count
+		return (0..<count).map { index -> String in
+			let lower = minimum + index * step
+			if index == count - 1 {
+				return "SELECT * FROM \(tableIdentifier) WHERE \(key) >= \(lower)"
+			}
+			return "SELECT * FROM \(tableIdentifier) WHERE \(key) >= \(lower) AND \(key) < \(lower + step)"
+		}
 	}
 
 	override public func isCompatibleWith(_ other: SQLDataset) -> Bool {
@@ -629,14 +1421,74 @@ public final class MySQLDataset: SQLDataset {
 }
 
 /**
-MySQLStream provides a stream of records from a MySQL result set. Because SQLite result can only be accessed once
-sequentially, cloning of this stream requires re-executing the query. */
-private final class MySQLResultStream: SequenceStream {
-	init(result: MySQLResult) {
-		super.init(AnySequence<Fallible<Tuple>>(result), columns: result.columns)
+Streams the rows of one or more MySQL results (see MySQLDataset.results). Each call to fetch reads a batch of rows from
+the next result (in turn) that is not finished yet. Each result is read on the queue of its own connection, so that
+concurrent fetches read from different results in parallel. Because a result can only be accessed once sequentially,
+cloning of this stream requires re-executing the query. */
+private final class MySQLResultStream: WarpCore.Stream {
+	private let results: [MySQLBatchResult]
+	private var finished: [Bool]
+	private var nextResult = 0
+	private let mutex = Mutex()
+	private let sizer = BatchSizer()
+
+	init(results: [MySQLBatchResult]) {
+		self.results = results
+		self.finished = results.map { _ in false }
+	}
+
+	func fetch(_ job: Job, consumer: @escaping Sink) {
+		// Claim the next result that has rows left
+		let claimed = self.mutex.locked { () -> Int? in
+			for i in 0..<self.results.count {
+				let index = (self.nextResult + i) % self.results.count
+				if !self.finished[index] {
+					self.nextResult = index + 1
+					return index
+				}
+			}
+			return nil
+		}
+
+		guard let index = claimed else {
+			consumer(.success([]), .finished)
+			return
+		}
+
+		let batchSize = self.sizer.size
+		let started = CFAbsoluteTimeGetCurrent()
+		self.results[index].rows(batchSize) { result in
+			switch result {
+			case .success(let rows):
+				self.sizer.observe(rows, duration: CFAbsoluteTimeGetCurrent() - started)
+				let status = self.mutex.locked { () -> StreamStatus in
+					if rows.count < batchSize {
+						self.finished[index] = true
+					}
+					return self.finished.contains(false) ? .hasMore : .finished
+				}
+
+				job.async {
+					consumer(.success(rows), status)
+				}
+
+			case .failure(let e):
+				self.mutex.locked {
+					self.finished[index] = true
+				}
+
+				job.async {
+					consumer(.failure(e), .finished)
+				}
+			}
+		}
+	}
+
+	func columns(_ job: Job, callback: @escaping (Fallible<OrderedSet<Column>>) -> ()) {
+		callback(.success(self.results.first?.columns ?? []))
 	}
 
-	override func clone() -> WarpCore.Stream {
+	func clone() -> WarpCore.Stream {
 		fatalError("MySQLResultStream cannot be cloned, because a result cannot be iterated multiple times. Clone MySQLStream instead")
 	}
 }
@@ -655,14 +1507,9 @@ public final class MySQLStream: WarpCore.Stream {
 	private func stream() -> WarpCore.Stream {
 		return self.mutex.locked {
 			if resultStream == nil {
-				switch data.result() {
-				case .success(let result):
-					if let result = result {
-						resultStream = MySQLResultStream(result: result)
-					}
-					else {
-						resultStream = ErrorStream("no result received, but also not an error")
-					}
+				switch data.results() {
+				case .success(let results):
+					resultStream = MySQLResultStream(results: results)
 
 				case .failure(let error):
 					resultStream = ErrorStream(error)
@@ -268,6 +268,107 @@ internal enum PostgresType: Oid {
 	case fdw_handler = 3115
 }
 
+extension PostgresType {
+	/** Whether values of this type can be read in binary format (see value(binary:length:)). For the types that can be
+	read, the resulting values are the same as when they are read in text format. This excludes float4: the server
+	sends its shortest decimal representation as text (e.g. 0.1), whereas the binary single-precision value widened to
+	a double is not the same (0.10000000149011612). */
+	var hasBinaryFormat: Bool {
+		switch self {
+		case .bool, .bytea, .char, .name, .int8, .int2, .int4, .text, .float8, .numeric, .json, .jsonb, .bpchar, .varchar:
+			return true
+		default:
+			return false
+		}
+	}
+
+	/** Converts a value in the binary format of this type (as sent by the server, in network byte order) to a Value. */
+	func value(binary bytes: UnsafeRawPointer, length: Int) -> Value {
+		switch self {
+		case .bool:
+			return length == 1 ? Value.bool(bytes.load(as: UInt8.self) != 0) : Value.invalid
+
+		case .int2:
+			return length == 2 ? Value.int(Int(Int16(bitPattern: PostgresType.read(bytes, as: UInt16.self)))) : Value.invalid
+
+		case .int4:
+			return length == 4 ? Value.int(Int(Int32(bitPattern: PostgresType.read(bytes, as: UInt32.self)))) : Value.invalid
+
+		case .int8:
+			return length == 8 ? Value.int(Int(Int64(bitPattern: PostgresType.read(bytes, as: UInt64.self)))) : Value.invalid
+
+		case .float8:
+			if length == 8 {
+				let d = Double(bitPattern: PostgresType.read(bytes, as: UInt64.self))
+				return d.isNaN ? Value.invalid : Value.double(d)
+			}
+			return Value.invalid
+
+		case .numeric:
+			return PostgresType.numeric(bytes, length: length)
+
+		case .bytea:
+			return Value.blob(Data(bytes: bytes, count: length))
+
+		case .json, .jsonb:
+			// Binary jsonb is the JSON text preceded by a version number (currently always 1)
+			let offset = (self == .jsonb) ? 1 : 0
+			if length < offset || (self == .jsonb && bytes.load(as: UInt8.self) != 1) {
+				return Value.invalid
+			}
+
+			let data = Data(bytesNoCopy: UnsafeMutableRawPointer(mutating: bytes + offset), count: length - offset, deallocator: .none)
+			if let obj = try? JSONSerialization.jsonObject(with: data, options: [.allowFragments]) {
+				return Value(jsonObject: obj)
+			}
+			return Value.invalid
+
+		default:
+			// The binary format of text types is the text itself
+			let buffer = UnsafeBufferPointer(start: bytes.assumingMemoryBound(to: UInt8.self), count: length)
+			return Value.string(String(decoding: buffer, as: UTF8.self))
+		}
+	}
+
+	private static func read<T: FixedWidthInteger>(_ bytes: UnsafeRawPointer, as type: T.Type) -> T {
+		var value: T = 0
+		memcpy(&value, bytes, MemoryLayout<T>.size)
+		return T(bigEndian: value)
+	}
+
+	/** Numeric values are sent as a sequence of base-10000 digits, preceded by the number of digits, the weight of the
+	first digit (the power of 10000 it is to be multiplied with), the sign and the display scale. */
+	private static func numeric(_ bytes: UnsafeRawPointer, length: Int) -> Value {
+		if length < 8 {
+			return Value.invalid
+		}
+
+		let digitCount = Int(Int16(bitPattern: read(bytes, as: UInt16.self)))
+		let weight = Int(Int16(bitPattern: read(bytes + 2, as: UInt16.self)))
+		let sign = read(bytes + 4, as: UInt16.self)
+
+		// 0x0000 is positive, 0x4000 negative; anything else is NaN or infinity
+		if (sign != 0x0000 && sign != 0x4000) || length < 8 + digitCount * 2 {
+			return Value.invalid
+		}
+
+		var value = 0.0
+		for i in 0..<digitCount {
+			value = value * 10000.0 + Double(read(bytes + 8 + i * 2, as: UInt16.self))
+		}
+
+		// Dividing by an exact power of ten (rather than multiplying by an inexact negative one) avoids rounding errors
+		let exponent = weight - digitCount + 1
+		if exponent < 0 {
+			value /= pow(10000.0, Double(-exponent))
+		}
+		else if exponent > 0 {
+			value *= pow(10000.0, Double(exponent))
+		}
+		return Value.double(sign == 0x4000 ? -value : value)
+	}
+}
+
 internal class PostgresResult: Sequence, IteratorProtocol {
 	typealias Element = Fallible<Tuple>
 	typealias Iterator = PostgresResult
@@ -308,29 +409,9 @@ internal class PostgresResult: Sequence, IteratorProtocol {
 					return
 				}
 
-				var columns: OrderedSet<Column> = []
-				var columnTypes: [Oid] = []
-
-				let colCount = PQnfields(result)
-				for colIndex in 0..<colCount {
-					if let column = PQfname(result, colIndex) {
-						if let name = String(cString: column, encoding: String.Encoding.utf8) {
-							columns.append(Column(String(name)))
-							let type = PQftype(result, colIndex)
-							columnTypes.append(type)
-						}
-						else {
-							resultFallible = .failure(NSLocalizedString("PostgreSQL returned an invalid column name.", comment: ""))
-							return
-						}
-					}
-					else {
-						resultFallible = .failure(NSLocalizedString("PostgreSQL returned an invalid column.", comment: ""))
-						return
-					}
+				resultFallible = PostgresResult.columns(of: result).use { columns in
+					return PostgresResult(connection: connection, result: result, columns: columns.0, columnTypes: columns.1)
 				}
-
-				resultFallible = .success(PostgresResult(connection: connection, result: result, columns: columns, columnTypes: columnTypes))
 			}
 			else {
 				resultFallible = .failure(connection.lastError)
@@ -340,6 +421,31 @@ internal class PostgresResult: Sequence, IteratorProtocol {
 		return resultFallible
 	}
 
+	/** Returns the names and types of the columns in a result. */
+	fileprivate static func columns(of result: OpaquePointer) -> Fallible<(OrderedSet<Column>, [Oid])> {
+		var columns: OrderedSet<Column> = []
+		var columnTypes: [Oid] = []
+
+		let colCount = PQnfields(result)
+		for colIndex in 0..<colCount {
+			if let column = PQfname(result, colIndex) {
+				if let name = String(cString: column, encoding: String.Encoding.utf8) {
+					columns.append(Column(String(name)))
+					let type = PQftype(result, colIndex)
+					columnTypes.append(type)
+				}
+				else {
+					return .failure(NSLocalizedString("PostgreSQL returned an invalid column name.", comment: ""))
+				}
+			}
+			else {
+				return .failure(NSLocalizedString("PostgreSQL returned an invalid column.", comment: ""))
+			}
+		}
+
+		return .success((columns, columnTypes))
+	}
+
 	private init(connection: PostgresConnection, result: OpaquePointer, columns: OrderedSet<Column>, columnTypes: [Oid]) {
 		self.connection = connection
 		self.result = result
@@ -411,60 +517,7 @@ internal class PostgresResult: Sequence, IteratorProtocol {
 							}
 							else {
 								if let stringValue = String(cString: val, encoding: String.Encoding.utf8) {
-									if let type = PostgresType(rawValue: PQftype(self.result, Int32(colIndex))) {
-										switch type {
-										case .bytea:
-											// This is delivered to us as '\\xdeadbeef'
-											// TODO this could probaby be made more efficient by not reading as UTF-8 first
-											let chars = Array(stringValue)
-											let numbers = stride(from: 2, to: chars.count, by: 2).map() {
-												UInt8(strtoul(String(chars[$0 ..< Swift.min($0 + 2, chars.count)]), nil, 16))
-											}
-											rowDataset!.append(.blob(Data(numbers)))
-
-										case .int8, .int4, .int2:
-											if let iv = stringValue.toInt() {
-												rowDataset!.append(Value.int(iv))
-											}
-											else {
-												rowDataset!.append(Value.invalid)
-											}
-
-										case .float4, .float8, .numeric:
-											if stringValue == "NaN" {
-												rowDataset?.append(Value.invalid)
-											}
-											else if let dv = stringValue.toDouble() {
-												rowDataset!.append(Value.double(dv))
-											}
-											else {
-												rowDataset!.append(Value.invalid)
-											}
-
-										case .json, .jsonb:
-											if let data = stringValue.data(using: .utf8) {
-												do {
-													let obj = try JSONSerialization.jsonObject(with: data, options: [.allowFragments])
-													rowDataset!.append(Value(jsonObject: obj))
-												}
-												catch(_) {
-													rowDataset!.append(.invalid)
-												}
-											}
-											else {
-												rowDataset!.append(.invalid)
-											}
-
-										case .bool:
-											rowDataset!.append(Value.bool(stringValue == "t"))
-
-										default:
-											rowDataset!.append(Value.string(stringValue as String))
-										}
-									}
-									else {
-										rowDataset!.append(Value.string(stringValue as String))
-									}
+									rowDataset!.append(PostgresResult.value(text: stringValue, type: PQftype(self.result, Int32(colIndex))))
 								}
 								else {
 									rowDataset!.append(Value.empty)
@@ -505,6 +558,205 @@ internal class PostgresResult: Sequence, IteratorProtocol {
 			return nil
 		}
 	}
+
+	/** Converts a value in the text format of the indicated type to a Value. */
+	static func value(text stringValue: String, type: Oid) -> Value {
+		guard let type = PostgresType(rawValue: type) else {
+			return Value.string(stringValue)
+		}
+
+		switch type {
+		case .bytea:
+			// This is delivered to us as '\\xdeadbeef'
+			let chars = Array(stringValue)
+			let numbers = stride(from: 2, to: chars.count, by: 2).map() {
+				UInt8(strtoul(String(chars[$0 ..< Swift.min($0 + 2, chars.count)]), nil, 16))
+			}
+			return .blob(Data(numbers))
+
+		case .int8, .int4, .int2:
+			if let iv = stringValue.toInt() {
+				return Value.int(iv)
+			}
+			return Value.invalid
+
+		case .float4, .float8, .numeric:
+			if stringValue == "NaN" {
+				return Value.invalid
+			}
+			else if let dv = stringValue.toDouble() {
+				return Value.double(dv)
+			}
+			return Value.invalid
+
+		case .json, .jsonb:
+			if let data = stringValue.data(using: .utf8), let obj = try? JSONSerialization.jsonObject(with: data, options: [.allowFragments]) {
+				return Value(jsonObject: obj)
+			}
+			return .invalid
+
+		case .bool:
+			return Value.bool(stringValue == "t")
+
+		default:
+			return Value.string(stringValue)
+		}
+	}
+}
+
+/** A server-side cursor over the result of a query. Rows are fetched in batches of many rows per round trip (streams
+fetch at least `fetchSize` rows at a time), rather than in a separate result for each row (as PostgresResult does in
+single-row mode). When all columns are of types that can be read in binary format (see PostgresType.hasBinaryFormat),
+rows are fetched in binary format, so that values are decoded directly from the bytes sent by the server. The cursor is
+declared in a transaction, which is committed when all rows have been fetched (or rolled back when the connection is
+closed before that). */
+internal final class PostgresCursor {
+	static let fetchSize = 4096
+	private static let name = "warp_cursor"
+
+	private let connection: PostgresConnection
+	private let columnTypes: [PostgresType?]
+	private let binary: Bool
+	let columns: OrderedSet<Column>
+	private(set) var finished = false
+
+	fileprivate static func declare(_ connection: PostgresConnection, sql: String) -> Fallible<PostgresCursor> {
+		var cursorFallible: Fallible<PostgresCursor> = .failure("Unknown error")
+
+		connection.queue.sync {
+			for command in ["BEGIN", "DECLARE \(PostgresCursor.name) NO SCROLL CURSOR FOR \(sql)"] {
+				let result = PQexec(connection.connection, command)
+				defer { PQclear(result) }
+
+				if PQresultStatus(result).rawValue != PGRES_COMMAND_OK.rawValue {
+					cursorFallible = .failure(connection.lastError)
+					return
+				}
+			}
+
+			// Determine the column types (and hence the result format) before fetching any rows
+			guard let description = PQdescribePortal(connection.connection, PostgresCursor.name) else {
+				cursorFallible = .failure(connection.lastError)
+				return
+			}
+			defer { PQclear(description) }
+
+			if PQresultStatus(description).rawValue != PGRES_COMMAND_OK.rawValue {
+				cursorFallible = .failure(connection.lastError)
+				return
+			}
+
+			cursorFallible = PostgresResult.columns(of: description).use { columns in
+				return PostgresCursor(connection: connection, columns: columns.0, columnTypes: columns.1)
+			}
+		}
+
+		return cursorFallible
+	}
+
+	private init(connection: PostgresConnection, columns: OrderedSet<Column>, columnTypes: [Oid]) {
+		self.connection = connection
+		self.columns = columns
+		self.columnTypes = columnTypes.map { PostgresType(rawValue: $0) }
+		self.binary = !self.columnTypes.contains { !($0?.hasBinaryFormat ?? false) }
+	}
+
+	/** Fetches the next batch of (at most) `count` rows. When the batch contains less rows, the cursor is finished. */
+	func fetch(_ count: Int) -> Fallible<PostgresRowBatch> {
+		var batchFallible: Fallible<PostgresRowBatch> = .failure("Unknown error")
+
+		self.connection.queue.sync {
+			if self.finished {
+				batchFallible = .success(PostgresRowBatch(result: nil, columnTypes: self.columnTypes, binary: self.binary, isLast: true))
+				return
+			}
+
+			let sql = "FETCH FORWARD \(count) FROM \(PostgresCursor.name)"
+			guard let result = PQexecParams(self.connection.connection, sql, 0, nil, nil, nil, nil, self.binary ? 1 : 0) else {
+				self.finished = true
+				batchFallible = .failure(self.connection.lastError)
+				return
+			}
+
+			if PQresultStatus(result).rawValue != PGRES_TUPLES_OK.rawValue {
+				self.finished = true
+				batchFallible = .failure(self.connection.lastError)
+				PQclear(result)
+				return
+			}
+
+			let isLast = Int(PQntuples(result)) < count
+			if isLast {
+				self.finished = true
+				for command in ["CLOSE \(PostgresCursor.name)", "COMMIT"] {
+					PQclear(PQexec(self.connection.connection, command))
+				}
+			}
+			batchFallible = .success(PostgresRowBatch(result: result, columnTypes: self.columnTypes, binary: self.binary, isLast: isLast))
+		}
+
+		return batchFallible
+	}
+}
+
+/** A batch of rows fetched by PostgresCursor. The rows are decoded when `rows` is called, which may happen on any
+thread, as a result is not modified after it has been received. */
+internal final class PostgresRowBatch {
+	private let result: OpaquePointer?
+	private let columnTypes: [PostgresType?]
+	private let binary: Bool
+	let count: Int
+
+	/** Whether this is the last batch of rows the cursor will return. */
+	let isLast: Bool
+
+	fileprivate init(result: OpaquePointer?, columnTypes: [PostgresType?], binary: Bool, isLast: Bool) {
+		self.result = result
+		self.columnTypes = columnTypes
+		self.binary = binary
+		self.isLast = isLast
+		self.count = result == nil ? 0 : Int(PQntuples(result))
+	}
+
+	deinit {
+		if let r = self.result {
+			PQclear(r)
+		}
+	}
+
+	var rows: [Tuple] {
+		var rows: [Tuple] = []
+		rows.reserveCapacity(self.count)
+
+		for rowIndex in 0..<Int32(self.count) {
+			var row: Tuple = []
+			row.reserveCapacity(self.columnTypes.count)
+
+			for (colIndex, type) in self.columnTypes.enumerated() {
+				let col = Int32(colIndex)
+				if PQgetisnull(self.result, rowIndex, col) == 1 {
+					row.append(Value.empty)
+				}
+				else if let val = PQgetvalue(self.result, rowIndex, col) {
+					if self.binary, let t = type {
+						row.append(t.value(binary: UnsafeRawPointer(val), length: Int(PQgetlength(self.result, rowIndex, col))))
+					}
+					else if let stringValue = String(cString: val, encoding: String.Encoding.utf8) {
+						row.append(PostgresResult.value(text: stringValue, type: type?.rawValue ?? 0))
+					}
+					else {
+						row.append(Value.empty)
+					}
+				}
+				else {
+					row.append(Value.invalid)
+				}
+			}
+			rows.append(row)
+		}
+
+		return rows
+	}
 }
 
 public class PostgresMutableDataset: SQLMutableDataset {
@@ -781,6 +1033,26 @@ public class PostgresConnection: SQLConnection {
 		return String(cString:  PQerrorMessage(self.connection), encoding: String.Encoding.utf8) ?? "(unknown)"
 	} }
 
+	/** Declares a server-side cursor for the query, from which rows can be fetched in batches (see PostgresCursor). */
+	func cursor(_ sql: String) -> Fallible<PostgresCursor> {
+		if self.result != nil && !self.result!.finished {
+			fatalError("Cannot start a query when the previous result is not finished yet")
+		}
+
+		#if DEBUG
+			trace("PostgreSQL Cursor \(sql)")
+		#endif
+
+		return PostgresCursor.declare(self, sql: sql)
+	}
+
+	public func bulkLoader(table: String, schema: String?, columns: [Column], job: Job) -> SQLBulkLoader? {
+		let dialect = self.database.dialect
+		let fields = columns.map { dialect.columnIdentifier($0, table: nil, schema: nil, database: nil) }.joined(separator: ", ")
+		let tableIdentifier = dialect.tableIdentifier(table, schema: schema, database: self.database.database)
+		return PostgresCopyLoader(connection: self, sql: "COPY \(tableIdentifier) (\(fields)) FROM STDIN WITH (FORMAT csv)")
+	}
+
 	func query(_ sql: String) -> Fallible<PostgresResult> {
 		if self.result != nil && !self.result!.finished {
 			fatalError("Cannot start a query when the previous result is not finished yet")
@@ -812,6 +1084,152 @@ public class PostgresConnection: SQLConnection {
 	}
 }
 
+/** Loads rows into a table using COPY ... FROM STDIN, which is much faster than executing INSERT statements. Rows are
+sent in CSV format, so that the server converts values to the types of the target columns like it would for literals in
+an INSERT statement. Each batch is encoded on the calling thread, while the previous batch is being sent on the queue
+of the connection. */
+private final class PostgresCopyLoader: SQLBulkLoader {
+	private let connection: PostgresConnection
+	private let sql: String
+
+	// These are only accessed on the queue of the connection
+	private var started = false
+	private var error: String? = nil
+
+	init(connection: PostgresConnection, sql: String) {
+		self.connection = connection
+		self.sql = sql
+	}
+
+	func append(_ rows: [Tuple], job: Job, callback: @escaping (Fallible<Void>) -> ()) {
+		var data: [UInt8] = []
+		job.time("Encode COPY data", items: rows.count, itemType: "row") {
+			for row in rows {
+				for (index, value) in row.enumerated() {
+					if index > 0 {
+						data.append(PostgresCopyLoader.comma)
+					}
+					PostgresCopyLoader.encode(value, to: &data)
+				}
+				data.append(PostgresCopyLoader.newline)
+			}
+		}
+
+		/* Report back once the previous batch has been sent, so that the next batch can be encoded while this one is
+		being sent (but no more batches pile up). Errors sending this batch are reported for the next one. */
+		self.connection.queue.async {
+			let error = self.error
+			job.async {
+				callback(error == nil ? .success(()) : .failure(error!))
+			}
+		}
+
+		self.connection.queue.async {
+			if self.error != nil {
+				return
+			}
+
+			if !self.started {
+				self.started = true
+				let result = PQexec(self.connection.connection, self.sql)
+				defer { PQclear(result) }
+
+				if PQresultStatus(result).rawValue != PGRES_COPY_IN.rawValue {
+					self.error = self.connection.lastError
+					return
+				}
+			}
+
+			let sent = data.withUnsafeBufferPointer { buffer -> Int32 in
+				return buffer.withMemoryRebound(to: Int8.self) { chars in
+					return PQputCopyData(self.connection.connection, chars.baseAddress, Int32(chars.count))
+				}
+			}
+
+			if sent != 1 {
+				self.error = self.connection.lastError
+			}
+		}
+	}
+
+	func finish(_ job: Job, callback: @escaping (Fallible<Void>) -> ()) {
+		self.connection.queue.async {
+			if self.started {
+				// When sending failed, the copy is aborted (with the error as reason) to return the connection to normal
+				if PQputCopyEnd(self.connection.connection, self.error) == 1 {
+					while let result = PQgetResult(self.connection.connection) {
+						if PQresultStatus(result).rawValue != PGRES_COMMAND_OK.rawValue && self.error == nil {
+							self.error = self.connection.lastError
+						}
+						PQclear(result)
+					}
+				}
+				else if self.error == nil {
+					self.error = self.connection.lastError
+				}
+			}
+
+			let error = self.error
+			job.async {
+				callback(error == nil ? .success(()) : .failure(error!))
+			}
+		}
+	}
+
+	private static let comma = UInt8(ascii: ",")
+	private static let newline = UInt8(ascii: "\n")
+	private static let quote = UInt8(ascii: "\"")
+
+	/** Appends a value as CSV field. Strings are always quoted, as an unquoted empty field denotes NULL. */
+	private static func encode(_ value: Value, to data: inout [UInt8]) {
+		switch value {
+		case .empty, .list(_):
+			// Lists cannot be written as literal either, and are inserted as NULL
+			break
+
+		case .string(let s):
+			data.append(quote)
+			for byte in s.utf8 {
+				data.append(byte)
+				if byte == quote {
+					data.append(quote)
+				}
+			}
+			data.append(quote)
+
+		case .int(let i):
+			data.append(contentsOf: String(i).utf8)
+
+		case .double(let d):
+			if d.isNaN {
+				data.append(contentsOf: "NaN".utf8)
+			}
+			else if d.isInfinite {
+				data.append(contentsOf: (d < 0 ? "-Infinity" : "Infinity").utf8)
+			}
+			else {
+				data.append(contentsOf: String(d).utf8)
+			}
+
+		case .date(let d):
+			data.append(contentsOf: String(d).utf8)
+
+		case .bool(let b):
+			data.append(contentsOf: (b ? "true" : "false").utf8)
+
+		case .invalid:
+			data.append(contentsOf: "NaN".utf8)
+
+		case .blob(let d):
+			// Hex format for bytea
+			data.append(contentsOf: "\\x".utf8)
+			for byte in d {
+				data.append(contentsOf: String(format: "%02hhx", byte).utf8)
+			}
+		}
+	}
+}
+
 /** Represents the result of a PostgreSQL query as a Dataset object. */
 public class PostgresDataset: SQLDataset, PostgresWireDataset {
 	private let database: PostgresDatabase
@@ -844,9 +1262,9 @@ public class PostgresDataset: SQLDataset, PostgresWireDataset {
 		return PostgresStream(data: self)
 	}
 
-	internal func result() -> Fallible<PostgresResult> {
+	internal func cursor() -> Fallible<PostgresCursor> {
 		return database.connect().use {
-			$0.query(self.sql.sqlSelect(nil).sql)
+			$0.cursor(self.sql.sqlSelect(nil).sql)
 		}
 	}
 
@@ -860,20 +1278,50 @@ public class PostgresDataset: SQLDataset, PostgresWireDataset {
 	}
 }
 
-/** PostgresStream provides a stream of records from a PostgreSQL result set. Because SQLite result can only be accessed 
-once sequentially, cloning of this stream requires re-executing the query. */
-private class PostgresResultStream: SequenceStream {
-	init(result: PostgresResult) {
-		super.init(AnySequence<Fallible<Tuple>>(result), columns: result.columns)
+/** Streams the rows of a PostgresCursor. Each call to fetch fetches the next batch of rows from the server; the batch is
+decoded asynchronously. Because a cursor can only be read once sequentially, cloning of this stream requires
+re-executing the query. */
+private class PostgresCursorStream: WarpCore.Stream {
+	private let cursor: PostgresCursor
+	private let sizer = BatchSizer()
+
+	init(cursor: PostgresCursor) {
+		self.cursor = cursor
 	}
 
-	override func clone() -> WarpCore.Stream {
-		fatalError("PostgresResultStream cannot be cloned, because a result cannot be iterated multiple times. Clone PostgresStream instead")
+	func fetch(_ job: Job, consumer: @escaping Sink) {
+		// Server round trips are relatively expensive, so never fetch less than the default fetch size
+		let started = CFAbsoluteTimeGetCurrent()
+		switch self.cursor.fetch(max(PostgresCursor.fetchSize, self.sizer.size)) {
+		case .success(let batch):
+			let status: StreamStatus = batch.isLast ? .finished : .hasMore
+			let fetchDuration = CFAbsoluteTimeGetCurrent() - started
+			job.async {
+				var rows: [Tuple] = []
+				let decodeStarted = CFAbsoluteTimeGetCurrent()
+				job.time("Decode PostgreSQL rows", items: batch.count, itemType: "row") {
+					rows = batch.rows
+				}
+				self.sizer.observe(rows, duration: fetchDuration + CFAbsoluteTimeGetCurrent() - decodeStarted)
+				consumer(.success(rows), status)
+			}
+
+		case .failure(let e):
+			consumer(.failure(e), .finished)
+		}
+	}
+
+	func columns(_ job: Job, callback: @escaping (Fallible<OrderedSet<Column>>) -> ()) {
+		callback(.success(self.cursor.columns))
+	}
+
+	func clone() -> WarpCore.Stream {
+		fatalError("PostgresCursorStream cannot be cloned, because a cursor cannot be iterated multiple times. Clone PostgresStream instead")
 	}
 }
 
 internal protocol PostgresWireDataset: Dataset {
-	func result() -> Fallible<PostgresResult>
+	func cursor() -> Fallible<PostgresCursor>
 }
 
 /** Stream that lazily queries and streams results from a PostgreSQL query. */
@@ -889,9 +1337,9 @@ class PostgresStream: WarpCore.Stream {
 	private func stream() -> WarpCore.Stream {
 		return mutex.locked {
 			if resultStream == nil {
-				switch data.result() {
-				case .success(let rs):
-					resultStream = PostgresResultStream(result: rs)
+				switch data.cursor() {
+				case .success(let cursor):
+					resultStream = PostgresCursorStream(cursor: cursor)
 
 				case .failure(let error):
 					resultStream = ErrorStream(error)
@@ -50,67 +50,85 @@ public class SQLiteResult {
 	/** Run is used to execute statements that do not return data (e.g. UPDATE, INSERT, DELETE, etc.). It can optionally
 	be fed with parameters which will be bound before query execution. */
 	public func run(_ parameters: [Value]? = nil) -> Fallible<Void> {
-		// If there are parameters, bind them
 		return self.db.mutex.locked {
-			if let p = parameters {
-				var i = 0
-				for value in p {
-					var result = SQLITE_OK
-					switch value {
-					case .string(let s):
-						// This, apparently, is super-slow, because Swift needs to convert its string to UTF-8.
-						result = sqlite3_bind_text(self.resultSet, CInt(i+1), s, -1, sqlite3_transient_destructor)
+			return self.step(parameters)
+		}
+	}
 
-					case .int(let x):
-						result = sqlite3_bind_int64(self.resultSet, CInt(i+1), sqlite3_int64(x))
+	/** Runs the statement once for each set of parameters, while holding the connection lock only once. This is used to
+	insert batches of rows through a single prepared INSERT statement. Execution stops at the first error. */
+	public func run(batch: [[Value]]) -> Fallible<Void> {
+		return self.db.mutex.locked {
+			for parameters in batch {
+				if case .failure(let m) = self.step(parameters) {
+					return .failure(m)
+				}
+			}
+			return .success(())
+		}
+	}
 
-					case .double(let d):
-						result = sqlite3_bind_double(self.resultSet, CInt(i+1), d)
+	/** Binds the parameters (if any), executes the statement and resets it. Must be called while holding the lock. */
+	private func step(_ parameters: [Value]?) -> Fallible<Void> {
+		// If there are parameters, bind them
+		if let p = parameters {
+			var i = 0
+			for value in p {
+				var result = SQLITE_OK
+				switch value {
+				case .string(let s):
+					// This, apparently, is super-slow, because Swift needs to convert its string to UTF-8.
+					result = sqlite3_bind_text(self.resultSet, CInt(i+1), s, -1, sqlite3_transient_destructor)
 
-					case .date(let d):
-						result = sqlite3_bind_double(self.resultSet, CInt(i+1), d)
+				case .int(let x):
+					result = sqlite3_bind_int64(self.resultSet, CInt(i+1), sqlite3_int64(x))
 
-					case .bool(let b):
-						result = sqlite3_bind_int(self.resultSet, CInt(i+1), b ? 1 : 0)
+				case .double(let d):
+					result = sqlite3_bind_double(self.resultSet, CInt(i+1), d)
 
-					case .list(_):
-						return .failure("SQLite does not support lists")
+				case .date(let d):
+					result = sqlite3_bind_double(self.resultSet, CInt(i+1), d)
 
-					case .invalid:
-						result = sqlite3_bind_null(self.resultSet, CInt(i+1))
+				case .bool(let b):
+					result = sqlite3_bind_int(self.resultSet, CInt(i+1), b ? 1 : 0)
 
-					case .empty:
-						result = sqlite3_bind_null(self.resultSet, CInt(i+1))
+				case .list(_):
+					return .failure("SQLite does not support lists")
 
-					case .blob(let d):
-						d.withUnsafeBytes { bytes in
-							result = sqlite3_bind_blob64(self.resultSet, CInt(i+1), bytes, sqlite3_uint64(d.count), sqlite3_transient_destructor)
-						}
-					}
+				case .invalid:
+					result = sqlite3_bind_null(self.resultSet, CInt(i+1))
+
+				case .empty:
+					result = sqlite3_bind_null(self.resultSet, CInt(i+1))
 
-					if result != SQLITE_OK {
-						return .failure("SQLite error on parameter bind: \(self.db.lastError)")
+				case .blob(let d):
+					d.withUnsafeBytes { bytes in
+						result = sqlite3_bind_blob64(self.resultSet, CInt(i+1), bytes, sqlite3_uint64(d.count), sqlite3_transient_destructor)
 					}
+				}
 
-					i += 1
+				if result != SQLITE_OK {
+					return .failure("SQLite error on parameter bind: \(self.db.lastError)")
 				}
-			}
 
-			let result = sqlite3_step(self.resultSet)
-			if result != SQLITE_ROW && result != SQLITE_DONE {
-				return .failure("SQLite error running statement: \(self.db.lastError)")
+				i += 1
 			}
+		}
 
-			if sqlite3_clear_bindings(self.resultSet) != SQLITE_OK {
-				return .failure("SQLite: failed to clear parameter bindings: \(self.db.lastError)")
-			}
+		let result = sqlite3_step(self.resultSet)
+		if result != SQLITE_ROW && result != SQLITE_DONE {
+			return .failure("SQLite error running statement: \(self.db.lastError)")
+		}
 
-			if sqlite3_reset(self.resultSet) != SQLITE_OK {
-				return .failure("SQLite: could not reset statement: \(self.db.lastError)")
-			}
+		if sqlite3_clear_bindings(self.resultSet) != SQLITE_OK {
+			return .failure("SQLite: failed to clear parameter bindings: \(self.db.lastError)")
+		}
 
-			return .success(())
+		if sqlite3_reset(self.resultSet) != SQLITE_OK {
+			return .failure("SQLite: could not reset statement: \(self.db.lastError)")
 		}
+
+		return .success(())
 	}
 
 	public var columnCount: Int {
@@ -149,83 +167,187 @@ private class SQLiteResultSequence: Sequence {
 private class SQLiteResultGenerator: IteratorProtocol {
 	typealias Element = Fallible<Tuple>
 	let result: SQLiteResult
-	var lastStatus: Int32 = SQLITE_OK
+	private let decoder: SQLiteRowDecoder
 
 	init(_ result: SQLiteResult) {
 		self.result = result
+		self.decoder = SQLiteRowDecoder(result)
 	}
 
 	func next() -> Element? {
-		if lastStatus == SQLITE_DONE {
-			return nil
+		return self.result.db.mutex.locked {
+			return self.decoder.next()
 		}
+	}
+}
+
+/** Steps through the rows of a statement and decodes them. How INTEGER values are decoded depends on the declared type
+of the column (booleans are stored as integers in columns declared as BOOL). The declared types are looked up once when
+the decoder is created, rather than for each value. */
+private final class SQLiteRowDecoder {
+	private enum IntegerKind {
+		case integer
+		case boolean
+		case undeclared
+	}
 
-		var item: Element? = nil
+	private let result: SQLiteResult
+	private let integerKinds: [IntegerKind]
+	private var error: String? = nil
+	private(set) var isDone = false
 
-		if case .failure(let m) = self.result.db.perform({ () -> Int32 in
-			self.lastStatus = sqlite3_step(self.result.resultSet)
-			if self.lastStatus == SQLITE_ROW {
-				item = .success(self.row)
-				return SQLITE_OK
+	init(_ result: SQLiteResult) {
+		self.result = result
+		self.integerKinds = result.db.mutex.locked {
+			let count = sqlite3_column_count(result.resultSet)
+			return (0..<count).map { idx -> IntegerKind in
+				if let ptr = sqlite3_column_decltype(result.resultSet, idx) {
+					return String(cString: ptr).hasPrefix("BOOL") ? .boolean : .integer
+				}
+				return .undeclared
 			}
-			else if self.lastStatus == SQLITE_DONE {
-				return SQLITE_OK
+		}
+	}
+
+	/** Reads at most `count` rows while holding the connection lock once. Fewer rows are returned when the statement has
+	no more rows, after which isDone is true. */
+	func rows(_ count: Int) -> Fallible<[Tuple]> {
+		return self.result.db.mutex.locked {
+			var rows: [Tuple] = []
+			rows.reserveCapacity(count)
+
+			while rows.count < count, let next = self.next() {
+				switch next {
+				case .success(let row):
+					rows.append(row)
+
+				case .failure(let e):
+					return .failure(e)
+				}
 			}
-			else {
-				item = .failure(self.result.db.lastError)
-				return self.lastStatus
+			return .success(rows)
+		}
+	}
+
+	/** Steps to the next row and decodes it. Must be called while holding the connection lock. */
+	func next() -> Fallible<Tuple>? {
+		if let e = self.error {
+			return .failure(e)
+		}
+
+		if self.isDone {
+			return nil
+		}
+
+		let status = sqlite3_step(self.result.resultSet)
+		if status == SQLITE_ROW {
+			return .success(self.row())
+		}
+
+		self.isDone = true
+		if status == SQLITE_DONE {
+			return nil
+		}
+
+		self.error = "SQLite error \(status): \(self.result.db.lastError)"
+		return .failure(self.error!)
+	}
+
+	private func row() -> Tuple {
+		let resultSet = self.result.resultSet
+		var row: Tuple = []
+		row.reserveCapacity(self.integerKinds.count)
+
+		for (idx, integerKind) in self.integerKinds.enumerated() {
+			let column = Int32(idx)
+			switch sqlite3_column_type(resultSet, column) {
+			case SQLITE_FLOAT:
+				row.append(Value(sqlite3_column_double(resultSet, column)))
+
+			case SQLITE_NULL:
+				row.append(Value.empty)
+
+			case SQLITE_INTEGER:
+				let intValue = Int(sqlite3_column_int64(resultSet, column))
+				switch integerKind {
+				case .integer: row.append(Value(intValue))
+				case .boolean: row.append(Value(intValue != 0))
+				case .undeclared: row.append(Value.invalid)
+				}
+
+			case SQLITE_TEXT:
+				if let ptr = sqlite3_column_text(resultSet, column) {
+					row.append(Value(String(cString: ptr)))
+				}
+				else {
+					row.append(Value.invalid)
+				}
+
+			case SQLITE_BLOB:
+				if let b = sqlite3_column_blob(resultSet, column) {
+					let sz = sqlite3_column_bytes(resultSet, column)
+					row.append(Value.blob(Data(bytes: b, count: Int(sz))))
+				}
+				else {
+					row.append(Value.empty)
+				}
+
+			default:
+				row.append(Value.invalid)
 			}
-		}) {
-			return .failure(m)
 		}
 
-		return item
+		return row
 	}
+}
 
-	var row: Tuple {
-		return self.result.db.mutex.locked {
-			return (0..<result.columns.count).map { idx in
-				switch sqlite3_column_type(self.result.resultSet, Int32(idx)) {
-				case SQLITE_FLOAT:
-					return Value(sqlite3_column_double(self.result.resultSet, Int32(idx)))
-
-				case SQLITE_NULL:
-					return Value.empty
-
-				case SQLITE_INTEGER:
-					// Booleans are represented as integers, but boolean columns are declared as BOOL columns
-					let intValue = Int(sqlite3_column_int64(self.result.resultSet, Int32(idx)))
-
-					if let ptr = sqlite3_column_decltype(self.result.resultSet, Int32(idx)) {
-						let type = String(cString: ptr)
-						if type.hasPrefix("BOOL") {
-							return Value(intValue != 0)
-						}
-						return Value(intValue)
-					}
-					return Value.invalid
+/** Streams the rows of a statement in batches. Each batch is decoded on the queue of the stream while holding the lock
+of the connection once (see SQLiteRowDecoder). */
+private final class SQLiteResultStream: WarpCore.Stream {
+	private let result: SQLiteResult
+	private let decoder: SQLiteRowDecoder
+	private let resultColumns: OrderedSet<Column>
+	private let queue = DispatchQueue(label: "nl.pixelspark.Warp.SQLiteResultStream", attributes: [])
+	private let sizer = BatchSizer()
 
-				case SQLITE_TEXT:
-					if let ptr = sqlite3_column_text(self.result.resultSet, Int32(idx)) {
-						let string = String(cString: ptr)
-						return Value(string)
-					}
-					return Value.invalid
+	init(result: SQLiteResult) {
+		self.result = result
+		self.resultColumns = result.columns
+		self.decoder = SQLiteRowDecoder(result)
+	}
 
-				case SQLITE_BLOB:
-					if let b = sqlite3_column_blob(self.result.resultSet, Int32(idx)) {
-						let sz = sqlite3_column_bytes(self.result.resultSet, Int32(idx))
-						let data = Data(bytes: b, count: Int(sz))
-						return Value.blob(data)
-					}
-					return Value.empty
+	func fetch(_ job: Job, consumer: @escaping Sink) {
+		self.queue.async {
+			var rows: Fallible<[Tuple]> = .success([])
+			let batchSize = self.sizer.size
+			let started = CFAbsoluteTimeGetCurrent()
+			job.time("SQLite read", items: batchSize, itemType: "rows") {
+				rows = self.decoder.rows(batchSize)
+			}
+			if case .success(let r) = rows {
+				self.sizer.observe(r, duration: CFAbsoluteTimeGetCurrent() - started)
+			}
+			let status: StreamStatus = self.decoder.isDone ? .finished : .hasMore
 
-				default:
-					return Value.invalid
+			job.async {
+				switch rows {
+				case .success(let r):
+					consumer(.success(r), status)
+
+				case .failure(let e):
+					consumer(.failure(e), .finished)
 				}
 			}
 		}
 	}
+
+	func columns(_ job: Job, callback: @escaping (Fallible<OrderedSet<Column>>) -> ()) {
+		callback(.success(self.resultColumns))
+	}
+
+	func clone() -> WarpCore.Stream {
+		fatalError("SQLiteResultStream cannot be cloned, because a result cannot be iterated multiple times. Clone SQLiteStream instead")
+	}
 }
 
 public  struct SQLiteForeignKey {
@@ -271,6 +393,37 @@ open class SQLiteConnection: NSObject, SQLConnection {
 				SQLiteCreateFunction(self.db, udfBinaryName, 3, true, SQLiteConnection.sqliteUDFBinary)
 			}
 		}
+
+		/* Each deterministic Function and each Binary is also registered as a function of its own (see nativeUDFName),
+		which the dialect calls instead of WARP_FUNCTION/WARP_BINARY. The implementation is captured by the callback, so
+		that calls do not need to look up the function by its name each time. */
+		for function in Function.allFunctions where function.isDeterministic {
+			SQLiteCreateFunction(self.db, SQLiteConnection.nativeUDFName(function), -1, true) { context, argc, values in
+				var args: [Value] = []
+				args.reserveCapacity(Int(argc))
+				for i in 0..<Int(argc) {
+					args.append(SQLiteConnection.sqliteValueToValue(values![i]!))
+				}
+				SQLiteConnection.sqliteResult(context!, result: function.apply(args))
+			}
+		}
+
+		for binary in Binary.allBinaries {
+			SQLiteCreateFunction(self.db, SQLiteConnection.nativeUDFName(binary), 2, true) { context, argc, values in
+				let first = SQLiteConnection.sqliteValueToValue(values![0]!)
+				let second = SQLiteConnection.sqliteValueToValue(values![1]!)
+				SQLiteConnection.sqliteResult(context!, result: binary.apply(first, second))
+			}
+		}
+	}
+
+	/** The name under which the native implementation of a function is registered in each connection. */
+	fileprivate static func nativeUDFName(_ function: Function) -> String {
+		return "WARP_F_\(function.rawValue)"
+	}
+
+	fileprivate static func nativeUDFName(_ binary: Binary) -> String {
+		return "WARP_B_\(binary.rawValue)"
 	}
 
 	deinit {
@@ -308,72 +461,71 @@ open class SQLiteConnection: NSObject, SQLConnection {
 		}
 	}
 
+	/* The functions below convert values passed to and returned from user-defined functions. They are called by SQLite
+	while a statement is being stepped, i.e. while the lock of the connection that runs the statement is already held, and
+	only touch the value or context of that call. Therefore they do not need to take a lock of their own. */
 	private static func sqliteValueToValue(_ value: OpaquePointer) -> Value {
-		return self.sharedMutex.locked {
-			switch sqlite3_value_type(value) {
-			case SQLITE_NULL:
-				return Value.empty
+		switch sqlite3_value_type(value) {
+		case SQLITE_NULL:
+			return Value.empty
 
-			case SQLITE_FLOAT:
-				return Value.double(sqlite3_value_double(value))
+		case SQLITE_FLOAT:
+			return Value.double(sqlite3_value_double(value))
 
-			case SQLITE_TEXT:
-				let ptr = sqlite3_value_text(value)
-				if ptr != nil {
-					return Value.string(String(cString: ptr!))
-				}
-				return Value.invalid
+		case SQLITE_TEXT:
+			let ptr = sqlite3_value_text(value)
+			if ptr != nil {
+				return Value.string(String(cString: ptr!))
+			}
+			return Value.invalid
 
-			case SQLITE_INTEGER:
-				return Value.int(Int(sqlite3_value_int64(value)))
+		case SQLITE_INTEGER:
+			return Value.int(Int(sqlite3_value_int64(value)))
 
-			case SQLITE_BLOB:
-				if let b = sqlite3_value_blob(value) {
-					let sz = sqlite3_value_bytes(value)
-					let data = Data(bytes: b, count: Int(sz))
-					return Value.blob(data)
-				}
-				else {
-					return Value.empty
-				}
-
-			default:
-				return Value.invalid
+		case SQLITE_BLOB:
+			if let b = sqlite3_value_blob(value) {
+				let sz = sqlite3_value_bytes(value)
+				let data = Data(bytes: b, count: Int(sz))
+				return Value.blob(data)
+			}
+			else {
+				return Value.empty
 			}
+
+		default:
+			return Value.invalid
 		}
 	}
 
 	private static func sqliteResult(_ context: OpaquePointer, result: Value) {
-		return self.sharedMutex.locked {
-			switch result {
-			case .invalid:
-				sqlite3_result_null(context)
+		switch result {
+		case .invalid:
+			sqlite3_result_null(context)
 
-			case .empty:
-				sqlite3_result_null(context)
+		case .empty:
+			sqlite3_result_null(context)
 
-			case .string(let s):
-				sqlite3_result_text(context, s, -1, sqlite3_transient_destructor)
+		case .string(let s):
+			sqlite3_result_text(context, s, -1, sqlite3_transient_destructor)
 
-			case .int(let s):
-				sqlite3_result_int64(context, Int64(s))
+		case .int(let s):
+			sqlite3_result_int64(context, Int64(s))
 
-			case .double(let d):
-				sqlite3_result_double(context, d)
+		case .double(let d):
+			sqlite3_result_double(context, d)
 
-			case .date(let d):
-				sqlite3_result_double(context, d)
+		case .date(let d):
+			sqlite3_result_double(context, d)
 
-			case .bool(let b):
-				sqlite3_result_int64(context, b ? 1 : 0)
+		case .bool(let b):
+			sqlite3_result_int64(context, b ? 1 : 0)
 
-			case .list(_):
-				fatalError("SQLite does not support lists")
+		case .list(_):
+			fatalError("SQLite does not support lists")
 
-			case .blob(let d):
-				d.withUnsafeBytes { bytes in
-					sqlite3_result_blob64(context, bytes, sqlite_uint64(d.count), sqlite3_transient_destructor)
-				}
+		case .blob(let d):
+			d.withUnsafeBytes { bytes in
+				sqlite3_result_blob64(context, bytes, sqlite_uint64(d.count), sqlite3_transient_destructor)
 			}
 		}
 	}
@@ -430,6 +582,22 @@ open class SQLiteConnection: NSObject, SQLConnection {
 		return callback(.success(()))
 	}
 
+	public func bulkLoader(table: String, schema: String?, columns: [Column], job: Job) -> SQLBulkLoader? {
+		let fields = columns.map { self.dialect.columnIdentifier($0, table: nil, schema: nil, database: nil) }.joined(separator: ", ")
+		let parameters = columns.map { _ in "?" }.joined(separator: ",")
+		let sql = "INSERT INTO \(self.dialect.tableIdentifier(table, schema: nil, database: nil)) (\(fields)) VALUES (\(parameters))"
+
+		// When the statement cannot be prepared, rows are inserted using SQL statements instead
+		switch self.query(sql) {
+		case .success(let statement):
+			return SQLiteInsertLoader(connection: self, statement: statement)
+
+		case .failure(let e):
+			trace("SQLite: cannot prepare bulk insert statement: \(e)")
+			return nil
+		}
+	}
+
 	public var tableNames: Fallible<[String]> {
 		let names = query("SELECT name FROM sqlite_master WHERE type='table' ORDER BY name ASC")
 
@@ -476,6 +644,109 @@ open class SQLiteConnection: NSObject, SQLConnection {
 	}
 }
 
+/** Inserts rows through a single prepared INSERT statement, to which the values of each row are bound. Rows are inserted
+in large transactions (SQLite otherwise commits each statement separately, which requires syncing the file each time).
+A savepoint is used rather than BEGIN, so that rows can also be loaded into a connection that is already in a
+transaction (in which case they are committed along with that transaction). */
+private final class SQLiteInsertLoader: SQLBulkLoader {
+	/** The number of rows after which the transaction is committed and a new one is started. */
+	static let transactionSize = 100_000
+
+	private let connection: SQLiteConnection
+	private let statement: SQLiteResult
+
+	// These are only accessed while holding the connection lock
+	private var rowsInTransaction = 0
+	private var inTransaction = false
+	private var error: String? = nil
+
+	init(connection: SQLiteConnection, statement: SQLiteResult) {
+		self.connection = connection
+		self.statement = statement
+	}
+
+	func append(_ rows: [Tuple], job: Job, callback: @escaping (Fallible<Void>) -> ()) {
+		let result = self.connection.mutex.locked { () -> Fallible<Void> in
+			if let e = self.error {
+				return .failure(e)
+			}
+
+			if !self.inTransaction {
+				if case .failure(let e) = self.execute("SAVEPOINT warp_load") {
+					self.error = e
+					return .failure(e)
+				}
+				self.inTransaction = true
+			}
+
+			var result: Fallible<Void> = .success(())
+			job.time("SQLite insert", items: rows.count, itemType: "row") {
+				result = self.statement.run(batch: rows)
+			}
+
+			if case .failure(let e) = result {
+				self.error = e
+				self.rollback()
+				return .failure(e)
+			}
+
+			self.rowsInTransaction += rows.count
+			if self.rowsInTransaction >= SQLiteInsertLoader.transactionSize {
+				return self.commit()
+			}
+			return .success(())
+		}
+
+		callback(result)
+	}
+
+	func finish(_ job: Job, callback: @escaping (Fallible<Void>) -> ()) {
+		let result = self.connection.mutex.locked { () -> Fallible<Void> in
+			if let e = self.error {
+				return .failure(e)
+			}
+			return self.commit()
+		}
+
+		callback(result)
+	}
+
+	private func commit() -> Fallible<Void> {
+		if self.inTransaction {
+			self.inTransaction = false
+			self.rowsInTransaction = 0
+			if case .failure(let e) = self.execute("RELEASE warp_load") {
+				self.error = e
+				return .failure(e)
+			}
+		}
+		return .success(())
+	}
+
+	private func rollback() {
+		if self.inTransaction {
+			self.inTransaction = false
+			self.rowsInTransaction = 0
+			// Rolling back to a savepoint does not remove it
+			for sql in ["ROLLBACK TO warp_load", "RELEASE warp_load"] {
+				if case .failure(let e) = self.execute(sql) {
+					trace("SQLite: rollback of bulk insert failed: \(e)")
+				}
+			}
+		}
+	}
+
+	private func execute(_ sql: String) -> Fallible<Void> {
+		switch self.connection.query(sql) {
+		case .success(let s):
+			return s.run()
+
+		case .failure(let e):
+			return .failure(e)
+		}
+	}
+}
+
 private func ==(lhs: SQLiteConnection, rhs: SQLiteConnection) -> Bool {
 	return lhs.db == rhs.db || (lhs.url == rhs.url && lhs.url != nil && rhs.url != nil)
 }
@@ -507,7 +778,7 @@ private class SQLiteDialect: StandardSQLDialect {
 		/* If a binary expression cannot be represented in 'normal' SQL, we can always use the special UDF function to
 		call into the native implementation */
 		if result == nil {
-			return "\(SQLiteConnection.sqliteUDFBinaryName)('\(type.rawValue)',\(second), \(first))"
+			return "\(SQLiteConnection.nativeUDFName(type))(\(second), \(first))"
 		}
 		return result
 	}
@@ -529,6 +800,9 @@ private class SQLiteDialect: StandardSQLDialect {
 		/* If a function cannot be implemented in SQL, we should fall back to our special UDF function to call into the
 		native implementation */
 		let value = args.joined(separator: ", ")
+		if type.isDeterministic {
+			return "\(SQLiteConnection.nativeUDFName(type))(\(value))"
+		}
 		return "\(SQLiteConnection.sqliteUDFFunctionName)('\(type.rawValue)',\(value))"
 	}
 
@@ -612,7 +886,7 @@ public class SQLiteStream: WarpCore.Stream {
 			if resultStream == nil {
 				switch data.result() {
 				case .success(let result):
-					resultStream = SequenceStream(AnySequence<Fallible<Tuple>>(result.sequence()), columns: result.columns)
+					resultStream = SQLiteResultStream(result: result)
 
 				case .failure(let error):
 					resultStream = ErrorStream(error)
@@ -17,10 +17,18 @@ import Foundation
 
 /** A Reducer is a function that takes multiple arguments, but can receive them in batches in order to calculate the
 result, and does not have to store all values. The 'average'  function for instance can maintain a sum of values received
-as well as a count, and determine the result at any point by dividing the sum by the count. */
-// TODO: implement hierarchical reducers (e.g. so that two SumReducers can be summed, and the reduction can be done in parallel)
+as well as a count, and determine the result at any point by dividing the sum by the count.
+
+Reducers are hierarchical: two reducers that have each received a part of the values can be merged into a single reducer
+that has the same result as a reducer that received all values. This allows reduction to be done in parallel. */
 public protocol Reducer {
 	mutating func add(_ values: [Value])
+
+	/** Merge the state of another reducer into this reducer. The other reducer must be of the same type (i.e. it must
+	have been obtained from the same function) and should be considered to have received its values after the values
+	this reducer has received. */
+	mutating func merge(_ other: Reducer)
+
 	var result: Value { get }
 }
 
@@ -125,6 +133,12 @@ private struct MinimumCellReducer: Reducer {
 		self.reducer.add(values)
 	}
 
+	public mutating func merge(_ other: Reducer) {
+		let o = other as! MinimumCellReducer
+		self.count += o.count
+		self.reducer.merge(o.reducer)
+	}
+
 	public var result: Value {
 		if self.count >= self.minimum {
 			return self.reducer.result
@@ -0,0 +1,331 @@
+/* Copyright (c) 2014-2016 Pixelspark, Tommy van der Vorst
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+import Foundation
+
+/** A compiled batch expression (see Expression.compileBatch) calculates the result of an expression for each row in a
+batch of rows at once. The rows must have values in the order of the columns the expression was compiled for. When input
+values are given, there must be exactly one for each row. The result contains one value for each row. */
+public typealias CompiledBatchExpression = (_ rows: [Tuple], _ inputValues: [Value]?) -> [Value]
+
+/** The intermediate result of evaluating an expression over a batch of rows: one value for each row in the batch.
+Whenever possible, values are kept in typed arrays, so that operators can process them in tight loops. Every case
+represents exactly the same values as the array of Value returned by `values`. */
+internal enum BatchColumn {
+	/** The same value for every row in the batch. */
+	case constant(Value, count: Int)
+
+	/** A column where each value is Value.int */
+	case ints([Int])
+
+	/** A column where each value is Value.double */
+	case doubles([Double])
+
+	/** A column where each value is Value.bool */
+	case bools([Bool])
+
+	/** A column of arbitrary values */
+	case values([Value])
+
+	/** Creates a batch column from values, using a typed representation when all values are of the same type. */
+	init(_ values: [Value]) {
+		guard let first = values.first else {
+			self = .values([])
+			return
+		}
+
+		switch first {
+		case .int:
+			var ints: [Int] = []
+			ints.reserveCapacity(values.count)
+			for v in values {
+				guard case .int(let i) = v else {
+					self = .values(values)
+					return
+				}
+				ints.append(i)
+			}
+			self = .ints(ints)
+
+		case .double:
+			var doubles: [Double] = []
+			doubles.reserveCapacity(values.count)
+			for v in values {
+				guard case .double(let d) = v else {
+					self = .values(values)
+					return
+				}
+				doubles.append(d)
+			}
+			self = .doubles(doubles)
+
+		case .bool:
+			var bools: [Bool] = []
+			bools.reserveCapacity(values.count)
+			for v in values {
+				guard case .bool(let b) = v else {
+					self = .values(values)
+					return
+				}
+				bools.append(b)
+			}
+			self = .bools(bools)
+
+		default:
+			self = .values(values)
+		}
+	}
+
+	var count: Int {
+		switch self {
+		case .constant(_, count: let c): return c
+		case .ints(let v): return v.count
+		case .doubles(let v): return v.count
+		case .bools(let v): return v.count
+		case .values(let v): return v.count
+		}
+	}
+
+	subscript(index: Int) -> Value {
+		switch self {
+		case .constant(let v, count: _): return v
+		case .ints(let v): return .int(v[index])
+		case .doubles(let v): return .double(v[index])
+		case .bools(let v): return .bool(v[index])
+		case .values(let v): return v[index]
+		}
+	}
+
+	var values: [Value] {
+		switch self {
+		case .constant(let v, count: let c): return Array(repeating: v, count: c)
+		case .ints(let v): return v.map { Value.int($0) }
+		case .doubles(let v): return v.map { Value.double($0) }
+		case .bools(let v): return v.map { Value.bool($0) }
+		case .values(let v): return v
+		}
+	}
+
+	var constantValue: Value? {
+		if case .constant(let v, count: _) = self {
+			return v
+		}
+		return nil
+	}
+
+	/** The values in this column as integers, if all values are Value.int. */
+	var ints: [Int]? {
+		switch self {
+		case .ints(let v): return v
+		case .constant(.int(let i), count: let c): return Array(repeating: i, count: c)
+		default: return nil
+		}
+	}
+
+	/** The values in this column as doubles, if all values are either Value.int or Value.double. */
+	var doubles: [Double]? {
+		switch self {
+		case .doubles(let v): return v
+		case .ints(let v): return v.map { Double($0) }
+		case .constant(.int(let i), count: let c): return Array(repeating: Double(i), count: c)
+		case .constant(.double(let d), count: let c): return Array(repeating: d, count: c)
+		default: return nil
+		}
+	}
+}
+
+/** A source of rows for batch evaluation. Sources provide values column by column, which allows sources that store
+their data in columns (i.e. ColumnarRaster) to provide typed values without first boxing them in rows. */
+internal protocol BatchSource {
+	/** The number of rows in this batch */
+	var count: Int { get }
+
+	/** The values in the column at the indicated index, or nil if the column does not exist. */
+	func column(_ index: Int) -> BatchColumn
+
+	/** The values of the row at the indicated index. */
+	func tuple(_ index: Int) -> Tuple
+}
+
+/** Batch source that reads from an array of rows. */
+internal struct TupleBatch: BatchSource {
+	let rows: [Tuple]
+
+	var count: Int {
+		return self.rows.count
+	}
+
+	func column(_ index: Int) -> BatchColumn {
+		return BatchColumn(self.rows.map { index < $0.count ? $0[index] : Value.invalid })
+	}
+
+	func tuple(_ index: Int) -> Tuple {
+		return self.rows[index]
+	}
+}
+
+/** Evaluates an expression over a batch of rows (see Expression.batchEvaluator). */
+internal typealias BatchEvaluator = (_ source: BatchSource, _ inputValues: [Value]?) -> BatchColumn
+
+extension Binary {
+	/** Applies this operator to each pair of values in the two columns (which must be of equal length). Arithmetic and
+	comparisons on numeric columns, as well as searching for a constant string, are performed in typed loops; all other
+	operators are applied value by value. The result is equal to calling apply(left[i], right[i]) for each row. */
+	internal func apply(batch left: BatchColumn, _ right: BatchColumn) -> BatchColumn {
+		let count = left.count
+		assert(count == right.count, "batch columns should be of equal length")
+
+		if let l = left.constantValue, let r = right.constantValue {
+			return .constant(self.apply(l, r), count: count)
+		}
+
+		switch self {
+		case .addition, .subtraction, .multiplication, .power, .division, .modulus:
+			if let l = left.doubles, let r = right.doubles {
+				var result = [Double](repeating: 0.0, count: count)
+				switch self {
+				case .addition: for i in 0..<count { result[i] = l[i] + r[i] }
+				case .subtraction: for i in 0..<count { result[i] = l[i] - r[i] }
+				case .multiplication: for i in 0..<count { result[i] = l[i] * r[i] }
+				case .power: for i in 0..<count { result[i] = pow(l[i], r[i]) }
+				case .division: for i in 0..<count { result[i] = l[i] / r[i] }
+				case .modulus: for i in 0..<count { result[i] = l[i].truncatingRemainder(dividingBy: r[i]) }
+				default: fatalError("unreachable")
+				}
+
+				if self == .division || self == .modulus {
+					// These return Value.invalid for NaN or infinite results (i.e. division by zero)
+					return .values(result.map { Value($0) })
+				}
+				return .doubles(result)
+			}
+
+		case .greater, .lesser, .greaterEqual, .lesserEqual, .equal, .notEqual:
+			if let l = left.ints, let r = right.ints {
+				return .bools(Binary.compare(l, r, count: count, self))
+			}
+			else if let l = left.doubles, let r = right.doubles {
+				return .bools(Binary.compare(l, r, count: count, self))
+			}
+
+		case .containsString, .containsStringStrict:
+			if let needle = right.constantValue?.stringValue {
+				let options: NSString.CompareOptions = (self == .containsString) ? .caseInsensitive : []
+				var result = [Value](repeating: Value.invalid, count: count)
+				for i in 0..<count {
+					if let s = left[i].stringValue {
+						result[i] = .bool(s.range(of: needle, options: options, range: nil, locale: nil) != nil)
+					}
+				}
+				return .values(result)
+			}
+
+		default:
+			break
+		}
+
+		return .values((0..<count).map { self.apply(left[$0], right[$0]) })
+	}
+
+	private static func compare<T: Comparable>(_ l: [T], _ r: [T], count: Int, _ type: Binary) -> [Bool] {
+		var result = [Bool](repeating: false, count: count)
+		switch type {
+		case .greater: for i in 0..<count { result[i] = l[i] > r[i] }
+		case .lesser: for i in 0..<count { result[i] = l[i] < r[i] }
+		case .greaterEqual: for i in 0..<count { result[i] = l[i] >= r[i] }
+		case .lesserEqual: for i in 0..<count { result[i] = l[i] <= r[i] }
+		case .equal: for i in 0..<count { result[i] = l[i] == r[i] }
+		case .notEqual: for i in 0..<count { result[i] = l[i] != r[i] }
+		default: fatalError("not a comparison operator")
+		}
+		return result
+	}
+}
+
+extension Function {
+	/** Applies this function to each row of argument values (arguments[n][i] is the n'th argument for row i). Common
+	string functions are evaluated in a single loop over the batch; other functions are applied row by row. The result
+	is equal to calling apply() for each row. */
+	internal func apply(batch arguments: [BatchColumn], count: Int) -> BatchColumn {
+		if !arity.valid(arguments.count) {
+			return .constant(Value.invalid, count: count)
+		}
+
+		// Deterministic functions of constant arguments only need to be calculated once
+		if self.isDeterministic && arguments.count > 0 && !arguments.contains(where: { $0.constantValue == nil }) {
+			return .constant(self.apply(arguments.map { $0.constantValue! }), count: count)
+		}
+
+		switch self {
+		case .uppercase, .lowercase:
+			let source = arguments[0]
+			var result = [Value](repeating: Value.invalid, count: count)
+			for i in 0..<count {
+				if let s = source[i].stringValue {
+					result[i] = Value(self == .uppercase ? s.uppercased() : s.lowercased())
+				}
+			}
+			return .values(result)
+
+		case .length:
+			let source = arguments[0]
+			var result = [Value](repeating: Value.invalid, count: count)
+			for i in 0..<count {
+				if let s = source[i].stringValue {
+					result[i] = .int(s.count)
+				}
+			}
+			return BatchColumn(result)
+
+		case .left, .right:
+			if let n = arguments[1].constantValue?.intValue, (self == .left ? n > 0 : n >= 0) {
+				let source = arguments[0]
+				var result = [Value](repeating: Value.invalid, count: count)
+				for i in 0..<count {
+					if let s = source[i].stringValue, s.count >= n {
+						result[i] = Value(String(self == .left ? s.prefix(n) : s.suffix(n)))
+					}
+				}
+				return .values(result)
+			}
+
+		case .concat:
+			var result = [Value](repeating: Value.invalid, count: count)
+			rows: for i in 0..<count {
+				var s = ""
+				for argument in arguments {
+					let v = argument[i]
+					if !v.isValid {
+						continue rows
+					}
+					s += v.stringValue ?? ""
+				}
+				result[i] = .string(s)
+			}
+			return .values(result)
+
+		default:
+			break
+		}
+
+		var args = [Value](repeating: Value.invalid, count: arguments.count)
+		return .values((0..<count).map { i -> Value in
+			for n in 0..<arguments.count {
+				args[n] = arguments[n][i]
+			}
+			return self.apply(args)
+		})
+	}
+}
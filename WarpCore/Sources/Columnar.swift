@@ -0,0 +1,719 @@
+/* Copyright (c) 2014-2016 Pixelspark, Tommy van der Vorst
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+import Foundation
+
+/** A compact bit set that records, for each cell in a typed column, whether the cell is empty (Value.empty). Typed
+column buffers store a placeholder in their value array for empty cells; the bitmap tells them apart. */
+public struct NullBitmap {
+	private var words: [UInt64] = []
+	public private(set) var count: Int = 0
+
+	public init() {
+	}
+
+	public init(repeating isNull: Bool, count: Int) {
+		self.words = Array(repeating: isNull ? UInt64.max : 0, count: (count + 63) / 64)
+		self.count = count
+	}
+
+	public mutating func append(_ isNull: Bool) {
+		let bit = self.count & 63
+		if bit == 0 {
+			self.words.append(0)
+		}
+
+		if isNull {
+			self.words[self.words.count - 1] |= (UInt64(1) << UInt64(bit))
+		}
+		self.count += 1
+	}
+
+	public subscript(index: Int) -> Bool {
+		return (self.words[index >> 6] & (UInt64(1) << UInt64(index & 63))) != 0
+	}
+
+	/** Returns true when at least one cell is marked as empty. */
+	public var hasNulls: Bool {
+		if self.count == 0 {
+			return false
+		}
+
+		// The last word may have bits set beyond `count` (see init(repeating:count:)), so mask those out
+		let lastBits = self.count & 63
+		for i in 0..<self.words.count {
+			let word = (i == self.words.count - 1 && lastBits != 0) ? (self.words[i] & ((UInt64(1) << UInt64(lastBits)) - 1)) : self.words[i]
+			if word != 0 {
+				return true
+			}
+		}
+		return false
+	}
+
+	internal func gather(_ indices: [Int]) -> NullBitmap {
+		var result = NullBitmap()
+		result.words.reserveCapacity((indices.count + 63) / 64)
+		for index in indices {
+			result.append(self[index])
+		}
+		return result
+	}
+
+	internal var byteSize: Int {
+		return self.words.count * MemoryLayout<UInt64>.size
+	}
+}
+
+/** Storage for a single column of a ColumnarRaster. Cells of the common scalar types are stored unboxed in contiguous
+typed arrays, with a NullBitmap marking the cells that hold Value.empty. String columns are dictionary-encoded: each
+distinct string is stored only once, and cells refer to it by its index in the dictionary. Columns that mix types, or
+that contain blobs, lists or invalid values, fall back to a plain array of Value. */
+public enum ColumnBuffer {
+	case int([Int], nulls: NullBitmap)
+	case double([Double], nulls: NullBitmap)
+	case bool([Bool], nulls: NullBitmap)
+	case date([Double], nulls: NullBitmap)
+	case string(codes: [UInt32], dictionary: [String], nulls: NullBitmap)
+	case values([Value])
+
+	public var count: Int {
+		switch self {
+		case .int(let v, nulls: _): return v.count
+		case .double(let v, nulls: _): return v.count
+		case .bool(let v, nulls: _): return v.count
+		case .date(let v, nulls: _): return v.count
+		case .string(codes: let c, dictionary: _, nulls: _): return c.count
+		case .values(let v): return v.count
+		}
+	}
+
+	public subscript(row: Int) -> Value {
+		switch self {
+		case .int(let v, nulls: let n): return n[row] ? .empty : .int(v[row])
+		case .double(let v, nulls: let n): return n[row] ? .empty : .double(v[row])
+		case .bool(let v, nulls: let n): return n[row] ? .empty : .bool(v[row])
+		case .date(let v, nulls: let n): return n[row] ? .empty : .date(v[row])
+		case .string(codes: let c, dictionary: let d, nulls: let n): return n[row] ? .empty : .string(d[Int(c[row])])
+		case .values(let v): return v[row]
+		}
+	}
+
+	/** Returns a new buffer that contains the cells at the indicated row indices, in the order given. String columns
+	keep sharing their dictionary with the original buffer. */
+	internal func gather(_ indices: [Int]) -> ColumnBuffer {
+		switch self {
+		case .int(let v, nulls: let n): return .int(indices.map { v[$0] }, nulls: n.gather(indices))
+		case .double(let v, nulls: let n): return .double(indices.map { v[$0] }, nulls: n.gather(indices))
+		case .bool(let v, nulls: let n): return .bool(indices.map { v[$0] }, nulls: n.gather(indices))
+		case .date(let v, nulls: let n): return .date(indices.map { v[$0] }, nulls: n.gather(indices))
+		case .string(codes: let c, dictionary: let d, nulls: let n): return .string(codes: indices.map { c[$0] }, dictionary: d, nulls: n.gather(indices))
+		case .values(let v): return .values(indices.map { v[$0] })
+		}
+	}
+
+	/** Returns the cells in the indicated range as a batch column (for batch expression evaluation). Typed values are
+	copied without boxing them when the range contains no empty cells. */
+	internal func batch(_ range: Range<Int>) -> BatchColumn {
+		switch self {
+		case .int(let v, nulls: let n) where !range.contains(where: { n[$0] }): return .ints(Array(v[range]))
+		case .double(let v, nulls: let n) where !range.contains(where: { n[$0] }): return .doubles(Array(v[range]))
+		case .bool(let v, nulls: let n) where !range.contains(where: { n[$0] }): return .bools(Array(v[range]))
+		case .values(let v): return BatchColumn(Array(v[range]))
+		default: return .values(range.map { self[$0] })
+		}
+	}
+
+	/** An estimate of the number of bytes used to store the cells in this buffer. */
+	internal var byteSize: Int {
+		switch self {
+		case .int(let v, nulls: let n): return v.count * MemoryLayout<Int>.size + n.byteSize
+		case .double(let v, nulls: let n): return v.count * MemoryLayout<Double>.size + n.byteSize
+		case .bool(let v, nulls: let n): return v.count * MemoryLayout<Bool>.size + n.byteSize
+		case .date(let v, nulls: let n): return v.count * MemoryLayout<Double>.size + n.byteSize
+		case .string(codes: let c, dictionary: let d, nulls: let n):
+			return c.count * MemoryLayout<UInt32>.size + d.reduce(0) { $0 + $1.utf8.count } + n.byteSize
+		case .values(let v): return v.count * MemoryLayout<Value>.stride
+		}
+	}
+}
+
+/** Builds a ColumnBuffer by appending values one at a time. The type of the buffer is determined by the first non-empty
+value appended. When a value of another type is appended later on, the builder falls back to storing Value objects. */
+internal struct ColumnBufferBuilder {
+	private enum Kind {
+		case undetermined
+		case int
+		case double
+		case bool
+		case date
+		case string
+		case values
+	}
+
+	private var kind = Kind.undetermined
+	private var ints: [Int] = []
+	private var doubles: [Double] = []
+	private var bools: [Bool] = []
+	private var codes: [UInt32] = []
+	private var dictionary: [String] = []
+	private var dictionaryIndex: [String: UInt32] = [:]
+	private var values: [Value] = []
+	private var nulls = NullBitmap()
+	private(set) var count = 0
+
+	init() {
+	}
+
+	mutating func append(_ value: Value) {
+		switch (self.kind, value) {
+		case (.values, _):
+			self.values.append(value)
+
+		case (_, .empty):
+			switch self.kind {
+			case .int: self.ints.append(0)
+			case .double, .date: self.doubles.append(0.0)
+			case .bool: self.bools.append(false)
+			case .string: self.codes.append(0)
+			case .undetermined, .values: break
+			}
+			self.nulls.append(true)
+
+		case (.undetermined, .int(let i)):
+			self.ints = Array(repeating: 0, count: self.count)
+			self.kind = .int
+			self.ints.append(i)
+			self.nulls.append(false)
+
+		case (.undetermined, .double(let d)):
+			self.doubles = Array(repeating: 0.0, count: self.count)
+			self.kind = .double
+			self.doubles.append(d)
+			self.nulls.append(false)
+
+		case (.undetermined, .date(let d)):
+			self.doubles = Array(repeating: 0.0, count: self.count)
+			self.kind = .date
+			self.doubles.append(d)
+			self.nulls.append(false)
+
+		case (.undetermined, .bool(let b)):
+			self.bools = Array(repeating: false, count: self.count)
+			self.kind = .bool
+			self.bools.append(b)
+			self.nulls.append(false)
+
+		case (.undetermined, .string(let s)):
+			self.codes = Array(repeating: 0, count: self.count)
+			self.kind = .string
+			self.codes.append(self.code(for: s))
+			self.nulls.append(false)
+
+		case (.int, .int(let i)):
+			self.ints.append(i)
+			self.nulls.append(false)
+
+		case (.double, .double(let d)), (.date, .date(let d)):
+			self.doubles.append(d)
+			self.nulls.append(false)
+
+		case (.bool, .bool(let b)):
+			self.bools.append(b)
+			self.nulls.append(false)
+
+		case (.string, .string(let s)):
+			self.codes.append(self.code(for: s))
+			self.nulls.append(false)
+
+		default:
+			// Type conflict (or a value that cannot be stored in a typed buffer): fall back to storing Value objects
+			let existing = self.buffer
+			self.values = (0..<self.count).map { existing[$0] }
+			self.ints = []
+			self.doubles = []
+			self.bools = []
+			self.codes = []
+			self.dictionary = []
+			self.dictionaryIndex = [:]
+			self.nulls = NullBitmap()
+			self.kind = .values
+			self.values.append(value)
+		}
+
+		self.count += 1
+	}
+
+	private mutating func code(for string: String) -> UInt32 {
+		if let c = self.dictionaryIndex[string] {
+			return c
+		}
+
+		let c = UInt32(self.dictionary.count)
+		self.dictionary.append(string)
+		self.dictionaryIndex[string] = c
+		return c
+	}
+
+	var buffer: ColumnBuffer {
+		switch self.kind {
+		case .undetermined:
+			// All cells are empty
+			return .int(Array(repeating: 0, count: self.count), nulls: NullBitmap(repeating: true, count: self.count))
+		case .int: return .int(self.ints, nulls: self.nulls)
+		case .double: return .double(self.doubles, nulls: self.nulls)
+		case .date: return .date(self.doubles, nulls: self.nulls)
+		case .bool: return .bool(self.bools, nulls: self.nulls)
+		case .string: return .string(codes: self.codes, dictionary: self.dictionary, nulls: self.nulls)
+		case .values: return .values(self.values)
+		}
+	}
+}
+
+/** ColumnarRaster is an in-memory table that stores its data column by column, in typed buffers (see ColumnBuffer).
+Compared to rows of boxed Value arrays this uses considerably less memory, and operations that only touch a few columns
+(filtering, sorting, aggregating) do not need to visit every cell of every row. A ColumnarRaster is immutable, and can
+therefore be read from multiple threads without locking. Use ColumnarRasterBuilder to create one incrementally. A Raster
+can be backed by a ColumnarRaster (see Raster.init(columnar:) and `raster`). */
+public final class ColumnarRaster {
+	public let columns: OrderedSet<Column>
+	public let buffers: [ColumnBuffer]
+	public let rowCount: Int
+
+	internal init(columns: OrderedSet<Column>, buffers: [ColumnBuffer], rowCount: Int) {
+		assert(columns.count == buffers.count, "there should be as many buffers as there are columns")
+		self.columns = columns
+		self.buffers = buffers
+		self.rowCount = rowCount
+	}
+
+	public convenience init(data: [Tuple], columns: OrderedSet<Column>) {
+		var builder = ColumnarRasterBuilder(columns: columns)
+		builder.append(contentsOf: data)
+		let result = builder.build()
+		self.init(columns: result.columns, buffers: result.buffers, rowCount: result.rowCount)
+	}
+
+	public convenience init(raster: Raster) {
+		let (columnar, data, columns) = raster.mutex.locked { () -> (ColumnarRaster?, [Tuple], OrderedSet<Column>) in
+			if let c = raster.columnar {
+				return (c, [], raster.columns)
+			}
+			return (nil, raster.tuples, raster.columns)
+		}
+
+		if let c = columnar {
+			self.init(columns: c.columns, buffers: c.buffers, rowCount: c.rowCount)
+		}
+		else {
+			self.init(data: data, columns: columns)
+		}
+	}
+
+	/** A (read-only) Raster backed by this table. */
+	public var raster: Raster {
+		return Raster(columnar: self, readOnly: true)
+	}
+
+	public func indexOfColumnWithName(_ name: Column) -> Int? {
+		return self.columns.firstIndex(of: name)
+	}
+
+	public subscript(row: Int, col: Int) -> Value {
+		return self.buffers[col][row]
+	}
+
+	public subscript(row: Int, col: Column) -> Value? {
+		if let colNr = self.indexOfColumnWithName(col) {
+			return self.buffers[colNr][row]
+		}
+		return nil
+	}
+
+	public subscript(row: Int) -> Row {
+		return Row(self.tuple(row), columns: self.columns)
+	}
+
+	public func tuple(_ row: Int) -> Tuple {
+		return self.buffers.map { $0[row] }
+	}
+
+	public var rows: AnyRandomAccessCollection<Row> {
+		return AnyRandomAccessCollection((0..<self.rowCount).lazy.map { return self[$0] })
+	}
+
+	/** An estimate of the amount of memory (in bytes) used to store the cells of this table. */
+	public var byteSize: Int {
+		return self.buffers.reduce(0) { $0 + $1.byteSize }
+	}
+
+	/** Returns a table containing only the rows at the indicated indices, in the order given. */
+	public func gather(_ indices: [Int]) -> ColumnarRaster {
+		return ColumnarRaster(columns: self.columns, buffers: self.buffers.map { $0.gather(indices) }, rowCount: indices.count)
+	}
+
+	/** Returns a table containing only the indicated columns (in the order given). Columns that do not exist in this
+	table are left out. No cells are copied. */
+	public func selectColumns(_ columns: OrderedSet<Column>) -> ColumnarRaster {
+		var newColumns = OrderedSet<Column>()
+		var newBuffers: [ColumnBuffer] = []
+		for column in columns {
+			if let index = self.indexOfColumnWithName(column), !newColumns.contains(column) {
+				newColumns.append(column)
+				newBuffers.append(self.buffers[index])
+			}
+		}
+		return ColumnarRaster(columns: newColumns, buffers: newBuffers, rowCount: self.rowCount)
+	}
+
+	/** Returns a table containing the rows in the indicated range (the range is clamped to the available rows). */
+	public func slice(_ range: Range<Int>) -> ColumnarRaster {
+		let clamped = range.clamped(to: 0..<self.rowCount)
+		return self.gather(Array(clamped))
+	}
+
+	/** Returns a function that evaluates `expression` for a row in this table. Only the cells of the columns that the
+	expression refers to are read. */
+	private func evaluator(for expression: Expression) -> (Int) -> Value {
+		let prepared = expression.prepare()
+		let dependencies = OrderedSet(prepared.siblingDependencies.filter { self.indexOfColumnWithName($0) != nil })
+		let buffers = dependencies.map { self.buffers[self.indexOfColumnWithName($0)!] }
+		let compiled = prepared.compile(columns: dependencies)
+
+		return { row in
+			return compiled(buffers.map { $0[row] }, nil, nil)
+		}
+	}
+
+	/** Returns a table containing only the rows for which `condition` evaluates to boolean true. The condition is
+	evaluated in batches, directly on the column buffers (see Expression.compileBatch). */
+	public func filter(_ condition: Expression) -> ColumnarRaster {
+		let evaluate = condition.prepare().batchEvaluator(columns: self.columns)
+		var selection: [Int] = []
+		var start = 0
+
+		while start < self.rowCount {
+			let range = start..<min(self.rowCount, start + StreamDefaultBatchSize)
+			let result = evaluate(ColumnarBatch(raster: self, range: range), nil)
+
+			if case .bools(let matches) = result {
+				for i in 0..<matches.count where matches[i] {
+					selection.append(start + i)
+				}
+			}
+			else {
+				for i in 0..<range.count where result[i] == Value.bool(true) {
+					selection.append(start + i)
+				}
+			}
+			start = range.upperBound
+		}
+		return self.gather(selection)
+	}
+
+	/** Returns this table sorted by the indicated orders, using the same semantics as RasterDataset.sort. Sort keys are
+	calculated only once for each row. When an order sorts by a column that is stored in a typed buffer, the typed values
+	are compared directly. */
+	public func sorted(by orders: [Order]) -> ColumnarRaster {
+		let keys = orders.map { self.sortKey(for: $0) }
+		let indices = (0..<self.rowCount).sorted { a, b -> Bool in
+			// Return true if a comes before b
+			for (n, order) in orders.enumerated() {
+				switch keys[n].compare(a, b, order: order) {
+				case .orderedAscending: return true
+				case .orderedDescending: return false
+				case .orderedSame: continue
+				}
+			}
+			return false
+		}
+		return self.gather(indices)
+	}
+
+	private func sortKey(for order: Order) -> ColumnarSortKey {
+		guard let expression = order.expression else {
+			return .constant
+		}
+
+		if let sibling = expression as? Sibling, let index = self.indexOfColumnWithName(sibling.column) {
+			switch (self.buffers[index], order.numeric) {
+			case (.int(let v, nulls: let n), true): return .ints(v, nulls: n)
+			case (.double(let v, nulls: let n), true): return .doubles(v, nulls: n)
+
+			case (.string(codes: let c, dictionary: let d, nulls: let n), false):
+				// Sort the (typically much smaller) dictionary once, then compare the ranks of strings
+				let sortedCodes = d.indices.sorted { d[$0].compare(d[$1]) == .orderedAscending }
+				var ranks = [UInt32](repeating: 0, count: d.count)
+				var rank: UInt32 = 0
+				for (position, code) in sortedCodes.enumerated() {
+					if position > 0 && d[sortedCodes[position - 1]].compare(d[code]) != .orderedSame {
+						rank += 1
+					}
+					ranks[code] = rank
+				}
+				return .ranks(c.map { ranks[Int($0)] }, nulls: n)
+
+			default:
+				break
+			}
+		}
+
+		let evaluate = self.evaluator(for: expression)
+		return .values((0..<self.rowCount).map(evaluate))
+	}
+}
+
+/** Batch source that reads a range of rows from a ColumnarRaster. */
+private struct ColumnarBatch: BatchSource {
+	let raster: ColumnarRaster
+	let range: Range<Int>
+
+	var count: Int {
+		return self.range.count
+	}
+
+	func column(_ index: Int) -> BatchColumn {
+		return self.raster.buffers[index].batch(self.range)
+	}
+
+	func tuple(_ index: Int) -> Tuple {
+		return self.raster.tuple(self.range.lowerBound + index)
+	}
+}
+
+/** Precomputed sort keys for a single Order over the rows of a ColumnarRaster. */
+private enum ColumnarSortKey {
+	case constant
+	case ints([Int], nulls: NullBitmap)
+	case doubles([Double], nulls: NullBitmap)
+	case ranks([UInt32], nulls: NullBitmap)
+	case values([Value])
+
+	func compare(_ a: Int, _ b: Int, order: Order) -> ComparisonResult {
+		switch self {
+		case .constant:
+			return .orderedSame
+
+		case .ints(let v, nulls: let n):
+			return ColumnarSortKey.compare(v, n, a, b, ascending: order.ascending)
+
+		case .doubles(let v, nulls: let n):
+			return ColumnarSortKey.compare(v, n, a, b, ascending: order.ascending)
+
+		case .ranks(let v, nulls: let n):
+			// Empty values have no string value, and are therefore left for the next order to decide
+			if n[a] || n[b] {
+				return .orderedSame
+			}
+			return ColumnarSortKey.compare(v, n, a, b, ascending: order.ascending)
+
+		case .values(let v):
+			return order.compare(v[a], v[b])
+		}
+	}
+
+	/** Compares typed values; empty values are smaller than any other value (as is the case for Value). */
+	private static func compare<T: Comparable>(_ values: [T], _ nulls: NullBitmap, _ a: Int, _ b: Int, ascending: Bool) -> ComparisonResult {
+		let (first, second) = ascending ? (a, b) : (b, a)
+		switch (nulls[first], nulls[second]) {
+		case (true, true): return .orderedSame
+		case (true, false): return .orderedAscending
+		case (false, true): return .orderedDescending
+		case (false, false):
+			if values[first] < values[second] {
+				return .orderedAscending
+			}
+			else if values[second] < values[first] {
+				return .orderedDescending
+			}
+			return .orderedSame
+		}
+	}
+}
+
+/** Builds a ColumnarRaster by appending rows. Rows that are shorter than the number of columns are padded with empty
+values; superfluous cells are ignored. */
+public struct ColumnarRasterBuilder {
+	public let columns: OrderedSet<Column>
+	private var builders: [ColumnBufferBuilder]
+	public private(set) var rowCount = 0
+
+	public init(columns: OrderedSet<Column>) {
+		self.columns = columns
+		self.builders = Array(repeating: ColumnBufferBuilder(), count: columns.count)
+	}
+
+	public mutating func append(_ row: Tuple) {
+		for i in 0..<self.builders.count {
+			self.builders[i].append(i < row.count ? row[i] : Value.empty)
+		}
+		self.rowCount += 1
+	}
+
+	public mutating func append(contentsOf rows: [Tuple]) {
+		for row in rows {
+			self.append(row)
+		}
+	}
+
+	public func build() -> ColumnarRaster {
+		return ColumnarRaster(columns: self.columns, buffers: self.builders.map { $0.buffer }, rowCount: self.rowCount)
+	}
+}
+
+/** ColumnarRasterStream streams the contents of a ColumnarRaster, materializing rows one batch at a time. The table is
+only produced when it is first needed (this allows ColumnarDataset to defer work until data is actually fetched). */
+public final class ColumnarRasterStream: NSObject, Stream {
+	private let producer: () -> ColumnarRaster
+	private var position = 0
+	private let mutex = Mutex()
+	private let sizer = BatchSizer()
+
+	public convenience init(_ raster: ColumnarRaster) {
+		self.init(producer: { return raster })
+	}
+
+	internal init(producer: @escaping () -> ColumnarRaster) {
+		self.producer = producer
+	}
+
+	public func columns(_ job: Job, callback: @escaping (Fallible<OrderedSet<Column>>) -> ()) {
+		callback(.success(self.producer().columns))
+	}
+
+	public func clone() -> Stream {
+		return ColumnarRasterStream(producer: self.producer)
+	}
+
+	public func fetch(_ job: Job, consumer: @escaping Sink) {
+		// Claim a range of rows synchronously (so concurrent wavefronts receive consecutive ranges)
+		let (raster, range, hasNext) = self.mutex.locked { () -> (ColumnarRaster, Range<Int>, Bool) in
+			let raster = self.producer()
+			let start = self.position
+			let end = min(raster.rowCount, start + self.sizer.size)
+			self.position = end
+			return (raster, start..<end, end < raster.rowCount)
+		}
+
+		// Materializing the rows can happen concurrently with other wavefronts
+		job.async {
+			if raster.rowCount > 0 {
+				job.reportProgress(Double(range.upperBound) / Double(raster.rowCount), forKey: self.hashValue)
+			}
+			let started = CFAbsoluteTimeGetCurrent()
+			let rows = range.map { raster.tuple($0) }
+			self.sizer.observe(rows, duration: CFAbsoluteTimeGetCurrent() - started)
+			consumer(.success(rows), hasNext ? .hasMore : .finished)
+		}
+	}
+}
+
+/** ColumnarDataset is a data set backed by an in-memory ColumnarRaster. Filtering, sorting, limiting and column
+selection are performed directly on the column buffers; all other operations are streamed (see StreamDataset). All
+operations are lazy: the columnar tables are only calculated once data is fetched. */
+public class ColumnarDataset: StreamDataset {
+	private let producer: () -> ColumnarRaster
+
+	public convenience init(columnar: ColumnarRaster) {
+		self.init(producer: { return columnar })
+	}
+
+	private init(producer: @escaping () -> ColumnarRaster) {
+		let memoizedProducer = memoize(producer)
+		self.producer = memoizedProducer
+		super.init(source: ColumnarRasterStream(producer: memoizedProducer))
+	}
+
+	private func apply(_ operation: @escaping (ColumnarRaster) -> ColumnarRaster) -> Dataset {
+		let producer = self.producer
+		return ColumnarDataset(producer: { return operation(producer()) })
+	}
+
+	override public func raster(_ job: Job, deliver: Delivery, callback: @escaping (Fallible<Raster>, StreamStatus) -> ()) {
+		job.async {
+			callback(.success(self.producer().raster), .finished)
+		}
+	}
+
+	override public func filter(_ condition: Expression) -> Dataset {
+		return self.apply { $0.filter(condition) }
+	}
+
+	override public func sort(_ by: [Order]) -> Dataset {
+		return self.apply { $0.sorted(by: by) }
+	}
+
+	override public func selectColumns(_ columns: OrderedSet<Column>) -> Dataset {
+		return self.apply { $0.selectColumns(columns) }
+	}
+
+	override public func limit(_ numberOfRows: Int) -> Dataset {
+		return self.apply { $0.slice(0..<max(0, numberOfRows)) }
+	}
+
+	override public func offset(_ numberOfRows: Int) -> Dataset {
+		return self.apply { $0.slice(max(0, numberOfRows)..<$0.rowCount) }
+	}
+}
+
+/** Collects the rows of a stream directly into a ColumnarRaster, without first building a Raster. */
+private class ColumnarStreamPuller: StreamPuller {
+	private var builder: ColumnarRasterBuilder
+	private let callback: (Fallible<ColumnarRaster>) -> ()
+
+	init(stream: Stream, job: Job, columns: OrderedSet<Column>, callback: @escaping (Fallible<ColumnarRaster>) -> ()) {
+		self.builder = ColumnarRasterBuilder(columns: columns)
+		self.callback = callback
+		super.init(stream: stream, job: job)
+	}
+
+	override func onReceiveRows(_ rows: [Tuple], callback: @escaping (Fallible<Void>) -> ()) {
+		self.mutex.locked {
+			self.builder.append(contentsOf: rows)
+			callback(.success(()))
+		}
+	}
+
+	override func onDoneReceiving() {
+		job.async {
+			let result = self.mutex.locked { return self.builder.build() }
+			self.callback(.success(result))
+		}
+	}
+
+	override func onError(_ error: String) {
+		job.async {
+			self.callback(.failure(error))
+		}
+	}
+}
+
+public extension Dataset {
+	/** Fetches all data in this data set into a ColumnarRaster. */
+	func columnar(_ job: Job, callback: @escaping (Fallible<ColumnarRaster>) -> ()) {
+		let s = self.stream()
+		job.async {
+			s.columns(job, callback: once { (columns) -> () in
+				switch columns {
+				case .success(let cns):
+					let puller = ColumnarStreamPuller(stream: s, job: job, columns: cns, callback: callback)
+					puller.start()
+
+				case .failure(let e):
+					callback(.failure(e))
+				}
+			})
+		}
+	}
+}
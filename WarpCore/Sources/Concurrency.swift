@@ -224,54 +224,11 @@ public func eachConcurrently<Element>(_ s: AnySequence<Element>, maxConcurrent:
 }
 
 internal extension Array {
-	func parallel<T, ResultType>(_ map: (@escaping (Array<Element>) -> (T)), reduce: (@escaping (T, ResultType?) -> (ResultType))) -> Future<ResultType?> {
-		let chunkSize = StreamDefaultBatchSize/8
-		
-		return Future<ResultType?>({ (job, completion) -> () in
-			let group = DispatchGroup()
-			var buffer: [T] = []
-			var finishedItems = 0
-			
-			// Chunk the contents of the array and dispatch jobs that map each chunk
-			for i in stride(from: 0, to: self.count, by: chunkSize) {
-				let x = i + chunkSize
-				let n = (x < self.count) ? x : self.count
-
-				let view = Array(self[i..<n])
-				let count: Int = view.count
-				
-				job.queue.async(group: group) {
-					// Check whether we still need to process this chunk
-					if job.cancelled {
-						return
-					}
-					
-					// Generate output for this chunk
-					let workerOutput = map(view)
-					
-					// Dispatch a block that adds our result (synchronously) to the intermediate result buffer
-					DispatchQueue.main.async(group: group) {
-						finishedItems += count
-						let p = Double(finishedItems) / Double(self.count)
-						job.reportProgress(p, forKey: 1)
-						buffer.append(workerOutput)
-					}
-				}
-			}
-			
-			// Reduce stage: loop over all intermediate results in the buffer and merge
-			group.notify(queue: job.queue) {
-				if job.cancelled {
-					return
-				}
-				
-				var result: ResultType? = nil
-				for item in buffer {
-					result = reduce(item, result)
-				}
-				
-				completion(result)
-			}
+	/** Maps chunks of this array in parallel and combines the results in order (see TaskPool.map). The combine function
+	must be associative. */
+	func parallel<T>(_ map: @escaping (ArraySlice<Element>) -> T, combine: @escaping (T, T) -> T) -> Future<T?> {
+		return Future<T?>({ (job, completion) -> () in
+			TaskPool.map(count: self.count, job: job, map: { range in map(self[range]) }, combine: combine, callback: completion)
 		}, timeLimit: nil)
 	}
 }
@@ -108,6 +108,37 @@ public class Order: NSObject, NSCoding {
 		}
 		return false
 	}
+
+	/** Compares two sort keys (results of evaluating this order's expression for two rows). Returns .orderedAscending
+	if the row with key `a` should come before the row with key `b`, .orderedDescending if it should come after it, and
+	.orderedSame if this order does not decide (in which case the next order should). */
+	internal func compare(_ a: Value, _ b: Value) -> ComparisonResult {
+		if self.numeric {
+			let (first, second) = self.ascending ? (a, b) : (b, a)
+
+			// Value's < considers the empty value to be smaller than any value, including another empty value
+			if first.isEmpty && second.isEmpty {
+				return .orderedSame
+			}
+			else if first < second {
+				return .orderedAscending
+			}
+			else if first > second {
+				return .orderedDescending
+			}
+			return .orderedSame
+		}
+		else {
+			if let aString = a.stringValue, let bString = b.stringValue {
+				let res = aString.compare(bString)
+				if res == .orderedSame || self.ascending {
+					return res
+				}
+				return res == .orderedAscending ? .orderedDescending : .orderedAscending
+			}
+			return .orderedSame
+		}
+	}
 }
 
 public enum JoinType: String {
@@ -293,6 +324,10 @@ public protocol Dataset {
 	order specified, in case of ties by the second, et cetera. If there are ties and there is no further order to sort by,
 	ordering is unspecified. If no orders are specified, sort is a no-op. */
 	func sort(_ by: [Order]) -> Dataset
+
+	/** Sort the dataset in the indicated ways and return only the first `numberOfRows` rows. This is equivalent to
+	sort(by).limit(numberOfRows), but implementations may avoid sorting (and holding on to) all rows. */
+	func sort(_ by: [Order], limit numberOfRows: Int) -> Dataset
 	
 	/** Perform the specified join operation on this data set and return the resulting data. */
 	func join(_ join: Join) -> Dataset
@@ -330,6 +365,10 @@ public extension Dataset {
 	var underlyingDataset: Dataset {
 		return self
 	}
+
+	func sort(_ by: [Order], limit numberOfRows: Int) -> Dataset {
+		return self.sort(by).limit(numberOfRows)
+	}
 }
 
 /** Utility class that allows for easy swapping of Dataset objects. This can for instance be used to swap-in a cached
@@ -357,6 +396,7 @@ open class ProxyDataset: NSObject, Dataset {
 	open func flatten(_ valueTo: Column, columnNameTo: Column?, rowIdentifier: Expression?, to: Column?) -> Dataset { return data.flatten(valueTo, columnNameTo: columnNameTo, rowIdentifier: rowIdentifier, to: to) }
 	open func offset(_ numberOfRows: Int) -> Dataset { return data.offset(numberOfRows) }
 	open func sort(_ by: [Order]) -> Dataset { return data.sort(by) }
+	open func sort(_ by: [Order], limit numberOfRows: Int) -> Dataset { return data.sort(by, limit: numberOfRows) }
 	open func join(_ join: Join) -> Dataset { return data.join(join) }
 	open func union(_ data: Dataset) -> Dataset { return data.union(data) }
 	open func rank(_ ranks: [Column : Aggregator], by: [Order]) -> Dataset { return data.rank(ranks, by:by) }
@@ -388,6 +428,7 @@ enum CoalescedDataset: Dataset {
 	case transposing(Dataset)
 	case filtering(Dataset, Expression)
 	case sorting(Dataset, [Order])
+	case sortingThenLimiting(Dataset, [Order], Int)
 	case ranking(Dataset, targets: [Column: Aggregator], by: [Order])
 	case selectingColumns(Dataset, OrderedSet<Column>)
 	case calculating(Dataset, [Column: Expression])
@@ -419,6 +460,9 @@ enum CoalescedDataset: Dataset {
 			
 			case .sorting(let data, let order):
 				return data.sort(order)
+
+			case .sortingThenLimiting(let data, let order, let numberOfRows):
+				return data.sort(order, limit: numberOfRows)
 			
 			case .selectingColumns(let data, let cols):
 				return data.selectColumns(cols)
@@ -562,7 +606,8 @@ enum CoalescedDataset: Dataset {
 	
 	/** Axioms for limit:
 	data.limit(x).limit(y) is equivalent to data.limit(min(x,y))
-	data.calculate(...).limit(x) is equivalent to data.limit(x).calculate(...) */
+	data.calculate(...).limit(x) is equivalent to data.limit(x).calculate(...)
+	data.sort(...).limit(x) is equivalent to data.sort(..., limit: x), which only needs to keep x rows while sorting */
 	func limit(_ numberOfRows: Int) -> Dataset {
 		switch self {
 			case .calculating(let data, let calculations):
@@ -570,6 +615,12 @@ enum CoalescedDataset: Dataset {
 
 			case .limiting(let data, let nr):
 				return CoalescedDataset.limiting(data, min(numberOfRows, nr))
+
+			case .sorting(let data, let orders):
+				return CoalescedDataset.sortingThenLimiting(data, orders, numberOfRows)
+
+			case .sortingThenLimiting(let data, let orders, let nr):
+				return CoalescedDataset.sortingThenLimiting(data, orders, min(numberOfRows, nr))
 			
 			default:
 				return CoalescedDataset.limiting(self.data, numberOfRows)
@@ -0,0 +1,322 @@
+/* Copyright (c) 2014-2016 Pixelspark, Tommy van der Vorst
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+import Foundation
+
+/** A batch of rows flowing through a pipeline of MorselExecutor. Morsels are numbered in the order in which they were
+produced by the source of the pipeline, so that sinks can restore that order when needed. */
+internal struct Morsel {
+	let sequence: Int
+	var rows: [Tuple]
+}
+
+/** A row-local operation in a pipeline, which modifies the rows of a morsel in place. Operators are called concurrently
+(for different morsels) from different workers. */
+internal typealias MorselOperator = (inout [Tuple]) -> ()
+
+/** Produces the morsels that enter a pipeline. `next` is called concurrently by the workers of the pipeline, and calls
+back exactly once: with the next morsel, or with nil when the source is exhausted. */
+internal protocol MorselSource: class {
+	func next(_ job: Job, callback: @escaping (Fallible<Morsel>?) -> ())
+}
+
+/** The end of a pipeline (a 'pipeline breaker'). The workers of the pipeline push morsels into the sink concurrently and
+in any order. When all morsels have been pushed, `finish` is called once. The result of the sink (e.g. the groups of an
+aggregation) can then be used as the source of the next pipeline. */
+internal protocol MorselSink: class {
+	func push(_ morsel: Morsel, job: Job)
+	func finish(_ job: Job, callback: @escaping (Fallible<Void>) -> ())
+}
+
+/** A pipeline that has a source and operators, but no sink yet. */
+internal struct OpenPipeline {
+	let source: MorselSource
+	let columns: OrderedSet<Column>
+	let operators: [MorselOperator]
+
+	/** Returns this pipeline with the operator added at the end. */
+	func appending(_ op: @escaping MorselOperator, columns: OrderedSet<Column>) -> OpenPipeline {
+		return OpenPipeline(source: self.source, columns: columns, operators: self.operators + [op])
+	}
+}
+
+/** Streams that can be executed by MorselExecutor as part of a push-based pipeline implement this protocol. Streams
+that do not are used as an (opaque) source, from which rows are fetched as usual. */
+internal protocol MorselPlannable {
+	/** Prepares the pipeline that produces the rows of this stream. A row-local stream adds operators to the pipeline of
+	its source. A pipeline breaker (e.g. an aggregation) runs the pipeline of its source to completion, and returns a new
+	pipeline that starts with its result. */
+	func plan(_ job: Job, callback: @escaping (Fallible<OpenPipeline>) -> ())
+}
+
+/** MorselExecutor executes streams using push-based, morsel-driven parallelism. In the pull model (Stream.fetch and
+StreamPuller), work is only parallel where a source supports concurrent fetches, and each transformer is visited (and
+locked) for every batch separately. The executor instead compiles a chain of streams into pipelines: a pipeline reads
+morsels from a source and pushes each of them through all row-local operators into a sink, on one worker. A number of
+workers (one for each processor) do this concurrently, so that every stage of the pipeline keeps all cores busy, not
+only the source.
+
+Pipelines end at a pipeline breaker, which needs all of its input before it can produce any output: an aggregation
+(partial aggregates are collected for each worker and merged at the end), a sort (rows are collected into runs that are
+merged) or the build side of a hash join (the hash table is built from the result of its own pipeline, after which
+probing it is a row-local operator). Streams that cannot be planned (see MorselPlannable) are wrapped as a source. */
+internal final class MorselExecutor {
+	/** The number of workers that run a pipeline concurrently. */
+	static let workerCount = max(1, ProcessInfo.processInfo.activeProcessorCount)
+
+	/** Executes the stream and collects all its rows in a raster (in columnar storage). */
+	static func raster(_ stream: Stream, job: Job, callback: @escaping (Fallible<Raster>) -> ()) {
+		MorselExecutor.plan(stream, job: job) { pipelineFallible in
+			switch pipelineFallible {
+			case .success(let pipeline):
+				let sink = ColumnarMorselSink(columns: pipeline.columns)
+				MorselExecutor.run(pipeline, into: sink, job: job) { result in
+					switch result {
+					case .success(_):
+						callback(.success(Raster(columnar: sink.result!, readOnly: true)))
+
+					case .failure(let e):
+						callback(.failure(e))
+					}
+				}
+
+			case .failure(let e):
+				callback(.failure(e))
+			}
+		}
+	}
+
+	/** Prepares the pipeline that produces the rows of the given stream. */
+	static func plan(_ stream: Stream, job: Job, callback: @escaping (Fallible<OpenPipeline>) -> ()) {
+		if let plannable = stream as? MorselPlannable {
+			plannable.plan(job, callback: callback)
+		}
+		else {
+			MorselExecutor.source(stream, job: job, callback: callback)
+		}
+	}
+
+	/** Returns a pipeline that fetches the rows of the stream (without planning the stream itself). */
+	static func source(_ stream: Stream, job: Job, callback: @escaping (Fallible<OpenPipeline>) -> ()) {
+		stream.columns(job) { columnsFallible in
+			switch columnsFallible {
+			case .success(let columns):
+				callback(.success(OpenPipeline(source: StreamMorselSource(stream), columns: columns, operators: [])))
+
+			case .failure(let e):
+				callback(.failure(e))
+			}
+		}
+	}
+
+	/** Runs the pipeline until its source is exhausted, pushing all morsels into the sink, and finishes the sink. */
+	static func run(_ pipeline: OpenPipeline, into sink: MorselSink, job: Job, callback: @escaping (Fallible<Void>) -> ()) {
+		MorselPipelineRun(pipeline: pipeline, sink: sink, job: job, callback: callback).start()
+	}
+}
+
+/** The execution of a single pipeline by a set of workers. Each worker repeatedly takes a morsel from the source, applies
+all operators to it and pushes it into the sink. A worker only takes the next morsel after it has pushed the previous one,
+so at most one morsel per worker is in flight. */
+private final class MorselPipelineRun {
+	private let pipeline: OpenPipeline
+	private let sink: MorselSink
+	private let job: Job
+	private let callback: (Fallible<Void>) -> ()
+	private let mutex = Mutex()
+	private var runningWorkers = 0
+	private var error: String? = nil
+
+	init(pipeline: OpenPipeline, sink: MorselSink, job: Job, callback: @escaping (Fallible<Void>) -> ()) {
+		self.pipeline = pipeline
+		self.sink = sink
+		self.job = job
+		self.callback = callback
+	}
+
+	func start() {
+		self.mutex.locked {
+			self.runningWorkers = MorselExecutor.workerCount
+		}
+
+		for _ in 0..<MorselExecutor.workerCount {
+			self.job.async {
+				self.work()
+			}
+		}
+	}
+
+	private func work() {
+		let stop = self.mutex.locked { return self.error != nil } || self.job.isCancelled
+		if stop {
+			return self.workerFinished()
+		}
+
+		self.pipeline.source.next(self.job) { morselFallible in
+			guard let mf = morselFallible else {
+				return self.workerFinished()
+			}
+
+			switch mf {
+			case .success(var morsel):
+				// Continue on the job's queue, as the source may call back on any queue (and possibly synchronously)
+				self.job.async {
+					if !self.pipeline.operators.isEmpty {
+						self.job.time("Pipeline", items: morsel.rows.count, itemType: "rows") {
+							for op in self.pipeline.operators {
+								op(&morsel.rows)
+							}
+						}
+					}
+					self.sink.push(morsel, job: self.job)
+					self.work()
+				}
+
+			case .failure(let e):
+				self.mutex.locked {
+					if self.error == nil {
+						self.error = e
+					}
+				}
+				self.workerFinished()
+			}
+		}
+	}
+
+	private func workerFinished() {
+		let (last, error) = self.mutex.locked { () -> (Bool, String?) in
+			self.runningWorkers -= 1
+			return (self.runningWorkers == 0, self.error)
+		}
+
+		if last {
+			if let e = error {
+				self.callback(.failure(e))
+			}
+			else if self.job.isCancelled {
+				self.callback(.failure("The operation was cancelled"))
+			}
+			else {
+				self.sink.finish(self.job, callback: self.callback)
+			}
+		}
+	}
+}
+
+/** Reads morsels from a stream. Each call to next fetches from the stream; the fetch is started while holding a lock,
+so that the morsels are numbered in the order in which fetch was called (see StreamPuller). */
+internal final class StreamMorselSource: MorselSource {
+	private let stream: Stream
+	private let mutex = Mutex()
+	private var nextSequence = 0
+	private var finished = false
+
+	init(_ stream: Stream) {
+		self.stream = stream
+	}
+
+	func next(_ job: Job, callback: @escaping (Fallible<Morsel>?) -> ()) {
+		var exhausted = false
+		self.mutex.locked {
+			if self.finished {
+				exhausted = true
+				return
+			}
+
+			let sequence = self.nextSequence
+			self.nextSequence += 1
+			self.stream.fetch(job) { rowsFallible, status in
+				if status == .finished {
+					self.mutex.locked {
+						self.finished = true
+					}
+				}
+
+				switch rowsFallible {
+				case .success(let rows):
+					callback(.success(Morsel(sequence: sequence, rows: rows)))
+
+				case .failure(let e):
+					callback(.failure(e))
+				}
+			}
+		}
+
+		if exhausted {
+			callback(nil)
+		}
+	}
+}
+
+/** Serves morsels from rows in memory (e.g. the result of a pipeline breaker). */
+internal final class RowsMorselSource: MorselSource {
+	private let rows: [Tuple]
+	private let mutex = Mutex()
+	private let sizer = BatchSizer()
+	private var position = 0
+	private var nextSequence = 0
+
+	init(_ rows: [Tuple]) {
+		self.rows = rows
+	}
+
+	func next(_ job: Job, callback: @escaping (Fallible<Morsel>?) -> ()) {
+		let morsel = self.mutex.locked { () -> Morsel? in
+			if self.position >= self.rows.count {
+				return nil
+			}
+
+			let rows = self.sizer.batch { size in
+				return Array(self.rows[self.position..<min(self.rows.count, self.position + size)])
+			}
+			self.position += rows.count
+			self.nextSequence += 1
+			return Morsel(sequence: self.nextSequence - 1, rows: rows)
+		}
+
+		callback(morsel.map { Fallible<Morsel>.success($0) })
+	}
+}
+
+/** Collects the rows of all morsels in a ColumnarRaster, in the order of the morsels. Morsels that arrive before their
+predecessors are held until those have been added. */
+internal final class ColumnarMorselSink: MorselSink {
+	private let mutex = Mutex()
+	private var builder: ColumnarRasterBuilder
+	private var pending: [Int: [Tuple]] = [:]
+	private var nextSequence = 0
+	private(set) var result: ColumnarRaster? = nil
+
+	init(columns: OrderedSet<Column>) {
+		self.builder = ColumnarRasterBuilder(columns: columns)
+	}
+
+	func push(_ morsel: Morsel, job: Job) {
+		self.mutex.locked {
+			self.pending[morsel.sequence] = morsel.rows
+			while let rows = self.pending.removeValue(forKey: self.nextSequence) {
+				self.builder.append(contentsOf: rows)
+				self.nextSequence += 1
+			}
+		}
+	}
+
+	func finish(_ job: Job, callback: @escaping (Fallible<Void>) -> ()) {
+		self.mutex.locked {
+			assert(self.pending.isEmpty, "all morsels should have been added when the pipeline finishes")
+			self.result = self.builder.build()
+		}
+		callback(.success(()))
+	}
+}
@@ -22,6 +22,10 @@ internal let expressions: [Expression.Type] = [
 	Identity.self
 ]
 
+/** A compiled expression (see Expression.compile) calculates the result of an expression for a row and (optionally) a
+foreign row, both provided as tuples with values in the order of the columns the expression was compiled for. */
+public typealias CompiledExpression = (_ row: Tuple, _ foreign: Tuple?, _ inputValue: Value?) -> Value
+
 /** A Expression is a 'formula' that evaluates to a certain Value given a particular context. */
 public class Expression: NSObject, NSCoding {
 	public func explain(_ locale: Language, topLevel: Bool = true) -> String {
@@ -92,6 +96,37 @@ public class Expression: NSObject, NSCoding {
 	public func apply(_ row: Row, foreign: Row?, inputValue: Value?) -> Value {
 		fatalError("A Expression was called that isn't implemented")
 	}
+
+	/** Returns a function that calculates the result of this expression for rows with the given columns (and foreign rows
+	with the given foreign columns). References to sibling and foreign columns are resolved to column indexes once, when
+	compiling, so that the returned function does not need to look up columns by name for each row it is called for. The
+	result of the compiled expression is the same as the result of apply() for the equivalent rows. Callers should
+	prepare() the expression before compiling it. */
+	public func compile(columns: OrderedSet<Column>, foreignColumns: OrderedSet<Column> = []) -> CompiledExpression {
+		return { row, foreign, inputValue in
+			return self.apply(Row(row, columns: columns), foreign: foreign.map { Row($0, columns: foreignColumns) }, inputValue: inputValue)
+		}
+	}
+
+	/** Returns a function that calculates the result of this expression for all rows in a batch at once. Instead of
+	walking the expression tree for each row, the returned function evaluates each node in the tree for the whole batch
+	(column at a time), which allows arithmetic, comparisons and common string functions to run in tight loops. The rows
+	should have values in the order of `columns`. References to foreign columns evaluate to an invalid value. */
+	public final func compileBatch(columns: OrderedSet<Column>) -> CompiledBatchExpression {
+		let evaluator = self.batchEvaluator(columns: columns)
+		return { rows, inputValues in
+			return evaluator(TupleBatch(rows: rows), inputValues).values
+		}
+	}
+
+	/** Returns a function that evaluates this expression for a batch of rows (see compileBatch). The default
+	implementation evaluates the compiled expression row by row; subclasses override this to evaluate column at a time. */
+	internal func batchEvaluator(columns: OrderedSet<Column>) -> BatchEvaluator {
+		let compiled = self.compile(columns: columns)
+		return { source, inputValues in
+			return .values((0..<source.count).map { compiled(source.tuple($0), nil, inputValues?[$0]) })
+		}
+	}
 	
 	/** Returns a list of suggestions for applications of this expression on the given value (fromValue) that result in the
 	given 'to' value (or bring the value closer to the toValue). */
@@ -265,6 +300,16 @@ public final class Literal: Expression {
 	public override func apply(_ row: Row, foreign: Row?, inputValue: Value?) -> Value {
 		return value
 	}
+
+	public override func compile(columns: OrderedSet<Column>, foreignColumns: OrderedSet<Column>) -> CompiledExpression {
+		let value = self.value
+		return { _, _, _ in return value }
+	}
+
+	internal override func batchEvaluator(columns: OrderedSet<Column>) -> BatchEvaluator {
+		let value = self.value
+		return { source, _ in return .constant(value, count: source.count) }
+	}
 	
 	override class func suggest(_ fromValue: Expression?, toValue: Value, row: Row, inputValue: Value?, level: Int, job: Job?) -> [Expression] {
 		if fromValue == nil {
@@ -311,6 +356,19 @@ public class Identity: Expression {
 	public override func apply(_ row: Row, foreign: Row?, inputValue: Value?) -> Value {
 		return inputValue ?? Value.invalid
 	}
+
+	public override func compile(columns: OrderedSet<Column>, foreignColumns: OrderedSet<Column>) -> CompiledExpression {
+		return { _, _, inputValue in return inputValue ?? Value.invalid }
+	}
+
+	internal override func batchEvaluator(columns: OrderedSet<Column>) -> BatchEvaluator {
+		return { source, inputValues in
+			if let iv = inputValues {
+				return BatchColumn(iv)
+			}
+			return .constant(Value.invalid, count: source.count)
+		}
+	}
 	
 	public override func isEquivalentTo(_ expression: Expression) -> Bool {
 		return self.isEqual(expression)
@@ -438,6 +496,24 @@ public final class Comparison: Expression {
 		let right = first.apply(row, foreign: foreign, inputValue: nil)
 		return self.type.apply(left, right)
 	}
+
+	public override func compile(columns: OrderedSet<Column>, foreignColumns: OrderedSet<Column>) -> CompiledExpression {
+		let left = second.compile(columns: columns, foreignColumns: foreignColumns)
+		let right = first.compile(columns: columns, foreignColumns: foreignColumns)
+		let type = self.type
+		return { row, foreign, _ in
+			return type.apply(left(row, foreign, nil), right(row, foreign, nil))
+		}
+	}
+
+	internal override func batchEvaluator(columns: OrderedSet<Column>) -> BatchEvaluator {
+		let left = second.batchEvaluator(columns: columns)
+		let right = first.batchEvaluator(columns: columns)
+		let type = self.type
+		return { source, _ in
+			return type.apply(batch: left(source, nil), right(source, nil))
+		}
+	}
 	
 	override class func suggest(_ fromValue: Expression?, toValue: Value, row: Row, inputValue: Value?, level: Int, job: Job?) -> [Expression] {
 		var suggestions: [Expression] = []
@@ -618,6 +694,22 @@ public final class Call: Expression {
 		let vals = arguments.map({$0.apply(row, foreign: foreign, inputValue: inputValue)})
 		return self.type.apply(vals)
 	}
+
+	public override func compile(columns: OrderedSet<Column>, foreignColumns: OrderedSet<Column>) -> CompiledExpression {
+		let compiledArguments = arguments.map { $0.compile(columns: columns, foreignColumns: foreignColumns) }
+		let type = self.type
+		return { row, foreign, inputValue in
+			return type.apply(compiledArguments.map { $0(row, foreign, inputValue) })
+		}
+	}
+
+	internal override func batchEvaluator(columns: OrderedSet<Column>) -> BatchEvaluator {
+		let argumentEvaluators = arguments.map { $0.batchEvaluator(columns: columns) }
+		let type = self.type
+		return { source, inputValues in
+			return type.apply(batch: argumentEvaluators.map { $0(source, inputValues) }, count: source.count)
+		}
+	}
 	
 	public override func isEquivalentTo(_ expression: Expression) -> Bool {
 		if let otherFunction = expression as? Call {
@@ -765,6 +857,20 @@ public final class Sibling: Expression, ColumnReferencingExpression {
 	public override func apply(_ row: Row, foreign: Row?, inputValue: Value?) -> Value {
 		return row[column] ?? Value.invalid
 	}
+
+	public override func compile(columns: OrderedSet<Column>, foreignColumns: OrderedSet<Column>) -> CompiledExpression {
+		if let index = columns.firstIndex(of: self.column) {
+			return { row, _, _ in return index < row.count ? row[index] : Value.invalid }
+		}
+		return { _, _, _ in return Value.invalid }
+	}
+
+	internal override func batchEvaluator(columns: OrderedSet<Column>) -> BatchEvaluator {
+		if let index = columns.firstIndex(of: self.column) {
+			return { source, _ in return source.column(index) }
+		}
+		return { source, _ in return .constant(Value.invalid, count: source.count) }
+	}
 	
 	override class func suggest(_ fromValue: Expression?, toValue: Value, row: Row, inputValue: Value?, level: Int, job: Job?) -> [Expression] {
 		var s: [Expression] = []
@@ -835,6 +941,18 @@ public final class Foreign: Expression, ColumnReferencingExpression {
 	public override func apply(_ row: Row, foreign: Row?, inputValue: Value?) -> Value {
 		return foreign?[column] ?? Value.invalid
 	}
+
+	public override func compile(columns: OrderedSet<Column>, foreignColumns: OrderedSet<Column>) -> CompiledExpression {
+		if let index = foreignColumns.firstIndex(of: self.column) {
+			return { _, foreign, _ in
+				if let f = foreign, index < f.count {
+					return f[index]
+				}
+				return Value.invalid
+			}
+		}
+		return { _, _, _ in return Value.invalid }
+	}
 	
 	override class func suggest(_ fromValue: Expression?, toValue: Value, row: Row, inputValue: Value?, level: Int, job: Job?) -> [Expression] {
 		// TODO: implement when we are going to implement foreign suggestions
@@ -2017,6 +2017,12 @@ private struct AverageReducer: Reducer {
 		}
 	}
 
+	mutating func merge(_ other: Reducer) {
+		let o = other as! AverageReducer
+		self.count += o.count
+		self.total = self.total + o.total
+	}
+
 	var result: Value { return self.total / Value(self.count) }
 }
 
@@ -2027,6 +2033,10 @@ private struct ListReducer: Reducer {
 	mutating func add(_ values: [Value]) {
 		self.list.append(contentsOf: values)
 	}
+
+	mutating func merge(_ other: Reducer) {
+		self.list.append(contentsOf: (other as! ListReducer).list)
+	}
 }
 
 private struct SumReducer: Reducer {
@@ -2040,6 +2050,10 @@ private struct SumReducer: Reducer {
 			}
 		}
 	}
+
+	mutating func merge(_ other: Reducer) {
+		self.result = self.result + (other as! SumReducer).result
+	}
 }
 
 private struct MaxReducer: Reducer {
@@ -2052,6 +2066,10 @@ private struct MaxReducer: Reducer {
 			}
 		}
 	}
+
+	mutating func merge(_ other: Reducer) {
+		self.add([(other as! MaxReducer).result])
+	}
 }
 
 private struct MinReducer: Reducer {
@@ -2064,6 +2082,10 @@ private struct MinReducer: Reducer {
 			}
 		}
 	}
+
+	mutating func merge(_ other: Reducer) {
+		self.add([(other as! MinReducer).result])
+	}
 }
 
 private struct CountReducer: Reducer {
@@ -2088,6 +2110,12 @@ private struct CountReducer: Reducer {
 		}
 	}
 
+	mutating func merge(_ other: Reducer) {
+		let o = other as! CountReducer
+		assert(o.all == self.all, "cannot merge different kinds of count reducers")
+		self.count += o.count
+	}
+
 	var result: Value {
 		return Value(self.count)
 	}
@@ -2101,6 +2129,10 @@ private struct ConcatenationReducer: Reducer {
 			result = result & a
 		}
 	}
+
+	mutating func merge(_ other: Reducer) {
+		self.result = self.result & (other as! ConcatenationReducer).result
+	}
 }
 
 private struct PackReducer: Reducer {
@@ -2112,6 +2144,10 @@ private struct PackReducer: Reducer {
 		}
 	}
 
+	mutating func merge(_ other: Reducer) {
+		self.pack = Pack(self.pack.items + (other as! PackReducer).pack.items)
+	}
+
 	var result: Value {
 		return Value(pack.stringValue)
 	}
@@ -2128,6 +2164,10 @@ private struct CountDistinctReducer: Reducer {
 		}
 	}
 
+	mutating func merge(_ other: Reducer) {
+		self.valueSet.formUnion((other as! CountDistinctReducer).valueSet)
+	}
+
 	var result: Value {
 		return Value(valueSet.count)
 	}
@@ -2152,6 +2192,10 @@ private struct MedianReducer: Reducer {
 		self.values += values.filter { return $0.isValid && !$0.isEmpty }
 	}
 
+	mutating func merge(_ other: Reducer) {
+		self.values += (other as! MedianReducer).values
+	}
+
 	var result: Value {
 		let sorted = values.sorted(by: { return $0 < $1 })
 		let count = sorted.count
@@ -2217,6 +2261,17 @@ private struct VarianceReducer: Reducer {
 		}
 	}
 
+	mutating func merge(_ other: Reducer) {
+		let o = other as! VarianceReducer
+		if o.invalid {
+			self.invalid = true
+			self.values = []
+		}
+		else if !self.invalid {
+			self.values += o.values
+		}
+	}
+
 	var result: Value {
 		if self.invalid {
 			return Value.invalid
@@ -2257,6 +2312,10 @@ private struct StandardDeviationReducer: Reducer {
 		self.varianceReducer.add(values)
 	}
 
+	mutating func merge(_ other: Reducer) {
+		self.varianceReducer.merge((other as! StandardDeviationReducer).varianceReducer)
+	}
+
 	var result: Value {
 		let r = varianceReducer.result
 
@@ -16,10 +16,10 @@ import Foundation
 
 internal typealias Filter = (Raster, Job?, Int) -> (Raster)
 
-/** Raster represents a mutable, in-memory dataset. It is stored as a simple array of Row, which in turn is an array 
-of Value. Column names are stored separately. Each Row should contain the same number of values as there are columns
-in the columns array. However, if rows are shorter, Raster will act as if there is a Value.empty in its
-place. 
+/** Raster represents a mutable, in-memory dataset. It is stored either as a simple array of Row, which in turn is an
+array of Value, or column by column in a ColumnarRaster (see `columnar`). Column names are stored separately. Each Row
+should contain the same number of values as there are columns in the columns array. However, if rows are shorter, Raster
+will act as if there is a Value.empty in its place.
 
 Raster is pedantic. It will assert and cause fatal errors on misuse, e.g. if a modification attempt is made to a read-
 only raster, or when a non-existent column is referenced. Users of Raster should check for these two conditions before
@@ -29,11 +29,22 @@ Raster data can only be modified if it was created with the `readOnly` flag set
 serially (i.e. Raster holds a mutex) and are atomic. To make multiple changes atomically, start holding the `mutex`
 before performing the first change and release it after performing the last (e.g. use raster.mutex.locked {...}). */
 public class Raster: NSObject, NSCoding {
-	internal var raster: [[Value]] = []
+	/** The rows of this raster, when it is stored row by row (i.e. `columnar` is nil). */
+	private var rowStorage: [[Value]] = []
+
+	/** The contents of this raster, when it is stored column by column. Large results (such as the complete result of a
+	stream, see StreamDataset.raster) are stored this way, as typed and dictionary-encoded column buffers use far less
+	memory than rows of boxed values. Reading does not change the storage; the first modification converts the raster
+	to row storage (see thaw). */
+	internal private(set) var columnar: ColumnarRaster? = nil
+
 	public internal(set) var columns: OrderedSet<Column> = []
 
 	public var rows: AnyRandomAccessCollection<Row> {
-		return AnyRandomAccessCollection(self.raster.lazy.map { return Row($0, columns: self.columns) })
+		if let c = self.columnar {
+			return AnyRandomAccessCollection((0..<c.rowCount).lazy.map { return Row(c.tuple($0), columns: self.columns) })
+		}
+		return AnyRandomAccessCollection(self.rowStorage.lazy.map { return Row($0, columns: self.columns) })
 	}
 
 	// FIXME: use a read-write lock to allow concurrent reads, but still provide safety
@@ -47,17 +58,24 @@ public class Raster: NSObject, NSCoding {
 	}
 	
 	public init(data: [[Value]], columns: OrderedSet<Column>, readOnly: Bool = false) {
-		self.raster = data
+		self.rowStorage = data
 		self.columns = columns
 		self.readOnly = readOnly
 		super.init()
 
 		assert(self.verify(), "raster is invalid")
 	}
+
+	public init(columnar: ColumnarRaster, readOnly: Bool = false) {
+		self.columnar = columnar
+		self.columns = columnar.columns
+		self.readOnly = readOnly
+		super.init()
+	}
 	
 	public required init?(coder aDecoder: NSCoder) {
 		let codedRaster = (aDecoder.decodeObject(forKey: "raster") as? [[ValueCoder]]) ?? []
-		raster = codedRaster.map({$0.map({return $0.value})})
+		rowStorage = codedRaster.map({$0.map({return $0.value})})
 		
 		let saveColumns = aDecoder.decodeObject(forKey: "columns") as? [String] ?? []
 		columns = OrderedSet(saveColumns.map({return Column($0)}))
@@ -66,7 +84,40 @@ public class Raster: NSObject, NSCoding {
 
 	public func clone(_ readOnly: Bool) -> Raster {
 		return self.mutex.locked {
-			return Raster(data: self.raster, columns: self.columns, readOnly: readOnly)
+			if readOnly, let c = self.columnar {
+				return Raster(columnar: c, readOnly: true)
+			}
+			return Raster(data: self.tuples, columns: self.columns, readOnly: readOnly)
+		}
+	}
+
+	/** All rows of this raster. For a raster in columnar storage, the rows are materialized on each access, so callers
+	should read this only once. */
+	internal var tuples: [Tuple] {
+		return self.mutex.locked {
+			if let c = self.columnar {
+				return (0..<c.rowCount).map { c.tuple($0) }
+			}
+			return self.rowStorage
+		}
+	}
+
+	/** The rows in the indicated range. */
+	internal func tuples(_ range: Range<Int>) -> [Tuple] {
+		return self.mutex.locked {
+			if let c = self.columnar {
+				return range.map { c.tuple($0) }
+			}
+			return Array(self.rowStorage[range])
+		}
+	}
+
+	/** Converts a raster in columnar storage to row storage, so that it can be modified. Must be called while holding
+	the mutex. */
+	fileprivate func thaw() {
+		if let c = self.columnar {
+			self.rowStorage = (0..<c.rowCount).map { c.tuple($0) }
+			self.columnar = nil
 		}
 	}
 
@@ -79,7 +130,7 @@ public class Raster: NSObject, NSCoding {
 		}
 
 		// Each raster row must contain the same number of values
-		for r in raster {
+		for r in rowStorage {
 			if r.count != columnCount {
 				return false
 			}
@@ -89,13 +140,13 @@ public class Raster: NSObject, NSCoding {
 	
 	public var isEmpty: Bool {
 		return self.mutex.locked {
-			return raster.count==0
+			return self.rowCount == 0
 		}
 	}
 	
 	public func encode(with aCoder: NSCoder) {
 		self.mutex.locked {
-			let saveValues = raster.map({return $0.map({return ValueCoder($0)})})
+			let saveValues = self.tuples.map({return $0.map({return ValueCoder($0)})})
 			aCoder.encode(saveValues, forKey: "raster")
 			
 			let saveColumns = columns.map({return $0.name})
@@ -107,7 +158,8 @@ public class Raster: NSObject, NSCoding {
 	public func removeRows(_ set: IndexSet) {
 		self.mutex.locked {
 			assert(!readOnly, "Dataset set is read-only")
-			self.raster.removeObjectsAtIndexes(set, offset: 0)
+			self.thaw()
+			self.rowStorage.removeObjectsAtIndexes(set, offset: 0)
 		}
 	}
 
@@ -119,7 +171,8 @@ public class Raster: NSObject, NSCoding {
 				}
 			}
 
-			self.raster = self.raster.filter { row in
+			self.thaw()
+			self.rowStorage = self.rowStorage.filter { row in
 				for key in keysByNumber {
 					var matches = true
 					// If any key does not match, we keep the row. Otherwise it must be removed
@@ -143,10 +196,11 @@ public class Raster: NSObject, NSCoding {
 	public func removeColumns(_ set: IndexSet) {
 		self.mutex.locked {
 			assert(!readOnly, "Dataset set is read-only")
+			self.thaw()
 			columns.subtract(Set(set.map { return self.columns[$0] }))
 			
-			for i in 0..<raster.count {
-				raster[i].removeObjectsAtIndexes(set, offset: 0)
+			for i in 0..<rowStorage.count {
+				rowStorage[i].removeObjectsAtIndexes(set, offset: 0)
 			}
 		}
 	}
@@ -154,39 +208,41 @@ public class Raster: NSObject, NSCoding {
 	public func addColumns(_ names: OrderedSet<Column>) {
 		self.mutex.locked {
 			assert(!readOnly, "Dataset set is read-only")
+			self.thaw()
 			let oldCount = self.columns.count
 			let newColumns = names.filter { !self.columns.contains($0) }
 			self.columns.append(contentsOf: newColumns)
 			let template = Array<Value>(repeating: Value.empty, count: newColumns.count)
 
-			for rowIndex in 0..<raster.count {
-				let cellCount = raster[rowIndex].count
+			for rowIndex in 0..<rowStorage.count {
+				let cellCount = rowStorage[rowIndex].count
 				if cellCount == oldCount {
-					raster[rowIndex].append(contentsOf: template)
+					rowStorage[rowIndex].append(contentsOf: template)
 				}
 				else if cellCount > oldCount {
 					// Cut off at the old count
-					var oldRow = Array(raster[rowIndex][0..<oldCount])
+					var oldRow = Array(rowStorage[rowIndex][0..<oldCount])
 					oldRow.append(contentsOf: template)
-					raster[rowIndex] = oldRow
+					rowStorage[rowIndex] = oldRow
 				}
 				else if cellCount < oldCount {
 					let largerTemplate = Array<Value>(repeating: Value.empty, count: newColumns.count)
-					raster[rowIndex].append(contentsOf: largerTemplate)
+					rowStorage[rowIndex].append(contentsOf: largerTemplate)
 				}
 			}
 		}
 	}
 
 	public var writableCopy: Raster {
-		return Raster(data: self.raster, columns: self.columns, readOnly: false)
+		return Raster(data: self.tuples, columns: self.columns, readOnly: false)
 	}
 
 	public func addRows(_ rows: [Tuple]) {
 		self.mutex.locked {
 			assert(!readOnly, "Dataset set is read-only")
 			self.mutex.locked {
-				raster.append(contentsOf: rows)
+				self.thaw()
+				rowStorage.append(contentsOf: rows)
 			}
 		}
 	}
@@ -195,7 +251,16 @@ public class Raster: NSObject, NSCoding {
 		self.mutex.locked {
 			assert(!readOnly, "Dataset set is read-only")
 			let row = Array<Value>(repeating: Value.empty, count: self.columns.count)
-			raster.append(row)
+			self.thaw()
+			rowStorage.append(row)
+		}
+	}
+
+	public func removeAllRows() {
+		self.mutex.locked {
+			assert(!readOnly, "Dataset set is read-only")
+			self.columnar = nil
+			self.rowStorage.removeAll()
 		}
 	}
 	
@@ -213,7 +278,7 @@ public class Raster: NSObject, NSCoding {
 	
 	public var rowCount: Int {
 		return self.mutex.locked {
-			return raster.count
+			return self.columnar?.rowCount ?? rowStorage.count
 		}
 	}
 	
@@ -235,17 +300,24 @@ public class Raster: NSObject, NSCoding {
 	public subscript(row: Int) -> Row {
 		return self.mutex.locked {
 			assert(row < rowCount)
-			return Row(raster[row], columns: self.columns)
+			if let c = self.columnar {
+				return Row(c.tuple(row), columns: self.columns)
+			}
+			return Row(rowStorage[row], columns: self.columns)
 		}
 	}
 	
 	public subscript(row: Int, col: Int) -> Value! {
 		return self.mutex.locked {
-			if row >= self.raster.count || col >= self.columns.count {
+			if row >= self.rowCount || col >= self.columns.count {
 				return nil
 			}
+
+			if let c = self.columnar {
+				return c[row, col]
+			}
 			
-			let rowDataset = raster[row]
+			let rowDataset = rowStorage[row]
 			if(col >= rowDataset.count) {
 				return .empty
 			}
@@ -263,8 +335,9 @@ public class Raster: NSObject, NSCoding {
 			assert(!readOnly, "Dataset set is read-only")
 			
 			if let col = indexOfColumnWithName(forColumn) {
-				if ifMatches == nil || raster[row][col] == ifMatches! || (!raster[row][col].isValid && !ifMatches!.isValid) {
-					raster[row][col] = value
+				self.thaw()
+				if ifMatches == nil || rowStorage[row][col] == ifMatches! || (!rowStorage[row][col].isValid && !ifMatches!.isValid) {
+					rowStorage[row][col] = value
 					return true
 				}
 				else {
@@ -286,9 +359,10 @@ public class Raster: NSObject, NSCoding {
 			})
 
 			let columnIndex = self.indexOfColumnWithName(column)!
+			self.thaw()
 
 			for rowIndex in  0..<rowCount {
-				var row = raster[rowIndex]
+				var row = rowStorage[rowIndex]
 
 				// Does this row match the key?
 				var match = true
@@ -306,7 +380,7 @@ public class Raster: NSObject, NSCoding {
 				if row[columnIndex] == old {
 					// Old value matches, we should change it to the new value
 					row[columnIndex] = new
-					raster[rowIndex] = row
+					rowStorage[rowIndex] = row
 					changes += 1
 				}
 				else {
@@ -418,10 +492,12 @@ public class Raster: NSObject, NSCoding {
 			rightIndicesInResult.forEach({rightIndicesInResultSet.add($0)})
 			
 			// Build the hash map of the foreign table
+			let rightExpression = comparison.rightExpression.prepare().compile(columns: rightColumns)
+			let leftExpression = comparison.leftExpression.prepare().compile(columns: self.columns)
+			let rightRows = rightRaster.tuples
 			var rightHash: [Value: [Int]] = [:]
-			for rowNumber in 0..<rightRaster.raster.count {
-				let row = Row(rightRaster.raster[rowNumber], columns: rightColumns)
-				let hash = comparison.rightExpression.apply(row, foreign: nil, inputValue: nil)
+			for rowNumber in 0..<rightRows.count {
+				let hash = rightExpression(rightRows[rowNumber], nil, nil)
 				if let existing = rightHash[hash] {
 					rightHash[hash] = existing + [rowNumber]
 				}
@@ -431,21 +507,20 @@ public class Raster: NSObject, NSCoding {
 			}
 			
 			// Iterate over the rows on the left side and join rows from the right side using the hash table
-			let future = self.raster.parallel(
+			let future = self.tuples.parallel(
 				{ (chunk) -> ([Tuple]) in
 					var newDataset: [Tuple] = []
 					job.time("hashJoin", items: chunk.count, itemType: "rows") {
 						var myTemplateRow = templateRow
 						
 						for leftTuple in chunk {
-							let leftRow = Row(leftTuple, columns: self.columns)
-							let hash = comparison.leftExpression.apply(leftRow, foreign: nil, inputValue: nil)
+							let hash = leftExpression(leftTuple, nil, nil)
 							if let rightMatches = rightHash[hash] {
 								for rightRowNumber in rightMatches {
-									let rightRow = Row(rightRaster.raster[rightRowNumber], columns: rightColumns)
+									let rightTuple = rightRows[rightRowNumber]
 									myTemplateRow.values.removeAll(keepingCapacity: true)
-									myTemplateRow.values.append(contentsOf: leftRow.values)
-									myTemplateRow.values.append(contentsOf: rightRow.values.objectsAtIndexes(rightIndicesInResultSet as IndexSet))
+									myTemplateRow.values.append(contentsOf: leftTuple)
+									myTemplateRow.values.append(contentsOf: rightTuple.objectsAtIndexes(rightIndicesInResultSet as IndexSet))
 									newDataset.append(myTemplateRow.values)
 								}
 							}
@@ -454,7 +529,7 @@ public class Raster: NSObject, NSCoding {
 								is a left (non-inner) join */
 								if !inner {
 									myTemplateRow.values.removeAll(keepingCapacity: true)
-									myTemplateRow.values.append(contentsOf: leftRow.values)
+									myTemplateRow.values.append(contentsOf: leftTuple)
 									rightIndicesInResult.forEach({(Int) -> () in myTemplateRow.values.append(Value.empty)})
 									newDataset.append(myTemplateRow.values)
 								}
@@ -463,12 +538,9 @@ public class Raster: NSObject, NSCoding {
 					}
 					return newDataset
 				},
-				reduce: { (a: [Tuple], b: [Tuple]?) -> ([Tuple]) in
-					if let br = b {
-						return br + a
-					}
-					return a
-			})
+				combine: { (a: [Tuple], b: [Tuple]) -> [Tuple] in
+					return a + b
+				})
 			
 			future.get(job) { (newDataset: [Tuple]?) -> () in
 				callback(Raster(data: newDataset ?? [], columns: templateRow.columns, readOnly: true))
@@ -488,27 +560,25 @@ public class Raster: NSObject, NSCoding {
 			rightIndicesInResult.forEach({rightIndicesInResultSet.add($0)})
 			
 			// Start joining rows
-			let joinExpression = expression.prepare()
+			let joinExpression = expression.prepare().compile(columns: self.columns, foreignColumns: rightColumns)
 			let templateRow = Row(Array<Value>(repeating: Value.invalid, count: self.columns.count + rightColumnsInResult.count), columns: self.columns + rightColumnsInResult)
 			
 			// Perform carthesian product (slow, so in parallel)
-			let future = self.raster.parallel(
+			let rightRows = rightRaster.tuples
+			let future = self.tuples.parallel(
 				{ (chunk) -> ([Tuple]) in
 					var newDataset: [Tuple] = []
 					job.time("carthesianProduct", items: chunk.count * rightRaster.rowCount, itemType: "pairs") {
 						var myTemplateRow = templateRow
 						
 						for leftTuple in chunk {
-							let leftRow = Row(leftTuple, columns: self.columns)
 							var foundRightMatch = false
 							
-							for rightTuple in rightRaster.raster {
-								let rightRow = Row(rightTuple, columns: rightColumns)
-								
-								if joinExpression.apply(leftRow, foreign: rightRow, inputValue: nil) == Value.bool(true) {
+							for rightTuple in rightRows {
+								if joinExpression(leftTuple, rightTuple, nil) == Value.bool(true) {
 									myTemplateRow.values.removeAll(keepingCapacity: true)
-									myTemplateRow.values.append(contentsOf: leftRow.values)
-									myTemplateRow.values.append(contentsOf: rightRow.values.objectsAtIndexes(rightIndicesInResultSet as IndexSet))
+									myTemplateRow.values.append(contentsOf: leftTuple)
+									myTemplateRow.values.append(contentsOf: rightTuple.objectsAtIndexes(rightIndicesInResultSet as IndexSet))
 									newDataset.append(myTemplateRow.values)
 									foundRightMatch = true
 								}
@@ -518,7 +588,7 @@ public class Raster: NSObject, NSCoding {
 							is a left (non-inner) join */
 							if !inner && !foundRightMatch {
 								myTemplateRow.values.removeAll(keepingCapacity: true)
-								myTemplateRow.values.append(contentsOf: leftRow.values)
+								myTemplateRow.values.append(contentsOf: leftTuple)
 								rightIndicesInResult.forEach({(Int) -> () in myTemplateRow.values.append(Value.empty)})
 								newDataset.append(myTemplateRow.values)
 							}
@@ -526,11 +596,8 @@ public class Raster: NSObject, NSCoding {
 					}
 					return newDataset
 				},
-				reduce: { (a: [Tuple], b: [Tuple]?) -> ([Tuple]) in
-					if let br = b {
-						return br + a
-					}
-					return a
+				combine: { (a: [Tuple], b: [Tuple]) -> [Tuple] in
+					return a + b
 				})
 			
 			future.get(job) { (newDataset: [Tuple]?) -> () in
@@ -695,6 +762,10 @@ public class RasterDataset: NSObject, Dataset {
 	
 	public func selectColumns(_ columns: OrderedSet<Column>) -> Dataset {
 		return apply("selectColumns") {(r: Raster, job, progressKey) -> Raster in
+			if let c = r.columnar {
+				return Raster(columnar: c.selectColumns(columns), readOnly: true)
+			}
+
 			var indexesToKeep: [Int] = []
 			var namesToKeep: [Column] = []
 			
@@ -740,12 +811,19 @@ public class RasterDataset: NSObject, Dataset {
 	
 	public func unique(_ expression: Expression, job: Job, callback: @escaping (Fallible<Set<Value>>) -> ()) {
 		self.raster(job, callback: { (raster) -> () in
-			callback(raster.use({(r) in Set<Value>(r.raster.map({expression.apply(Row($0, columns: r.columns), foreign: nil, inputValue: nil)}))}))
+			callback(raster.use({(r) in
+				let compiledExpression = expression.prepare().compile(columns: r.columns)
+				return Set<Value>(r.tuples.map({ compiledExpression($0, nil, nil) }))
+			}))
 		})
 	}
 	
 	public func limit(_ numberOfRows: Int) -> Dataset {
 		return apply("limit") {(r: Raster, job, progressKey) -> Raster in
+			if let c = r.columnar {
+				return Raster(columnar: c.slice(0..<max(0, numberOfRows)), readOnly: true)
+			}
+
 			var newDataset: [[Value]] = []
 			
 			let resultingNumberOfRows = min(numberOfRows, r.rowCount)
@@ -785,7 +863,7 @@ public class RasterDataset: NSObject, Dataset {
 				// Report progress
 				n += 1
 				if n % 100 == 0 {
-					job?.reportProgress(Double(n) / Double(r.raster.count), forKey: progressKey)
+					job?.reportProgress(Double(n) / Double(r.rowCount), forKey: progressKey)
 				}
 
 				return newRow.values
@@ -799,47 +877,17 @@ public class RasterDataset: NSObject, Dataset {
 		return apply("sort") {(r: Raster, job, progressKey) -> Raster in
 			let columns = r.columns
 			
-			let newDataset = r.raster.sorted(by: { (a, b) -> Bool in
-				// Return true if a comes before b
-				for order in by {
-					if let aValue = order.expression?.apply(Row(a, columns: columns), foreign: nil, inputValue: nil),
-						let bValue = order.expression?.apply(Row(b, columns: columns), foreign: nil, inputValue: nil) {
-						
-						if order.numeric {
-							if order.ascending && aValue < bValue {
-								return true
-							}
-							else if !order.ascending && bValue < aValue {
-								return true
-							}
-							if order.ascending && aValue > bValue {
-								return false
-							}
-							else if !order.ascending && bValue > aValue {
-								return false
-							}
-							else {
-								// Ordered same, let next order decide
-							}
-						}
-						else {
-							if let aString = aValue.stringValue, let bString = bValue.stringValue {
-								let res = aString.compare(bString)
-								if res == ComparisonResult.orderedAscending {
-									return order.ascending
-								}
-								else if res == ComparisonResult.orderedDescending {
-									return !order.ascending
-								}
-								else {
-									// Ordered same, let next order decide
-								}
-							}
-						}
-					}
-				}
-				return false
-			})
+			// Calculate the sort keys only once for each row
+			let comparator = SortKeyComparator(orders: by, columns: columns)
+			let rows = r.tuples
+			var keys: [Value] = []
+			keys.reserveCapacity(rows.count * comparator.keyCount)
+			for row in rows {
+				comparator.appendKeys(for: row, to: &keys)
+			}
+
+			let sortedIndices = comparator.sortedIndices(keys: keys, count: rows.count)
+			let newDataset = sortedIndices.map { rows[$0] }
 
 			// FIXME: more detailed progress reporting
 			job?.reportProgress(1.0, forKey: progressKey)
@@ -849,6 +897,10 @@ public class RasterDataset: NSObject, Dataset {
 
 	public func offset(_ numberOfRows: Int) -> Dataset {
 		return apply {(r: Raster, job, progressKey) -> Raster in
+			if let c = r.columnar {
+				return Raster(columnar: c.slice(max(0, numberOfRows)..<c.rowCount), readOnly: true)
+			}
+
 			var newDataset: [[Value]] = []
 			
 			let skipRows = min(numberOfRows, r.rowCount)
@@ -884,11 +936,16 @@ public class RasterDataset: NSObject, Dataset {
 		}
 
 		return apply { (r: Raster, job, progressKey) -> Raster in
+			if let c = r.columnar {
+				return Raster(columnar: c.filter(optimizedCondition), readOnly: true)
+			}
+
 			var newDataset: [Tuple] = []
+			let compiledCondition = optimizedCondition.compile(columns: r.columns)
 			
 			for rowNumber in 0..<r.rowCount {
 				let row = r[rowNumber]
-				if optimizedCondition.apply(row, foreign: nil, inputValue: nil) == Value.bool(true) {
+				if compiledCondition(row.values, nil, nil) == Value.bool(true) {
 					newDataset.append(row.values)
 				}
 
@@ -925,7 +982,7 @@ public class RasterDataset: NSObject, Dataset {
 					
 						// Fill in the data from the left side
 						let fillRight = Array<Value>(repeating: Value.empty, count: columns.count - leftRaster.columns.count)
-						for row in leftRaster.raster {
+						for row in leftRaster.tuples {
 							var rowClone = row
 							rowClone.append(contentsOf: fillRight)
 							newDataset.append(rowClone)
@@ -934,7 +991,7 @@ public class RasterDataset: NSObject, Dataset {
 						// Fill in data from the right side
 						let indices = rightRaster.columns.map({return columns.firstIndex(of: $0)})
 						let empty = Array<Value>(repeating: Value.empty, count: columns.count)
-						for row in rightRaster.raster {
+						for row in rightRaster.tuples {
 							var rowClone = empty
 							for sourceIndex in 0..<row.count {
 								if let destinationIndex = indices[sourceIndex] {
@@ -995,7 +1052,7 @@ public class RasterDataset: NSObject, Dataset {
 			var verticalGroups: Dictionary<HashableArray<Value>, Dictionary<HashableArray<Value>, [Value]> > = [:]
 			
 			// Group all rows to horizontal and vertical groups
-			r.raster.forEach({ (row) -> () in
+			r.tuples.forEach({ (row) -> () in
 				let verticalGroup = HashableArray(verticalIndexes.map({$0 == nil ? Value.invalid : row[$0!]}))
 				let horizontalGroup = HashableArray(horizontalIndexes.map({$0 == nil ? Value.invalid : row[$0!]}))
 				horizontalGroups.insert(horizontalGroup)
@@ -1053,7 +1110,7 @@ public class RasterDataset: NSObject, Dataset {
 		return apply {(r: Raster, job, progressKey) -> Raster in
 			var newDataset: Set<HashableArray<Value>> = []
 			var rowNumber = 0
-			r.raster.forEach {
+			r.tuples.forEach {
 				newDataset.insert(HashableArray<Value>($0))
 				rowNumber += 1
 				if (rowNumber % Raster.progressReportRowInterval) == 0 {
@@ -1190,16 +1247,20 @@ public class RasterMutableDataset: MutableDataset {
 	public func performMutation(_ mutation: DatasetMutation, job: Job, callback: @escaping (Fallible<Void>) -> ()) {
 		switch mutation {
 		case .truncate:
-			self.raster.raster.removeAll()
+			self.raster.removeAllRows()
 			callback(.success(()))
 
 		case .rename(let mapping):
-			self.raster.columns = OrderedSet(self.raster.columns.map { cn -> Column in
-				if let newName = mapping[cn] {
-					return newName
-				}
-				return cn
-			})
+			self.raster.mutex.locked {
+				// Columnar storage holds its own column names
+				self.raster.thaw()
+				self.raster.columns = OrderedSet(self.raster.columns.map { cn -> Column in
+					if let newName = mapping[cn] {
+						return newName
+					}
+					return cn
+				})
+			}
 			callback(.success(()))
 
 		case .alter(let def):
@@ -1276,6 +1337,7 @@ private class RasterDatasetStream: NSObject, Stream {
 	private var raster: Future<Fallible<Raster>>
 	private var position = 0
 	private let mutex = Mutex()
+	private let sizer = BatchSizer()
 	
 	init(_ data: RasterDataset) {
 		self.data = data
@@ -1306,9 +1368,11 @@ private class RasterDatasetStream: NSObject, Stream {
 						}
 
 						if self.position < raster.rowCount {
-							let end = min(raster.rowCount, self.position + StreamDefaultBatchSize)
-							let rows = Array(raster.raster[self.position..<end])
-							self.position = end
+							let rows = self.sizer.batch { size in
+								let end = min(raster.rowCount, self.position + size)
+								return raster.tuples(self.position..<end)
+							}
+							self.position += rows.count
 							let hasNext = self.position < raster.rowCount
 							return (rows, hasNext)
 						}
@@ -1351,50 +1415,3 @@ private func ==<T>(lhs: HashableArray<T>, rhs: HashableArray<T>) -> Bool {
 	
 	return true
 }
-
-/** A catalog is a tree where each node is a particular aggregation group label. The first aggregation group defines the
-first level in the tree, the second group is the second level, et cetera. Values are stored at the leafs and are 'reduced' 
-at the end, producing a value for each possible group label combination.
-
-Each leaf has its own Mutex protecting the leaf from concurrent modification. By recursively obtaining a lock, parallel
-work can be done on different 'branches' of the tree at the same time. **/
-internal class Catalog<ValueType>: NSObject {
-	let mutex = Mutex()
-	var children = Dictionary<Value, Catalog<ValueType>>()
-	var values: [Column: ValueType]? = nil
-
-	final func leafForRow(_ row: Row, groups: [Expression]) -> Catalog {
-		var currentCatalog = self
-
-		for groupExpression in groups {
-			let groupValue = groupExpression.apply(row, foreign: nil, inputValue: nil)
-
-			currentCatalog.mutex.locked {
-				if let nextIndex = currentCatalog.children[groupValue] {
-					currentCatalog = nextIndex
-				}
-				else {
-					let nextIndex = Catalog()
-					currentCatalog.children[groupValue] = nextIndex
-					currentCatalog = nextIndex
-				}
-			}
-		}
-
-		return currentCatalog
-	}
-
-	final func visit(_ path: [Value] = [], block: ([Value], [Column: ValueType]) -> ()) {
-		self.mutex.locked {
-			if let v = values {
-				block(path, v)
-			}
-			else {
-				for (val, index) in children {
-					let newPath = path + [val]
-					index.visit(newPath, block: block)
-				}
-			}
-		}
-	}
-}
@@ -132,6 +132,28 @@ public protocol SQLConnection {
 	database, wrapping in a transaction is possible by issuing 'BEGIN'  and 'COMMIT'  commands. Whenever an
 	error is encountered, no further query processing should happen. */
 	func run(_ sql: [String], job: Job, callback: (Fallible<Void>) -> ())
+
+	/** Returns a loader that appends rows to the indicated table more efficiently than separate INSERT statements (e.g.
+	using a bulk loading protocol), or nil when the database does not support this. The rows passed to the loader have
+	values for the indicated columns, in that order. */
+	func bulkLoader(table: String, schema: String?, columns: [Column], job: Job) -> SQLBulkLoader?
+}
+
+public extension SQLConnection {
+	func bulkLoader(table: String, schema: String?, columns: [Column], job: Job) -> SQLBulkLoader? {
+		return nil
+	}
+}
+
+/** Loads rows into a table in batches (see SQLConnection.bulkLoader). Batches are appended in the order in which append
+is called. Loaders may send a batch to the database while the next is being prepared; the callback of append may be
+called before the rows have actually been written, in which case any error is reported by the callback of a later call
+to append or finish. */
+public protocol SQLBulkLoader {
+	func append(_ rows: [Tuple], job: Job, callback: @escaping (Fallible<Void>) -> ())
+
+	/** Completes loading. The callback is called once all rows have been written (or an error occurred). */
+	func finish(_ job: Job, callback: @escaping (Fallible<Void>) -> ())
 }
 
 open class SQLWarehouse: Warehouse {
@@ -227,13 +249,15 @@ private class SQLInsertPuller: StreamPuller {
 	private let insertStatement: String
 	private let connection: SQLConnection
 	private let database: SQLDatabase
+	private let loader: SQLBulkLoader?
 
-	init(stream: Stream, job: Job, columns: OrderedSet<Column>, mapping: ColumnMapping, insertStatement: String, connection: SQLConnection, database: SQLDatabase, callback: ((Fallible<Void>) -> ())?) {
+	init(stream: Stream, job: Job, columns: OrderedSet<Column>, mapping: ColumnMapping, insertStatement: String, connection: SQLConnection, database: SQLDatabase, loader: SQLBulkLoader?, callback: ((Fallible<Void>) -> ())?) {
 		self.callback = callback
 		self.columns = columns
 		self.insertStatement = insertStatement
 		self.connection = connection
 		self.database = database
+		self.loader = loader
 
 		self.fastMapping = mapping.keys.map { targetField -> Int? in
 			if let sourceFieldName = mapping[targetField] {
@@ -249,7 +273,20 @@ private class SQLInsertPuller: StreamPuller {
 
 	override func onReceiveRows(_ rows: [Tuple], callback: @escaping (Fallible<Void>) -> ()) {
 		self.mutex.locked {
-			if !rows.isEmpty {
+			if let loader = self.loader {
+				if !rows.isEmpty {
+					let mapped = rows.map { row in
+						return fastMapping.map { idx -> Value in
+							return idx != nil ? row[idx!] : Value.empty
+						}
+					}
+					loader.append(mapped, job: job, callback: callback)
+				}
+				else {
+					callback(.success(()))
+				}
+			}
+			else if !rows.isEmpty {
 				let values = rows.map { row in
 					let tuple = fastMapping.map { idx -> String in
 						if let i = idx {
@@ -283,8 +320,18 @@ private class SQLInsertPuller: StreamPuller {
 		self.mutex.locked {
 			let cb = self.callback!
 			self.callback = nil
-			self.job.async {
-				cb(.success(()))
+
+			if let loader = self.loader {
+				loader.finish(self.job) { result in
+					self.job.async {
+						cb(result)
+					}
+				}
+			}
+			else {
+				self.job.async {
+					cb(.success(()))
+				}
 			}
 		}
 	}
@@ -368,7 +415,8 @@ open class SQLMutableDataset: MutableDataset {
 			switch columnsFallible {
 			case .success(let sourceColumnNames):
 				let stream = data.stream()
-				let puller = SQLInsertPuller(stream: stream, job: job, columns: sourceColumnNames, mapping: mapping, insertStatement: insertStatement, connection: connection, database: self.database, callback: callback)
+				let loader = connection.bulkLoader(table: self.tableName, schema: self.schemaName, columns: Array(mapping.keys), job: job)
+				let puller = SQLInsertPuller(stream: stream, job: job, columns: sourceColumnNames, mapping: mapping, insertStatement: insertStatement, connection: connection, database: self.database, loader: loader, callback: callback)
 				puller.start()
 
 			case .failure(let e):
@@ -1597,7 +1645,7 @@ open class SQLDataset: NSObject, Dataset {
 			
 			data.raster(job) { (raster) -> () in
 				callback(raster.use { r in
-					return Set<Value>(r.raster.map({$0[0]}))
+					return Set<Value>(r.tuples.map({$0[0]}))
 				})
 			}
 		}
@@ -0,0 +1,993 @@
+/* Copyright (c) 2014-2016 Pixelspark, Tommy van der Vorst
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+import Foundation
+
+/** The default amount of memory (in bytes) that ExternalSortStream will use to buffer rows before it sorts them and
+writes them to disk. */
+public let SortDefaultMemoryBudget = 128 * 1024 * 1024
+
+/** Calculates sort keys for rows and compares rows by their sort keys. The keys of a row are calculated only once; for
+a set of rows, keys are stored in a single flat array (keyCount values per row). Orders without an expression do not
+participate in sorting. */
+internal struct SortKeyComparator {
+	let orders: [Order]
+	private let expressions: [CompiledExpression]
+
+	init(orders: [Order], columns: OrderedSet<Column>) {
+		let effectiveOrders = orders.filter { $0.expression != nil }
+		self.orders = effectiveOrders
+		self.expressions = effectiveOrders.map { $0.expression!.prepare().compile(columns: columns) }
+	}
+
+	var keyCount: Int {
+		return self.orders.count
+	}
+
+	/** Appends the sort keys for the given row to the key array. */
+	func appendKeys(for row: Tuple, to keys: inout [Value]) {
+		for expression in self.expressions {
+			keys.append(expression(row, nil, nil))
+		}
+	}
+
+	/** Compares two rows given their sort keys (each slice should contain keyCount values). */
+	func compare(_ a: ArraySlice<Value>, _ b: ArraySlice<Value>) -> ComparisonResult {
+		var ai = a.startIndex, bi = b.startIndex
+		for order in self.orders {
+			let result = order.compare(a[ai], b[bi])
+			if result != .orderedSame {
+				return result
+			}
+			ai += 1
+			bi += 1
+		}
+		return .orderedSame
+	}
+
+	/** Returns the indices of the rows in sorted order, given the flat array of keys for the rows. Rows that sort the
+	same keep their original relative order. */
+	func sortedIndices(keys: [Value], count: Int) -> [Int] {
+		let k = self.keyCount
+		if k == 0 {
+			return Array(0..<count)
+		}
+
+		return (0..<count).sorted(by: { (a, b) -> Bool in
+			switch self.compare(keys[(a * k)..<((a + 1) * k)], keys[(b * k)..<((b + 1) * k)]) {
+			case .orderedAscending: return true
+			case .orderedDescending: return false
+			case .orderedSame: return a < b
+			}
+		})
+	}
+}
+
+/** Keeps the first `limit` rows (in sort order) out of all rows added to it, using a bounded binary heap. The heap root
+is the row that sorts last among the kept rows, so that a new row can be rejected with a single comparison once the heap
+is full. Rows that sort the same are kept in the order of their sequence numbers. */
+internal final class TopKHeap {
+	let comparator: SortKeyComparator
+	let limit: Int
+	private var entries: [(keys: [Value], row: Tuple, sequence: Int)] = []
+
+	init(comparator: SortKeyComparator, limit: Int) {
+		self.comparator = comparator
+		self.limit = limit
+		self.entries.reserveCapacity(limit)
+	}
+
+	/** Adds a row, given its sort keys and a sequence number that indicates its original position. */
+	func add(keys: ArraySlice<Value>, row: Tuple, sequence: Int) {
+		if self.limit <= 0 {
+			return
+		}
+
+		if self.entries.count < self.limit {
+			self.entries.append((keys: Array(keys), row: row, sequence: sequence))
+			self.siftUp(self.entries.count - 1)
+		}
+		else if self.precedes(keys, sequence, self.entries[0].keys[...], self.entries[0].sequence) {
+			self.entries[0] = (keys: Array(keys), row: row, sequence: sequence)
+			self.siftDown(0)
+		}
+	}
+
+	/** Adds all rows kept by another heap to this heap. */
+	func merge(_ other: TopKHeap) {
+		for entry in other.entries {
+			self.add(keys: entry.keys[...], row: entry.row, sequence: entry.sequence)
+		}
+	}
+
+	/** The rows kept, in sort order. */
+	var sortedRows: [Tuple] {
+		return self.entries.sorted(by: { a, b in
+			return self.precedes(a.keys[...], a.sequence, b.keys[...], b.sequence)
+		}).map { $0.row }
+	}
+
+	private func precedes(_ a: ArraySlice<Value>, _ aSequence: Int, _ b: ArraySlice<Value>, _ bSequence: Int) -> Bool {
+		switch self.comparator.compare(a, b) {
+		case .orderedAscending: return true
+		case .orderedDescending: return false
+		case .orderedSame: return aSequence < bSequence
+		}
+	}
+
+	/** Whether the entry at index a should be closer to the root than the entry at index b (i.e. sorts later). */
+	private func above(_ a: Int, _ b: Int) -> Bool {
+		let x = self.entries[a], y = self.entries[b]
+		return self.precedes(y.keys[...], y.sequence, x.keys[...], x.sequence)
+	}
+
+	private func siftUp(_ index: Int) {
+		var child = index
+		while child > 0 {
+			let parent = (child - 1) / 2
+			if !self.above(child, parent) {
+				break
+			}
+			self.entries.swapAt(child, parent)
+			child = parent
+		}
+	}
+
+	private func siftDown(_ index: Int) {
+		var parent = index
+		while true {
+			let left = 2 * parent + 1
+			let right = left + 1
+			var first = parent
+
+			if left < self.entries.count && self.above(left, first) {
+				first = left
+			}
+			if right < self.entries.count && self.above(right, first) {
+				first = right
+			}
+			if first == parent {
+				return
+			}
+			self.entries.swapAt(parent, first)
+			parent = first
+		}
+	}
+}
+
+/** A set of rows sorted in memory, along with their sort keys (in the same order). */
+private struct SortedRun {
+	let rows: [Tuple]
+	let keys: [Value]
+
+	init(rows: [Tuple], keys: [Value], comparator: SortKeyComparator) {
+		let k = comparator.keyCount
+		let indices = comparator.sortedIndices(keys: keys, count: rows.count)
+		var sortedKeys: [Value] = []
+		sortedKeys.reserveCapacity(keys.count)
+		for index in indices {
+			sortedKeys.append(contentsOf: keys[(index * k)..<((index + 1) * k)])
+		}
+		self.rows = indices.map { rows[$0] }
+		self.keys = sortedKeys
+	}
+}
+
+/** A cursor over the rows of a sorted run, used by SortMerger. After a successful call to advance() that returned true,
+`keys` and `row` contain the sort keys and values of the current row. */
+private protocol SortRunCursor: class {
+	var keys: ArraySlice<Value> { get }
+	var row: Tuple { get }
+	func advance() -> Fallible<Bool>
+}
+
+private final class MemoryRunCursor: SortRunCursor {
+	private let run: SortedRun
+	private let keyCount: Int
+	private var position = -1
+
+	init(run: SortedRun, keyCount: Int) {
+		self.run = run
+		self.keyCount = keyCount
+	}
+
+	var keys: ArraySlice<Value> {
+		return self.run.keys[(position * keyCount)..<((position + 1) * keyCount)]
+	}
+
+	var row: Tuple {
+		return self.run.rows[position]
+	}
+
+	func advance() -> Fallible<Bool> {
+		self.position += 1
+		return .success(self.position < self.run.rows.count)
+	}
+}
+
+/** A temporary file holding a sorted run. The file is removed when the object is deallocated. Values are stored in a
+compact binary format (see Value.spill); each record consists of the sort keys of a row followed by its values. */
+private final class SpillFile {
+	let url: URL
+
+	/** Writes the run to a new temporary file. */
+	init(run: SortedRun, keyCount: Int) throws {
+		self.url = FileManager.default.temporaryDirectory.appendingPathComponent("warp-sort-\(UUID().uuidString).run")
+		// FileHandle.write raises an Objective-C exception when writing fails (e.g. when the disk is full), which cannot be
+		// caught from Swift. Use POSIX write instead, so that the error ends up in the result of the sort.
+		let fd = open(self.url.path, O_WRONLY | O_CREAT | O_TRUNC, 0o600)
+		guard fd >= 0 else {
+			throw SpillError.cannotCreate(self.url.path)
+		}
+		defer { close(fd) }
+
+		var buffer: [UInt8] = []
+		buffer.reserveCapacity(SpillFile.bufferSize)
+
+		for (index, row) in run.rows.enumerated() {
+			for key in run.keys[(index * keyCount)..<((index + 1) * keyCount)] {
+				key.spill(to: &buffer)
+			}
+			SpillFile.append(UInt64(row.count), to: &buffer)
+			for value in row {
+				value.spill(to: &buffer)
+			}
+
+			if buffer.count >= SpillFile.bufferSize {
+				try SpillFile.write(buffer, to: fd)
+				buffer.removeAll(keepingCapacity: true)
+			}
+		}
+		try SpillFile.write(buffer, to: fd)
+	}
+
+	deinit {
+		try? FileManager.default.removeItem(at: self.url)
+	}
+
+	fileprivate static let bufferSize = 1024 * 1024
+
+	/** Writes all bytes in the buffer to the file descriptor, continuing after partial writes. */
+	private static func write(_ buffer: [UInt8], to fd: Int32) throws {
+		try buffer.withUnsafeBytes { bytes in
+			var offset = 0
+			while offset < bytes.count {
+				let written = Foundation.write(fd, bytes.baseAddress! + offset, bytes.count - offset)
+				if written < 0 {
+					if errno == EINTR {
+						continue
+					}
+					throw SpillError.cannotWrite(String(cString: strerror(errno)))
+				}
+				offset += written
+			}
+		}
+	}
+
+	fileprivate static func append(_ n: UInt64, to buffer: inout [UInt8]) {
+		var x = n
+		for _ in 0..<8 {
+			buffer.append(UInt8(truncatingIfNeeded: x))
+			x >>= 8
+		}
+	}
+
+	fileprivate enum SpillError: Error, CustomStringConvertible {
+		case cannotCreate(String)
+		case cannotWrite(String)
+
+		var description: String {
+			switch self {
+			case .cannotCreate(let path): return "Could not create temporary file at \(path) for sorting"
+			case .cannotWrite(let reason): return "Could not write temporary file for sorting: \(reason)"
+			}
+		}
+	}
+}
+
+/** Reads records from a SpillFile. */
+private final class SpillFileCursor: SortRunCursor {
+	private let file: SpillFile
+	private let handle: FileHandle
+	private let keyCount: Int
+	private var buffer: [UInt8] = []
+	private var position = 0
+	private var currentKeys: [Value] = []
+	private(set) var row: Tuple = []
+
+	init(file: SpillFile, keyCount: Int) throws {
+		self.file = file
+		self.keyCount = keyCount
+		self.handle = try FileHandle(forReadingFrom: file.url)
+	}
+
+	deinit {
+		self.handle.closeFile()
+	}
+
+	var keys: ArraySlice<Value> {
+		return self.currentKeys[...]
+	}
+
+	func advance() -> Fallible<Bool> {
+		if !self.ensure(1) {
+			return .success(false)
+		}
+
+		self.currentKeys.removeAll(keepingCapacity: true)
+		for _ in 0..<self.keyCount {
+			guard let key = self.readValue() else { return .failure("Temporary sort file is corrupt") }
+			self.currentKeys.append(key)
+		}
+
+		guard let count = self.readUInt64() else { return .failure("Temporary sort file is corrupt") }
+		var row: Tuple = []
+		row.reserveCapacity(Int(count))
+		for _ in 0..<count {
+			guard let value = self.readValue() else { return .failure("Temporary sort file is corrupt") }
+			row.append(value)
+		}
+		self.row = row
+		return .success(true)
+	}
+
+	/** Makes sure at least n bytes are available in the buffer. Returns false when the file does not contain enough
+	data. */
+	private func ensure(_ n: Int) -> Bool {
+		if self.buffer.count - self.position >= n {
+			return true
+		}
+
+		self.buffer.removeFirst(self.position)
+		self.position = 0
+		while self.buffer.count < n {
+			let data = self.handle.readData(ofLength: max(n - self.buffer.count, SpillFile.bufferSize))
+			if data.isEmpty {
+				return false
+			}
+			self.buffer.append(contentsOf: data)
+		}
+		return true
+	}
+
+	private func readBytes(_ n: Int) -> ArraySlice<UInt8>? {
+		if !self.ensure(n) {
+			return nil
+		}
+		let bytes = self.buffer[self.position..<(self.position + n)]
+		self.position += n
+		return bytes
+	}
+
+	private func readUInt64() -> UInt64? {
+		guard let bytes = self.readBytes(8) else { return nil }
+		var x: UInt64 = 0
+		for (shift, byte) in bytes.enumerated() {
+			x |= UInt64(byte) << UInt64(shift * 8)
+		}
+		return x
+	}
+
+	private func readValue() -> Value? {
+		guard let tag = self.readBytes(1)?.first else { return nil }
+
+		switch tag {
+		case Value.SpillTag.string.rawValue:
+			guard let length = self.readUInt64(), let bytes = self.readBytes(Int(length)) else { return nil }
+			return .string(String(decoding: bytes, as: UTF8.self))
+
+		case Value.SpillTag.int.rawValue:
+			guard let x = self.readUInt64() else { return nil }
+			return .int(Int(Int64(bitPattern: x)))
+
+		case Value.SpillTag.bool.rawValue:
+			guard let b = self.readBytes(1)?.first else { return nil }
+			return .bool(b != 0)
+
+		case Value.SpillTag.double.rawValue:
+			guard let x = self.readUInt64() else { return nil }
+			return .double(Double(bitPattern: x))
+
+		case Value.SpillTag.date.rawValue:
+			guard let x = self.readUInt64() else { return nil }
+			return .date(Double(bitPattern: x))
+
+		case Value.SpillTag.empty.rawValue:
+			return .empty
+
+		case Value.SpillTag.invalid.rawValue:
+			return .invalid
+
+		case Value.SpillTag.blob.rawValue:
+			guard let length = self.readUInt64(), let bytes = self.readBytes(Int(length)) else { return nil }
+			return .blob(Data(bytes))
+
+		case Value.SpillTag.list.rawValue:
+			guard let count = self.readUInt64() else { return nil }
+			var list: [Value] = []
+			for _ in 0..<count {
+				guard let item = self.readValue() else { return nil }
+				list.append(item)
+			}
+			return .list(list)
+
+		default:
+			return nil
+		}
+	}
+}
+
+fileprivate extension Value {
+	enum SpillTag: UInt8 {
+		case string = 0, int, bool, double, date, empty, invalid, blob, list
+	}
+
+	/** Appends a binary representation of this value to the buffer (readable by SpillFileCursor). */
+	func spill(to buffer: inout [UInt8]) {
+		switch self {
+		case .string(let s):
+			buffer.append(SpillTag.string.rawValue)
+			let utf8 = Array(s.utf8)
+			SpillFile.append(UInt64(utf8.count), to: &buffer)
+			buffer.append(contentsOf: utf8)
+
+		case .int(let i):
+			buffer.append(SpillTag.int.rawValue)
+			SpillFile.append(UInt64(bitPattern: Int64(i)), to: &buffer)
+
+		case .bool(let b):
+			buffer.append(SpillTag.bool.rawValue)
+			buffer.append(b ? 1 : 0)
+
+		case .double(let d):
+			buffer.append(SpillTag.double.rawValue)
+			SpillFile.append(d.bitPattern, to: &buffer)
+
+		case .date(let d):
+			buffer.append(SpillTag.date.rawValue)
+			SpillFile.append(d.bitPattern, to: &buffer)
+
+		case .empty:
+			buffer.append(SpillTag.empty.rawValue)
+
+		case .invalid:
+			buffer.append(SpillTag.invalid.rawValue)
+
+		case .blob(let data):
+			buffer.append(SpillTag.blob.rawValue)
+			SpillFile.append(UInt64(data.count), to: &buffer)
+			buffer.append(contentsOf: data)
+
+		case .list(let list):
+			buffer.append(SpillTag.list.rawValue)
+			SpillFile.append(UInt64(list.count), to: &buffer)
+			for item in list {
+				item.spill(to: &buffer)
+			}
+		}
+	}
+
+	/** A rough estimate of the amount of memory (in bytes) occupied by this value. */
+	var estimatedSize: Int {
+		switch self {
+		case .string(let s): return MemoryLayout<Value>.stride + s.utf8.count
+		case .blob(let d): return MemoryLayout<Value>.stride + d.count
+		case .list(let l): return MemoryLayout<Value>.stride + l.reduce(0) { $0 + $1.estimatedSize }
+		default: return MemoryLayout<Value>.stride
+		}
+	}
+}
+
+/** Merges a set of sorted runs into a single sorted sequence of rows (k-way merge). A binary heap holds the cursors of
+all runs that still have rows, ordered by their current row. Rows that sort the same are returned in the order of their
+runs, so that the merge is stable if the runs are. */
+private final class SortMerger {
+	private let comparator: SortKeyComparator
+	private let cursors: [SortRunCursor]
+	private var heap: [Int] = []
+	private var error: String? = nil
+
+	init(cursors: [SortRunCursor], comparator: SortKeyComparator) {
+		self.comparator = comparator
+		self.cursors = cursors
+
+		for (index, cursor) in cursors.enumerated() {
+			switch cursor.advance() {
+			case .success(true): self.push(index)
+			case .success(false): break
+			case .failure(let e): self.error = e
+			}
+		}
+	}
+
+	var isFinished: Bool {
+		return self.heap.isEmpty || self.error != nil
+	}
+
+	/** Returns the next (at most) `count` rows in sorted order. */
+	func next(_ count: Int) -> Fallible<[Tuple]> {
+		var rows: [Tuple] = []
+		rows.reserveCapacity(min(count, StreamDefaultBatchSize))
+
+		while rows.count < count && !self.heap.isEmpty {
+			if let e = self.error {
+				return .failure(e)
+			}
+
+			let top = self.heap[0]
+			let cursor = self.cursors[top]
+			rows.append(cursor.row)
+
+			switch cursor.advance() {
+			case .success(true):
+				self.siftDown(0)
+
+			case .success(false):
+				let last = self.heap.removeLast()
+				if !self.heap.isEmpty {
+					self.heap[0] = last
+					self.siftDown(0)
+				}
+
+			case .failure(let e):
+				self.error = e
+				return .failure(e)
+			}
+		}
+
+		if let e = self.error {
+			return .failure(e)
+		}
+		return .success(rows)
+	}
+
+	private func precedes(_ a: Int, _ b: Int) -> Bool {
+		switch self.comparator.compare(self.cursors[a].keys, self.cursors[b].keys) {
+		case .orderedAscending: return true
+		case .orderedDescending: return false
+		case .orderedSame: return a < b
+		}
+	}
+
+	private func push(_ cursor: Int) {
+		self.heap.append(cursor)
+		var child = self.heap.count - 1
+		while child > 0 {
+			let parent = (child - 1) / 2
+			if !self.precedes(self.heap[child], self.heap[parent]) {
+				break
+			}
+			self.heap.swapAt(child, parent)
+			child = parent
+		}
+	}
+
+	private func siftDown(_ index: Int) {
+		var parent = index
+		while true {
+			let left = 2 * parent + 1
+			let right = left + 1
+			var first = parent
+
+			if left < self.heap.count && self.precedes(self.heap[left], self.heap[first]) {
+				first = left
+			}
+			if right < self.heap.count && self.precedes(self.heap[right], self.heap[first]) {
+				first = right
+			}
+			if first == parent {
+				return
+			}
+			self.heap.swapAt(parent, first)
+			parent = first
+		}
+	}
+}
+
+/** Collects rows and their sort keys into sorted runs. Whenever the buffered rows exceed the memory budget, they are
+sorted and written to a temporary file in the background. When all rows have been added, the remaining rows are sorted in
+parallel (in several runs) and a SortMerger is created over all runs. Rows must be added in the order in which they
+should appear in the result when they sort the same. */
+private final class SortRunBuilder {
+	private let comparator: SortKeyComparator
+	private let memoryBudget: Int
+	private let job: Job
+	private let mutex = Mutex()
+	private let group = DispatchGroup()
+
+	private var rows: [Tuple] = []
+	private var keys: [Value] = []
+	private var bufferedBytes = 0
+	private var spilledRuns: [Int: Fallible<SpillFile>] = [:]
+	private var spillCount = 0
+
+	init(comparator: SortKeyComparator, memoryBudget: Int, job: Job) {
+		self.comparator = comparator
+		self.memoryBudget = memoryBudget
+		self.job = job
+	}
+
+	/** Adds rows along with their sort keys (as calculated by SortKeyComparator.appendKeys). */
+	func add(_ rows: [Tuple], keys: [Value]) {
+		self.mutex.locked {
+			self.rows.append(contentsOf: rows)
+			self.keys.append(contentsOf: keys)
+			for row in rows {
+				self.bufferedBytes += row.reduce(0) { $0 + $1.estimatedSize }
+			}
+			self.bufferedBytes += keys.count * MemoryLayout<Value>.stride
+
+			if self.bufferedBytes > self.memoryBudget {
+				self.spill()
+			}
+		}
+	}
+
+	/** Sorts the currently buffered rows and writes them to disk in the background. */
+	private func spill() {
+		let runRows = self.rows
+		let runKeys = self.keys
+		let runIndex = self.spillCount
+		self.spillCount += 1
+		self.rows = []
+		self.keys = []
+		self.bufferedBytes = 0
+
+		let comparator = self.comparator
+		let job = self.job
+		job.queue.async(group: self.group) {
+			if job.isCancelled {
+				return
+			}
+
+			var file: Fallible<SpillFile> = .failure("The sort was cancelled")
+			job.time("Sort and spill run", items: runRows.count, itemType: "rows") {
+				do {
+					let run = SortedRun(rows: runRows, keys: runKeys, comparator: comparator)
+					file = .success(try SpillFile(run: run, keyCount: comparator.keyCount))
+				}
+				catch {
+					file = .failure(String(describing: error))
+				}
+			}
+
+			self.mutex.locked {
+				self.spilledRuns[runIndex] = file
+			}
+		}
+	}
+
+	/** Sorts the remaining rows and creates a merger over all runs. Must be called after the last rows were added. */
+	func finish(_ callback: @escaping (Fallible<SortMerger>) -> ()) {
+		self.mutex.locked {
+			// Sort the rows still in memory in parallel, in one run for each processor
+			let rows = self.rows
+			let keys = self.keys
+			let comparator = self.comparator
+			let k = comparator.keyCount
+			let job = self.job
+			self.rows = []
+			self.keys = []
+
+			let runCount = max(1, min(ProcessInfo.processInfo.processorCount, rows.count / StreamDefaultBatchSize))
+			let runSize = (rows.count + runCount - 1) / max(1, runCount)
+			var memoryRuns = [SortedRun?](repeating: nil, count: runCount)
+			let memoryRunsMutex = Mutex()
+
+			for runIndex in 0..<runCount {
+				let start = min(rows.count, runIndex * runSize)
+				let end = min(rows.count, start + runSize)
+
+				job.queue.async(group: self.group) {
+					if job.isCancelled {
+						return
+					}
+
+					job.time("Sort run", items: end - start, itemType: "rows") {
+						let run = SortedRun(rows: Array(rows[start..<end]), keys: Array(keys[(start * k)..<(end * k)]), comparator: comparator)
+						memoryRunsMutex.locked {
+							memoryRuns[runIndex] = run
+						}
+					}
+				}
+			}
+
+			self.group.notify(queue: job.queue) {
+				if job.isCancelled {
+					callback(.failure("The sort was cancelled"))
+					return
+				}
+
+				self.mutex.locked {
+					do {
+						// Runs are merged in the order in which their rows were received
+						var cursors: [SortRunCursor] = []
+						for runIndex in 0..<self.spillCount {
+							switch self.spilledRuns[runIndex]! {
+							case .success(let file):
+								cursors.append(try SpillFileCursor(file: file, keyCount: k))
+
+							case .failure(let e):
+								callback(.failure(e))
+								return
+							}
+						}
+
+						memoryRunsMutex.locked {
+							for run in memoryRuns {
+								cursors.append(MemoryRunCursor(run: run!, keyCount: k))
+							}
+						}
+
+						callback(.success(SortMerger(cursors: cursors, comparator: comparator)))
+					}
+					catch {
+						callback(.failure(String(describing: error)))
+					}
+				}
+			}
+		}
+	}
+}
+
+/** Pulls all rows from a stream, calculating their sort keys as they come in, and collects them into sorted runs (see
+SortRunBuilder). */
+private final class SortRunPuller: StreamPuller {
+	private let comparator: SortKeyComparator
+	private let builder: SortRunBuilder
+	private let callback: (Fallible<SortMerger>) -> ()
+
+	init(stream: Stream, job: Job, comparator: SortKeyComparator, memoryBudget: Int, callback: @escaping (Fallible<SortMerger>) -> ()) {
+		self.comparator = comparator
+		self.builder = SortRunBuilder(comparator: comparator, memoryBudget: memoryBudget, job: job)
+		self.callback = callback
+		super.init(stream: stream, job: job)
+	}
+
+	override func onReceiveRows(_ rows: [Tuple], callback: @escaping (Fallible<Void>) -> ()) {
+		self.mutex.locked {
+			var keys: [Value] = []
+			keys.reserveCapacity(rows.count * self.comparator.keyCount)
+			for row in rows {
+				self.comparator.appendKeys(for: row, to: &keys)
+			}
+			self.builder.add(rows, keys: keys)
+		}
+		callback(.success(()))
+	}
+
+	override func onDoneReceiving() {
+		self.builder.finish(self.callback)
+	}
+
+	override func onError(_ error: String) {
+		self.callback(.failure(error))
+	}
+}
+
+/** Sorts the morsels of a pipeline (see MorselExecutor). Sort keys are calculated by the workers concurrently; the rows
+are then added to the runs in the order of the morsels, so that the sort is stable. */
+private final class SortMorselSink: MorselSink {
+	private let comparator: SortKeyComparator
+	private let builder: SortRunBuilder
+	private let mutex = Mutex()
+	private var pending: [Int: ([Tuple], [Value])] = [:]
+	private var nextSequence = 0
+	private(set) var merger: SortMerger? = nil
+
+	init(comparator: SortKeyComparator, memoryBudget: Int, job: Job) {
+		self.comparator = comparator
+		self.builder = SortRunBuilder(comparator: comparator, memoryBudget: memoryBudget, job: job)
+	}
+
+	func push(_ morsel: Morsel, job: Job) {
+		var keys: [Value] = []
+		job.time("Sort keys", items: morsel.rows.count, itemType: "rows") {
+			keys.reserveCapacity(morsel.rows.count * self.comparator.keyCount)
+			for row in morsel.rows {
+				self.comparator.appendKeys(for: row, to: &keys)
+			}
+		}
+
+		self.mutex.locked {
+			self.pending[morsel.sequence] = (morsel.rows, keys)
+			while let next = self.pending.removeValue(forKey: self.nextSequence) {
+				self.builder.add(next.0, keys: next.1)
+				self.nextSequence += 1
+			}
+		}
+	}
+
+	func finish(_ job: Job, callback: @escaping (Fallible<Void>) -> ()) {
+		self.builder.finish { result in
+			switch result {
+			case .success(let m):
+				self.merger = m
+				callback(.success(()))
+
+			case .failure(let e):
+				callback(.failure(e))
+			}
+		}
+	}
+}
+
+/** Serves the rows of a SortMerger as morsels. The merge itself is sequential, but the operators that follow it in the
+pipeline are not. */
+private final class MergerMorselSource: MorselSource {
+	private let merger: SortMerger
+	private let mutex = Mutex()
+	private let sizer = BatchSizer()
+	private var nextSequence = 0
+
+	init(_ merger: SortMerger) {
+		self.merger = merger
+	}
+
+	func next(_ job: Job, callback: @escaping (Fallible<Morsel>?) -> ()) {
+		let morsel = self.mutex.locked { () -> Fallible<Morsel>? in
+			if self.merger.isFinished {
+				// The merger may have finished because of an error
+				if case .failure(let e) = self.merger.next(0) {
+					return .failure(e)
+				}
+				return nil
+			}
+
+			let started = CFAbsoluteTimeGetCurrent()
+			switch self.merger.next(self.sizer.size) {
+			case .success(let rows):
+				self.sizer.observe(rows, duration: CFAbsoluteTimeGetCurrent() - started)
+				self.nextSequence += 1
+				return .success(Morsel(sequence: self.nextSequence - 1, rows: rows))
+
+			case .failure(let e):
+				return .failure(e)
+			}
+		}
+		callback(morsel)
+	}
+}
+
+/** A stream that returns the rows of a source stream, sorted by the given orders. The sort is performed externally: the
+source stream is consumed completely, and rows are sorted in runs. When the rows do not fit in the memory budget, runs are
+written to temporary files, which are merged when the sorted rows are fetched. Sort keys are calculated only once for
+each row. */
+public final class ExternalSortStream: Stream {
+	private let source: Stream
+	private let orders: [Order]
+	private let memoryBudget: Int
+	private let mutex = Mutex()
+	private let queue = DispatchQueue(label: "nl.pixelspark.Warp.ExternalSortStream", attributes: [])
+	private var started = false
+	private var merger: Fallible<SortMerger>? = nil
+	private var pendingConsumers: [Sink] = []
+	private let sizer = BatchSizer()
+
+	public init(source: Stream, orders: [Order], memoryBudget: Int = SortDefaultMemoryBudget) {
+		self.source = source
+		self.orders = orders
+		self.memoryBudget = memoryBudget
+	}
+
+	public func columns(_ job: Job, callback: @escaping (Fallible<OrderedSet<Column>>) -> ()) {
+		self.source.columns(job, callback: callback)
+	}
+
+	public func clone() -> Stream {
+		return ExternalSortStream(source: self.source.clone(), orders: self.orders, memoryBudget: self.memoryBudget)
+	}
+
+	public func fetch(_ job: Job, consumer: @escaping Sink) {
+		self.mutex.locked {
+			if let m = self.merger {
+				self.deliver(m, job: job, to: consumer)
+			}
+			else {
+				self.pendingConsumers.append(consumer)
+
+				if !self.started {
+					self.started = true
+					self.sortSource(job)
+				}
+			}
+		}
+	}
+
+	/** Batches are taken from the merger on a serial queue, in the order in which fetch was called. */
+	private func deliver(_ merger: Fallible<SortMerger>, job: Job, to consumer: @escaping Sink) {
+		self.queue.async {
+			switch merger {
+			case .success(let m):
+				let started = CFAbsoluteTimeGetCurrent()
+				let rows = m.next(self.sizer.size)
+				if case .success(let r) = rows {
+					self.sizer.observe(r, duration: CFAbsoluteTimeGetCurrent() - started)
+				}
+				let status: StreamStatus = (m.isFinished) ? .finished : .hasMore
+				job.async {
+					consumer(rows, rows.isFailure ? .finished : status)
+				}
+
+			case .failure(let e):
+				job.async {
+					consumer(.failure(e), .finished)
+				}
+			}
+		}
+	}
+
+	private func sortSource(_ job: Job) {
+		self.source.columns(job) { columnsFallible in
+			switch columnsFallible {
+			case .success(let columns):
+				let comparator = SortKeyComparator(orders: self.orders, columns: columns)
+				let puller = SortRunPuller(stream: self.source, job: job, comparator: comparator, memoryBudget: self.memoryBudget) { result in
+					self.finishSorting(result, job: job)
+				}
+				puller.start()
+
+			case .failure(let e):
+				self.finishSorting(.failure(e), job: job)
+			}
+		}
+	}
+
+	private func finishSorting(_ result: Fallible<SortMerger>, job: Job) {
+		self.mutex.locked {
+			self.merger = result
+			let consumers = self.pendingConsumers
+			self.pendingConsumers = []
+			for consumer in consumers {
+				self.deliver(result, job: job, to: consumer)
+			}
+		}
+	}
+}
+
+extension ExternalSortStream: MorselPlannable {
+	/** The rows of the source pipeline are sorted by a SortMorselSink (a pipeline breaker); the sorted rows are the
+	source of the next pipeline. */
+	func plan(_ job: Job, callback: @escaping (Fallible<OpenPipeline>) -> ()) {
+		MorselExecutor.plan(self.source, job: job) { pipelineFallible in
+			switch pipelineFallible {
+			case .success(let pipeline):
+				let comparator = SortKeyComparator(orders: self.orders, columns: pipeline.columns)
+				let sink = SortMorselSink(comparator: comparator, memoryBudget: self.memoryBudget, job: job)
+				MorselExecutor.run(pipeline, into: sink, job: job) { result in
+					switch result {
+					case .success(_):
+						callback(.success(OpenPipeline(source: MergerMorselSource(sink.merger!), columns: pipeline.columns, operators: [])))
+
+					case .failure(let e):
+						callback(.failure(e))
+					}
+				}
+
+			case .failure(let e):
+				callback(.failure(e))
+			}
+		}
+	}
+}
+
+private extension Fallible {
+	var isFailure: Bool {
+		if case .failure(_) = self {
+			return true
+		}
+		return false
+	}
+}
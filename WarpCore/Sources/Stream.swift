@@ -29,13 +29,122 @@ public enum StreamStatus {
 as well as a boolean indicating whether the next call of fetch() will return any rows (true) or not (false). */
 public typealias Sink = (Fallible<Array<Tuple>>, StreamStatus) -> ()
 
-/** The default number of rows that a Stream will send to a consumer upon request through Stream.fetch. */
+/** The default number of rows that a Stream will send to a consumer upon request through Stream.fetch. Streams that
+size their batches adaptively (see BatchSizer) start out with this number of rows. */
 public let StreamDefaultBatchSize = 256
 
+/** Determines the number of rows a stream returns from each call to fetch. A fixed number of rows does not fit all data
+sets: for narrow rows, the per-batch overhead (closures, futures, locks) dominates, whereas batches of wide rows (e.g.
+with large strings or blobs) take up a lot of memory. The sizer therefore targets a number of bytes per batch, based on
+the observed width of rows. Batches are also kept small enough to be produced within `latencyBudget`, so that progress
+is reported regularly and consumers do not wait too long for the first rows.
+
+Streams start out at StreamDefaultBatchSize rows, and report each batch they produce (and how long it took) through
+`observe`. The batch size changes at most twofold between batches. */
+public final class BatchSizer {
+	/** The number of bytes a batch should take up in memory. */
+	public static let byteBudget = 1 << 20
+
+	/** The time (in seconds) a stream should take to produce a single batch. */
+	public static let latencyBudget = 0.1
+
+	public static let minimumSize = 16
+
+	/** The largest batch size. This is kept well below StreamPuller.defaultMaximumBufferedRows, so that a puller can
+	still run several wavefronts concurrently when batches of narrow rows have grown to this size. */
+	public static let maximumSize = StreamDefaultBatchSize * 32
+
+	private static let sampleSize = 16
+	private static let smoothing = 0.3
+
+	private let mutex = Mutex()
+	private var currentSize = StreamDefaultBatchSize
+	private var rowWidth: Double? = nil
+	private var rowDuration: Double? = nil
+
+	public init() {
+	}
+
+	/** The number of rows the next batch should contain. */
+	public var size: Int {
+		return self.mutex.locked { self.currentSize }
+	}
+
+	/** Calls the block to produce a batch of (at most) the indicated number of rows, and observes the result. */
+	public func batch(_ produce: (Int) -> [Tuple]) -> [Tuple] {
+		let start = CFAbsoluteTimeGetCurrent()
+		let rows = produce(self.size)
+		self.observe(rows, duration: CFAbsoluteTimeGetCurrent() - start)
+		return rows
+	}
+
+	/** Records that a batch of rows was produced in the indicated time (in seconds), and adjusts the batch size. */
+	public func observe(_ rows: [Tuple], duration: Double) {
+		if rows.isEmpty {
+			return
+		}
+
+		let width = Double(BatchSizer.estimatedSize(of: rows)) / Double(rows.count)
+		let perRow = max(duration, 0.0) / Double(rows.count)
+
+		self.mutex.locked {
+			self.rowWidth = BatchSizer.average(self.rowWidth, width)
+			self.rowDuration = BatchSizer.average(self.rowDuration, perRow)
+
+			var target = Double(BatchSizer.byteBudget) / max(self.rowWidth!, 1.0)
+			if self.rowDuration! > 0.0 {
+				target = min(target, BatchSizer.latencyBudget / self.rowDuration!)
+			}
+
+			let bounded = min(Double(self.currentSize * 2), max(Double(self.currentSize / 2), target))
+			self.currentSize = max(BatchSizer.minimumSize, min(BatchSizer.maximumSize, Int(bounded)))
+		}
+	}
+
+	private static func average(_ current: Double?, _ measurement: Double) -> Double {
+		if let c = current {
+			return c + BatchSizer.smoothing * (measurement - c)
+		}
+		return measurement
+	}
+
+	/** Estimates the number of bytes the rows take up in memory, from the width of a sample of rows spread out over the
+	batch. */
+	public static func estimatedSize(of rows: [Tuple]) -> Int {
+		if rows.isEmpty {
+			return 0
+		}
+
+		let step = max(1, rows.count / BatchSizer.sampleSize)
+		var sampledBytes = 0
+		var sampledRows = 0
+		for index in stride(from: 0, to: rows.count, by: step) {
+			sampledBytes += BatchSizer.estimatedSize(rows[index])
+			sampledRows += 1
+		}
+		return Int(Double(sampledBytes) / Double(sampledRows) * Double(rows.count))
+	}
+
+	/** Estimates the number of bytes a row takes up in memory (the values themselves, and any storage they refer to). */
+	private static func estimatedSize(_ row: Tuple) -> Int {
+		var size = MemoryLayout<Value>.stride * row.count
+		for value in row {
+			switch value {
+			case .string(let s): size += s.utf8.count
+			case .blob(let d): size += d.count
+			case .list(let l): size += estimatedSize(l)
+			default: break
+			}
+		}
+		return size
+	}
+}
+
 /** Stream represents a data set that can be streamed (consumed in batches). This allows for efficient processing of
 data sets for operations that do not require memory (e.g. a limit or filter can be performed almost statelessly). The 
 stream implements a single method (fetch) that allows batch fetching of result rows. The size of the batches are defined
-by the stream (for now).
+by the stream (usually through a BatchSizer). Transformers process the batches they receive as a whole, so that the
+batch size chosen by the source applies to the whole stream.
 
 Streams are drained using concurrent calls to the 'fetch' method (multiple 'wavefronts'). */
 public protocol Stream {
@@ -66,23 +175,58 @@ public protocol Stream {
 /** This class manages the multithreaded retrieval of data from a stream. It will make concurrent calls to a stream's
 fetch function ('wavefronts') and call the method onReceiveRows each time it receives rows. When all results are in, the
 onDoneReceiving method is called. The subclass should implement onReceiveRows, onDoneReceiving and onError.
-The class also exists to avoid issues with reference counting (the sink closure needs to reference itself). */
+The class also exists to avoid issues with reference counting (the sink closure needs to reference itself).
+
+The puller applies backpressure: rows that have been fetched but not yet fully processed by onReceiveRows (including
+results that arrived out of order and wait for their predecessors) count as buffered. No new wavefronts are started
+while the buffered rows (plus the rows expected from fetches still running) exceed `maximumBufferedRows`, or their
+estimated size (see BatchSizer.estimatedSize) exceeds `maximumBufferedBytes`, so that a slow consumer (e.g. an insert
+into a database) does not cause the whole source to be read into memory. The byte limit matters for wide rows (e.g.
+long texts or blobs), of which even a modest number of rows takes up a lot of memory.
+
+The number of concurrent wavefronts is adapted to the measured throughput of both sides: a single wavefront delivers
+rows at a certain rate, the consumer processes them at another. Enough wavefronts are run to keep the consumer busy, up
+to twice the number of processors. When the buffer limit is hit, the number of wavefronts is halved. */
 open class StreamPuller {
+	/** The default limit on the number of rows buffered by a puller. */
+	public static let defaultMaximumBufferedRows = StreamDefaultBatchSize * 256
+
+	/** The default limit on the (estimated) number of bytes buffered by a puller. */
+	public static let defaultMaximumBufferedBytes = BatchSizer.byteBudget * 64
+
 	public let job: Job
 	public let stream: Stream
 	public let mutex = Mutex()
+	public let maximumBufferedRows: Int
+	public let maximumBufferedBytes: Int
 
-	private let concurrentWavefronts: Int
+	private let maximumWavefronts: Int
+	private var concurrentWavefronts: Int
 	private var outstandingWavefronts = 0
 	private var lastStartedWavefront = 0
 	private var lastSinkedWavefront = 0
 	private var earlyResults: [Int : Fallible<[Tuple]>] = [:]
 	private var done = false
 
-	public init(stream: Stream, job: Job) {
+	/** Throughput measurements (all exponential moving averages) */
+	private var fetchStartTimes: [Int: CFAbsoluteTime] = [:]
+	/** The number of rows (and their estimated size in bytes) that have been received but not yet processed. */
+	public private(set) var bufferedRows = 0
+	public private(set) var bufferedBytes = 0
+
+	private var averageBatchRows = Double(StreamDefaultBatchSize)
+	private var averageBatchBytes = 0.0
+	private var producerRate: Double? = nil
+	private var consumerRate: Double? = nil
+	private static let smoothing = 0.2
+
+	public init(stream: Stream, job: Job, maximumBufferedRows: Int = StreamPuller.defaultMaximumBufferedRows, maximumBufferedBytes: Int = StreamPuller.defaultMaximumBufferedBytes) {
 		self.stream = stream
 		self.job = job
+		self.maximumBufferedRows = maximumBufferedRows
+		self.maximumBufferedBytes = maximumBufferedBytes
 		self.concurrentWavefronts = ProcessInfo.processInfo.processorCount
+		self.maximumWavefronts = ProcessInfo.processInfo.processorCount * 2
 	}
 
 	private func startWavefront() {
@@ -92,9 +236,12 @@ open class StreamPuller {
 			self.lastStartedWavefront += 1
 			self.outstandingWavefronts += 1
 			let waveFrontId = self.lastStartedWavefront
+			self.fetchStartTimes[waveFrontId] = CFAbsoluteTimeGetCurrent()
 
 			self.stream.fetch(self.job, consumer: { (rows, streamStatus) in
 				self.mutex.locked {
+					self.received(rows, wavefront: waveFrontId)
+
 					/** Some fetches may return earlier than others, but we need to reassemble them in the
 					correct order. Therefore we keep track of a 'wavefront ID'. If the last wavefront that was
 					'sinked' was this wavefront's id minus one, we can sink this one directly. Otherwise we need
@@ -122,11 +269,87 @@ open class StreamPuller {
 		}
 	}
 
-	/** Start up to self.concurrentFetches number of fetch 'wavefronts' that will deliver their data to the
-	'sink' funtion. */
+	/** Records the arrival of the result of a wavefront, and measures the rate at which a single wavefront produces rows.
+	Must be called while holding the mutex. */
+	private func received(_ rows: Fallible<[Tuple]>, wavefront: Int) {
+		let count = StreamPuller.count(rows)
+		let bytes = StreamPuller.bytes(rows)
+		self.bufferedRows += count
+		self.bufferedBytes += bytes
+
+		if let started = self.fetchStartTimes.removeValue(forKey: wavefront), count > 0 {
+			let rate = Double(count) / max(CFAbsoluteTimeGetCurrent() - started, 1e-6)
+			self.producerRate = StreamPuller.average(self.producerRate, rate)
+			self.averageBatchRows = StreamPuller.average(self.averageBatchRows, Double(count))!
+			self.averageBatchBytes = StreamPuller.average(self.averageBatchBytes, Double(bytes))!
+		}
+	}
+
+	/** Whether the buffered rows exceed either of the limits. */
+	private var isOverLimit: Bool {
+		return self.bufferedRows >= self.maximumBufferedRows || self.bufferedBytes >= self.maximumBufferedBytes
+	}
+
+	/** Records that the consumer has processed rows (at the indicated rate), and adjusts the number of concurrent
+	wavefronts. Must be called while holding the mutex. */
+	private func consumed(_ count: Int, bytes: Int, duration: Double) {
+		self.bufferedRows -= count
+		self.bufferedBytes -= bytes
+		if count > 0 {
+			self.consumerRate = StreamPuller.average(self.consumerRate, Double(count) / max(duration, 1e-6))
+		}
+
+		if self.isOverLimit {
+			// The consumer cannot keep up, buffered rows are piling up
+			self.concurrentWavefronts = max(1, self.concurrentWavefronts / 2)
+		}
+		else if let producer = self.producerRate, let consumer = self.consumerRate {
+			// Move one step towards the number of wavefronts that together produce rows as fast as they are consumed
+			let desired = max(1, min(self.maximumWavefronts, Int((consumer / producer).rounded(.up))))
+			if desired > self.concurrentWavefronts {
+				self.concurrentWavefronts += 1
+			}
+			else if desired < self.concurrentWavefronts {
+				self.concurrentWavefronts -= 1
+			}
+		}
+	}
+
+	private static func average(_ current: Double?, _ measurement: Double) -> Double? {
+		if let c = current {
+			return c + StreamPuller.smoothing * (measurement - c)
+		}
+		return measurement
+	}
+
+	private static func count(_ rows: Fallible<[Tuple]>) -> Int {
+		if case .success(let r) = rows {
+			return r.count
+		}
+		return 0
+	}
+
+	private static func bytes(_ rows: Fallible<[Tuple]>) -> Int {
+		if case .success(let r) = rows {
+			return BatchSizer.estimatedSize(of: r)
+		}
+		return 0
+	}
+
+	/** Start up to self.concurrentWavefronts number of fetch 'wavefronts' that will deliver their data to the
+	'sink' funtion. Fewer wavefronts are started when this would cause more than maximumBufferedRows rows (or more than
+	maximumBufferedBytes bytes) to be buffered, unless nothing is in flight at all. The consumer will call start again
+	after processing buffered rows. */
 	public func start() {
 		mutex.locked {
 			while self.outstandingWavefronts < self.concurrentWavefronts {
+				let fetching = self.outstandingWavefronts - self.earlyResults.count
+				let expectedRows = self.bufferedRows + Int(Double(fetching + 1) * self.averageBatchRows)
+				let expectedBytes = self.bufferedBytes + Int(Double(fetching + 1) * self.averageBatchBytes)
+				let idle = self.outstandingWavefronts == 0 && self.bufferedRows == 0
+				if !idle && (expectedRows > self.maximumBufferedRows || expectedBytes > self.maximumBufferedBytes) {
+					break
+				}
 				self.startWavefront()
 			}
 		}
@@ -146,8 +369,11 @@ open class StreamPuller {
 
 			switch rows {
 			case .success(let r):
+				let receiveStarted = CFAbsoluteTimeGetCurrent()
 				self.onReceiveRows(r) { receiveResult in
 					self.mutex.locked {
+						self.consumed(r.count, bytes: BatchSizer.estimatedSize(of: r), duration: CFAbsoluteTimeGetCurrent() - receiveStarted)
+
 						switch receiveResult {
 						case .failure(let e):
 							self.outstandingWavefronts = 0
@@ -294,6 +520,7 @@ open class SequenceStream: Stream {
 	private var rowCount: Int? = nil // nil = number of rows is yet unknown
 	private var queue = DispatchQueue(label: "nl.pixelspark.Warp.SequenceStream", attributes: [])
 	private var error: String? = nil
+	private let sizer = BatchSizer()
 	
 	public init(_ sequence: AnySequence<Fallible<Tuple>>, columns: OrderedSet<Column>, rowCount: Int? = nil) {
 		self.sequence = sequence
@@ -309,43 +536,47 @@ open class SequenceStream: Stream {
 		}
 
 		queue.async {
-			job.time("sequence", items: StreamDefaultBatchSize, itemType: "rows") {
-				var done = false
-				var rows :[Tuple] = []
-				rows.reserveCapacity(StreamDefaultBatchSize)
-				
-				for _ in 0..<StreamDefaultBatchSize {
-					if let next = self.generator.next() {
-						switch next {
-							case .success(let f):
-								rows.append(f)
-
-							case .failure(let e):
-								self.error = e
-								done = true
-								break
+			var done = false
+			let rows = self.sizer.batch { size -> [Tuple] in
+				var rows: [Tuple] = []
+				job.time("sequence", items: size, itemType: "rows") {
+					rows.reserveCapacity(size)
+
+					for _ in 0..<size {
+						if let next = self.generator.next() {
+							switch next {
+								case .success(let f):
+									rows.append(f)
+
+								case .failure(let e):
+									self.error = e
+									done = true
+									break
+							}
+						}
+						else {
+							done = true
 						}
-					}
-					else {
-						done = true
-					}
 
-					if done {
-						break
+						if done {
+							break
+						}
 					}
 				}
-				self.position += rows.count
-				if let rc = self.rowCount, rc > 0 {
-					job.reportProgress(Double(self.position) / Double(rc), forKey: Unmanaged.passUnretained(self).toOpaque().hashValue)
-				}
+				return rows
+			}
 
-				job.async {
-					if let e = self.error {
-						consumer(.failure(e), .finished)
-					}
-					else {
-						consumer(.success(Array(rows)), done ? .finished : .hasMore)
-					}
+			self.position += rows.count
+			if let rc = self.rowCount, rc > 0 {
+				job.reportProgress(Double(self.position) / Double(rc), forKey: Unmanaged.passUnretained(self).toOpaque().hashValue)
+			}
+
+			job.async {
+				if let e = self.error {
+					consumer(.failure(e), .finished)
+				}
+				else {
+					consumer(.success(rows), done ? .finished : .hasMore)
 				}
 			}
 		}
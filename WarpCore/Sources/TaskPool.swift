@@ -0,0 +1,198 @@
+/* Copyright (c) 2014-2016 Pixelspark, Tommy van der Vorst
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+import Foundation
+
+/** TaskPool performs data-parallel work (such as mapping a function over the rows of a raster) on all available cores.
+The items to process are divided over a number of workers, each of which owns a contiguous range of items. A worker
+repeatedly takes a chunk from the front of its own range. When its range is exhausted, it steals the back half of the
+largest range left with any of the other workers. This keeps all cores busy until the very end, even when some chunks
+take much longer than others (e.g. in a join where some keys match many rows).
+
+Chunks are sized adaptively: each worker measures how long its previous chunk took, and sizes the next one so that it
+will take about `targetChunkDuration`. Cheap work is done in large chunks (little overhead), expensive work in small
+chunks (better balance). The results of the chunks are combined in item order, pairwise in a balanced tree, on the job's
+queue (never on the main thread). */
+public final class TaskPool {
+	/** The number of workers that perform a single map. */
+	public static let workerCount = max(1, ProcessInfo.processInfo.activeProcessorCount)
+
+	/** Work on fewer items than this is not worth distributing over workers, and is performed as a single chunk. */
+	public static let parallelThreshold = StreamDefaultBatchSize * 8
+
+	/** Chunks are sized so that processing each takes about this long (in seconds). */
+	static let targetChunkDuration = 0.002
+	static let minimumChunkSize = 16
+	static let maximumChunkSize = StreamDefaultBatchSize * 64
+
+	/** Calls `map` for chunks of the items in 0..<count in parallel, then combines the results in the order of the items
+	using `combine`, which must be associative. The callback receives the combined result, or nil when there are no
+	items or the job was cancelled. */
+	public static func map<T>(count: Int, job: Job, map: @escaping (Range<Int>) -> T, combine: @escaping (T, T) -> T, callback: @escaping (T?) -> ()) {
+		if count <= 0 {
+			return callback(nil)
+		}
+
+		if count < TaskPool.parallelThreshold || TaskPool.workerCount == 1 {
+			job.async {
+				callback(job.isCancelled ? nil : map(0..<count))
+			}
+			return
+		}
+
+		let workerCount = TaskPool.workerCount
+		let workers = (0..<workerCount).map { i in
+			return TaskPoolWorker<T>(range: (count * i / workerCount)..<(count * (i + 1) / workerCount))
+		}
+
+		let group = DispatchGroup()
+		let progressKey = Unmanaged.passUnretained(group).toOpaque().hashValue
+		let progressMutex = Mutex()
+		var processed = 0
+
+		for worker in workers {
+			job.queue.async(group: group) {
+				var chunkSize = TaskPool.minimumChunkSize
+
+				while !job.isCancelled {
+					if let chunk = worker.take(chunkSize) {
+						let start = CFAbsoluteTimeGetCurrent()
+						let result = map(chunk)
+						let duration = CFAbsoluteTimeGetCurrent() - start
+						worker.results.append((chunk.lowerBound, result))
+						chunkSize = TaskPool.nextChunkSize(after: chunk.count, took: duration)
+
+						let p = progressMutex.locked { () -> Double in
+							processed += chunk.count
+							return Double(processed) / Double(count)
+						}
+						job.reportProgress(p, forKey: progressKey)
+					}
+					else if !TaskPool.steal(for: worker, from: workers) {
+						// No work left anywhere
+						break
+					}
+				}
+			}
+		}
+
+		group.notify(queue: job.queue) {
+			if job.isCancelled {
+				return callback(nil)
+			}
+
+			let results = workers.flatMap { $0.results }.sorted { $0.0 < $1.0 }.map { $0.1 }
+			callback(TaskPool.combine(results, combine: combine))
+		}
+	}
+
+	/** Moves the back half of the largest remaining range of the other workers to the given (idle) worker. Returns false
+	when there is no work left to steal. */
+	private static func steal<T>(for thief: TaskPoolWorker<T>, from workers: [TaskPoolWorker<T>]) -> Bool {
+		var victim: TaskPoolWorker<T>? = nil
+		var victimRemaining = 0
+		for worker in workers where worker !== thief {
+			let remaining = worker.remaining
+			if remaining > victimRemaining {
+				victim = worker
+				victimRemaining = remaining
+			}
+		}
+
+		guard let v = victim else {
+			return false
+		}
+
+		// Another worker may have emptied the victim in the meantime, in which case the caller simply tries again
+		if let stolen = v.steal() {
+			thief.give(stolen)
+		}
+		return true
+	}
+
+	private static func nextChunkSize(after size: Int, took duration: Double) -> Int {
+		// Grow at most twofold per chunk, so that a single fast (e.g. cached) chunk does not cause a huge next chunk
+		let proposed = duration > 0.0 ? Int(Double(size) * TaskPool.targetChunkDuration / duration) : size * 2
+		return max(TaskPool.minimumChunkSize, min(TaskPool.maximumChunkSize, size * 2, proposed))
+	}
+
+	/** Combines the results pairwise (each level of the tree in parallel), preserving their order. */
+	private static func combine<T>(_ results: [T], combine: @escaping (T, T) -> T) -> T? {
+		var level = results
+		while level.count > 1 {
+			let pairs = level.count / 2
+			var next = [T?](repeating: nil, count: (level.count + 1) / 2)
+			let current = level
+			next.withUnsafeMutableBufferPointer { next in
+				DispatchQueue.concurrentPerform(iterations: pairs) { i in
+					next[i] = combine(current[2 * i], current[2 * i + 1])
+				}
+			}
+
+			if level.count % 2 == 1 {
+				next[pairs] = level.last
+			}
+			level = next.map { $0! }
+		}
+		return level.first
+	}
+}
+
+/** A worker in a TaskPool map. The range of items that has not been taken yet can be stolen by other workers, and is
+therefore protected by a mutex. The results are only accessed by the worker itself until all workers have finished. */
+private final class TaskPoolWorker<T> {
+	private let mutex = Mutex()
+	private var range: Range<Int>
+	var results: [(Int, T)] = []
+
+	init(range: Range<Int>) {
+		self.range = range
+	}
+
+	var remaining: Int {
+		return self.mutex.locked { self.range.count }
+	}
+
+	/** Takes a chunk of at most `size` items from the front of the range. */
+	func take(_ size: Int) -> Range<Int>? {
+		return self.mutex.locked { () -> Range<Int>? in
+			if self.range.isEmpty {
+				return nil
+			}
+			let end = min(self.range.upperBound, self.range.lowerBound + size)
+			let chunk = self.range.lowerBound..<end
+			self.range = end..<self.range.upperBound
+			return chunk
+		}
+	}
+
+	/** Removes the back half of the range (rounded up, so that a single remaining item can be stolen too). */
+	func steal() -> Range<Int>? {
+		return self.mutex.locked { () -> Range<Int>? in
+			if self.range.isEmpty {
+				return nil
+			}
+			let middle = self.range.lowerBound + self.range.count / 2
+			let stolen = middle..<self.range.upperBound
+			self.range = self.range.lowerBound..<middle
+			return stolen
+		}
+	}
+
+	func give(_ range: Range<Int>) {
+		self.mutex.locked {
+			self.range = range
+		}
+	}
+}
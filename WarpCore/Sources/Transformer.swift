@@ -140,6 +140,17 @@ open class StreamDataset: Dataset {
 
 	open func raster(_ job: Job, deliver: Delivery, callback: @escaping (Fallible<Raster>, StreamStatus) -> ()) {
 		let s = source.clone()
+
+		// When only the complete result is needed, the stream is executed as push-based pipelines (see MorselExecutor)
+		if deliver == .onceComplete {
+			job.async {
+				MorselExecutor.raster(s, job: job) { result in
+					callback(result, .finished)
+				}
+			}
+			return
+		}
+
 		job.async {
 			s.columns(job, callback: once { (columns) -> () in
 				switch columns {
@@ -177,7 +188,7 @@ open class StreamDataset: Dataset {
 	}
 
 	open func selectColumns(_ columns: OrderedSet<Column>) -> Dataset {
-		return StreamDataset(source: ColumnsTransformer(source: source, selectColumns: columns))
+		return self.pipeline(.selectColumns(columns))
 	}
 
 	open func offset(_ numberOfRows: Int) -> Dataset {
@@ -199,7 +210,13 @@ open class StreamDataset: Dataset {
 	}
 
 	open func sort(_ by: [Order]) -> Dataset {
-		return fallback().sort(by)
+		// Sorted externally, so that data sets larger than the available memory can be sorted
+		return StreamDataset(source: ExternalSortStream(source: source, orders: by))
+	}
+
+	open func sort(_ by: [Order], limit numberOfRows: Int) -> Dataset {
+		// Only the first rows need to be kept while streaming (see TopKTransformer)
+		return StreamDataset(source: TopKTransformer(source: source, orders: by, numberOfRows: numberOfRows))
 	}
 
 	open func rank(_ ranks: [Column : Aggregator], by order: [Order]) -> Dataset {
@@ -211,8 +228,7 @@ open class StreamDataset: Dataset {
 	}
 
 	open func calculate(_ calculations: Dictionary<Column, Expression>) -> Dataset {
-		// Implemented as stream by CalculateTransformer
-		return StreamDataset(source: CalculateTransformer(source: source, calculations: calculations))
+		return self.pipeline(.calculate(calculations))
 	}
 
 	open func pivot(_ horizontal: OrderedSet<Column>, vertical: OrderedSet<Column>, values: OrderedSet<Column>) -> Dataset {
@@ -224,7 +240,17 @@ open class StreamDataset: Dataset {
 	}
 
 	open func filter(_ condition: Expression) -> Dataset {
-		return StreamDataset(source: FilterTransformer(source: source, condition: condition))
+		return self.pipeline(.filter(condition))
+	}
+
+	/** Returns a data set that performs the given row-local operation on the stream of this data set. When that stream is
+	a pipeline of row-local operations itself, the operation is added to (a copy of) that pipeline (see
+	PipelineTransformer). */
+	private func pipeline(_ stage: PipelineStage) -> Dataset {
+		if let p = self.source as? PipelineTransformer {
+			return StreamDataset(source: PipelineTransformer(source: p.source, stages: p.stages + [stage]))
+		}
+		return StreamDataset(source: PipelineTransformer(source: self.source, stages: [stage]))
 	}
 
 	open func columns(_ job: Job, callback: @escaping (Fallible<OrderedSet<Column>>) -> ()) {
@@ -297,10 +323,12 @@ private class FlattenTransformer: Transformer {
 				var templateRow: [Value] = self.columns.map({(c) -> (Value) in return Value.invalid})
 				let valueIndex = (self.writeRowIdentifier ? 1 : 0) + (self.writeColumnIdentifier ? 1 : 0);
 
+				let compiledRowIdentifier = self.writeRowIdentifier ? self.rowIdentifier!.compile(columns: originalColumns) : nil
+
 				job.time("flatten", items: self.columns.count * rows.count, itemType: "cells") {
 					for row in rows {
-						if self.writeRowIdentifier {
-							templateRow[0] = self.rowIdentifier!.apply(Row(row, columns: originalColumns), foreign: nil, inputValue: nil)
+						if let rowIdentifier = compiledRowIdentifier {
+							templateRow[0] = rowIdentifier(row, nil, nil)
 						}
 
 						for columnIndex in 0..<originalColumns.count {
@@ -322,25 +350,160 @@ private class FlattenTransformer: Transformer {
 	}
 }
 
-private class FilterTransformer: Transformer {
-	var position = 0
-	let condition: Expression
+/** A row-local operation that can be part of a PipelineTransformer. Each row is transformed (or dropped) by looking at
+that row only. */
+private enum PipelineStage {
+	case filter(Expression)
+	case calculate(Dictionary<Column, Expression>)
+	case selectColumns(OrderedSet<Column>)
+}
+
+/** The PipelineTransformer performs a chain of row-local operations (filters, calculations and column selections) as a
+single transformer. Consecutive operations on a StreamDataset are fused into one pipeline (see StreamDataset.pipeline),
+so that a chain such as filter, calculate, selectColumns only requires one fetch, one set of transformer bookkeeping and
+one lookup of the columns per batch, instead of one for each operation. The stages are compiled once for the columns of
+the source, and then modify each batch of rows in place, without allocating intermediate batches. */
+private class PipelineTransformer: Transformer {
+	/** A compiled stage modifies a batch of rows in place. */
+	private typealias CompiledStage = (inout [Tuple]) -> ()
+
+	private struct CompiledPipeline {
+		let columns: OrderedSet<Column>
+		let stages: [CompiledStage]
+	}
+
+	let stages: [PipelineStage]
+	private let compiled: Future<Fallible<CompiledPipeline>>
 
-	init(source: Stream, condition: Expression) {
-		self.condition = condition
+	init(source: Stream, stages: [PipelineStage]) {
+		self.stages = stages
+		self.compiled = Future({ (job, callback) -> () in
+			source.columns(job) { columns in
+				switch columns {
+				case .success(let cns):
+					callback(PipelineTransformer.compile(stages, columns: cns))
+
+				case .failure(let e):
+					callback(.failure(e))
+				}
+			}
+		})
 		super.init(source: source)
 	}
 
+	private static func compile(_ stages: [PipelineStage], columns sourceColumns: OrderedSet<Column>) -> Fallible<CompiledPipeline> {
+		var columns = sourceColumns
+		var compiled: [CompiledStage] = []
+
+		for stage in stages {
+			switch stage {
+			case .filter(let condition):
+				let evaluate = condition.prepare().compileBatch(columns: columns)
+				compiled.append { rows in
+					// Move the rows that are kept to the front, then drop the rest
+					let results = evaluate(rows, nil)
+					var kept = 0
+					for index in 0..<rows.count where results[index] == Value.bool(true) {
+						if kept != index {
+							rows.swapAt(kept, index)
+						}
+						kept += 1
+					}
+					rows.removeLast(rows.count - kept)
+				}
+
+			case .calculate(let calculations):
+				for (column, expression) in calculations {
+					if expression.dependsOnForeigns {
+						return .failure(String(format: translationForString("The calculation for column %@ references foreign columns, which can only be referenced when referencing a second data source."), column.name))
+					}
+
+					// Check whether referenced columns exist
+					let deps = expression.siblingDependencies
+					if !columns.isSuperset(of: deps) {
+						let missing = Array(deps.subtracting(columns)).map { return $0.name }.joined(separator: ", ")
+						return .failure(String(format: translationForString("The following referenced columns are missing: %@ in calculation for column %@"), missing, column.name))
+					}
+				}
+
+				// Create newly calculated columns
+				let ordered = calculations.map { ($0.key, $0.value.prepare()) }
+				var indices = Dictionary<Column, Int>()
+				for (targetColumn, _) in ordered {
+					if let index = columns.firstIndex(of: targetColumn) {
+						indices[targetColumn] = index
+					}
+					else {
+						columns.append(targetColumn)
+						indices[targetColumn] = columns.count - 1
+					}
+				}
+
+				// Resolve column references in the calculations against the output columns
+				let width = columns.count
+				let calculate = ordered.map { (targetColumn, formula) -> (Int, CompiledBatchExpression) in
+					return (indices[targetColumn]!, formula.compileBatch(columns: columns))
+				}
+
+				compiled.append { rows in
+					for index in 0..<rows.count where rows[index].count < width {
+						rows[index].append(contentsOf: repeatElement(Value.empty, count: width - rows[index].count))
+					}
+
+					/* Calculate each column for the whole batch at once. Calculations are performed in order, so that a
+					calculation sees the results of the calculations performed before it. */
+					for (columnIndex, formula) in calculate {
+						let inputValues = rows.map { $0[columnIndex] }
+						let newValues = formula(rows, inputValues)
+						for index in 0..<rows.count {
+							rows[index][columnIndex] = newValues[index]
+						}
+					}
+				}
+
+			case .selectColumns(let selected):
+				let indices = selected.compactMap { columns.firstIndex(of: $0) }
+				columns = OrderedSet(indices.map { columns[$0] })
+				compiled.append { rows in
+					for index in 0..<rows.count {
+						let row = rows[index]
+						rows[index] = indices.map { row[$0] }
+					}
+				}
+			}
+		}
+
+		return .success(CompiledPipeline(columns: columns, stages: compiled))
+	}
+
+	fileprivate override func columns(_ job: Job, callback: @escaping (Fallible<OrderedSet<Column>>) -> ()) {
+		self.compiled.get(job) { result in
+			callback(result.use { $0.columns })
+		}
+	}
+
 	fileprivate override func transform(_ rows: Array<Tuple>, streamStatus: StreamStatus, job: Job, callback: @escaping Sink) {
-		source.columns(job) { (columns) -> () in
-			switch columns {
-			case .success(let cns):
-				job.time("Stream filter", items: rows.count, itemType: "row") {
-					let newRows = Array(rows.filter({(row) -> Bool in
-						return self.condition.apply(Row(row, columns: cns), foreign: nil, inputValue: nil) == Value.bool(true)
-					}))
+		self.compiled.get(job) { result in
+			switch result {
+			case .success(let pipeline):
+				let run = { (rows: [Tuple]) -> [Tuple] in
+					var rows = rows
+					job.time("Stream pipeline", items: rows.count, itemType: "row") {
+						for stage in pipeline.stages {
+							stage(&rows)
+						}
+					}
+					return rows
+				}
 
-					callback(.success(Array(newRows)), streamStatus)
+				// All stages are row-local, so large batches can be processed in chunks on all cores
+				if rows.count >= TaskPool.parallelThreshold {
+					TaskPool.map(count: rows.count, job: job, map: { range in run(Array(rows[range])) }, combine: { $0 + $1 }) { newRows in
+						callback(.success(newRows ?? []), streamStatus)
+					}
+				}
+				else {
+					callback(.success(run(rows)), streamStatus)
 				}
 
 			case .failure(let error):
@@ -350,7 +513,28 @@ private class FilterTransformer: Transformer {
 	}
 
 	fileprivate override func clone() -> Stream {
-		return FilterTransformer(source: source.clone(), condition: condition)
+		return PipelineTransformer(source: source.clone(), stages: stages)
+	}
+}
+
+extension PipelineTransformer: MorselPlannable {
+	/** The stages are added as operators to the pipeline of the source. */
+	func plan(_ job: Job, callback: @escaping (Fallible<OpenPipeline>) -> ()) {
+		MorselExecutor.plan(self.source, job: job) { pipelineFallible in
+			switch pipelineFallible {
+			case .success(let pipeline):
+				switch PipelineTransformer.compile(self.stages, columns: pipeline.columns) {
+				case .success(let compiled):
+					callback(.success(OpenPipeline(source: pipeline.source, columns: compiled.columns, operators: pipeline.operators + compiled.stages)))
+
+				case .failure(let e):
+					callback(.failure(e))
+				}
+
+			case .failure(let e):
+				callback(.failure(e))
+			}
+		}
 	}
 }
 
@@ -472,6 +656,111 @@ private class LimitTransformer: Transformer {
 	}
 }
 
+/** The TopKTransformer returns the first rows of the source stream in the indicated order (i.e. it performs a sort
+followed by a limit). Each concurrent call to transform keeps the first rows it has seen in a bounded heap that no other
+call is using at the same time. The heaps are merged in finish. Only the requested number of rows is kept for each heap,
+and rows are never fully sorted. */
+private class TopKTransformer: Transformer {
+	let orders: [Order]
+	let limit: Int
+	private var sourceColumnNames: Future<Fallible<OrderedSet<Column>>>
+	private var comparator: SortKeyComparator? = nil
+	private var heaps: [TopKHeap] = []
+	private var availableHeaps: [TopKHeap] = []
+	private var sequence = 0
+
+	init(source: Stream, orders: [Order], numberOfRows: Int) {
+		self.orders = orders
+		self.limit = numberOfRows
+		self.sourceColumnNames = Future({ (job, callback) in
+			source.columns(job, callback: callback)
+		})
+		super.init(source: source)
+	}
+
+	private func checkOutHeap(_ comparator: SortKeyComparator) -> TopKHeap {
+		return self.mutex.locked { () -> TopKHeap in
+			if let heap = self.availableHeaps.popLast() {
+				return heap
+			}
+
+			let heap = TopKHeap(comparator: comparator, limit: self.limit)
+			self.heaps.append(heap)
+			return heap
+		}
+	}
+
+	private func checkInHeap(_ heap: TopKHeap) {
+		self.mutex.locked {
+			self.availableHeaps.append(heap)
+		}
+	}
+
+	fileprivate override func transform(_ rows: Array<Tuple>, streamStatus: StreamStatus, job: Job, callback: @escaping Sink) {
+		self.sourceColumnNames.get(job) { sourceColumnsFallible in
+			switch sourceColumnsFallible {
+			case .success(let sourceColumns):
+				job.async {
+					job.time("Top-K collect", items: rows.count, itemType: "rows") {
+						let (comparator, firstSequence) = self.mutex.locked { () -> (SortKeyComparator, Int) in
+							if self.comparator == nil {
+								self.comparator = SortKeyComparator(orders: self.orders, columns: sourceColumns)
+							}
+							let first = self.sequence
+							self.sequence += rows.count
+							return (self.comparator!, first)
+						}
+
+						let k = comparator.keyCount
+						var keys: [Value] = []
+						keys.reserveCapacity(rows.count * k)
+						for row in rows {
+							comparator.appendKeys(for: row, to: &keys)
+						}
+
+						let heap = self.checkOutHeap(comparator)
+						for (index, row) in rows.enumerated() {
+							heap.add(keys: keys[(index * k)..<((index + 1) * k)], row: row, sequence: firstSequence + index)
+						}
+						self.checkInHeap(heap)
+					}
+
+					callback(.success([]), streamStatus)
+				}
+
+			case .failure(let e):
+				callback(.failure(e), .finished)
+			}
+		}
+	}
+
+	fileprivate override func finish(_ lastRows: Fallible<[Tuple]>, job: Job, callback: @escaping Sink) {
+		job.async {
+			var rows: [Tuple] = []
+
+			job.time("Top-K merge", items: 1, itemType: "result") {
+				let heaps = self.mutex.locked { () -> [TopKHeap] in
+					assert(self.availableHeaps.count == self.heaps.count, "all heaps should have been checked in")
+					return self.heaps
+				}
+
+				if let result = heaps.first {
+					for heap in heaps.dropFirst() {
+						result.merge(heap)
+					}
+					rows = result.sortedRows
+				}
+			}
+
+			callback(.success(rows), .finished)
+		}
+	}
+
+	fileprivate override func clone() -> Stream {
+		return TopKTransformer(source: source.clone(), orders: orders, numberOfRows: limit)
+	}
+}
+
 /** The RankTransformer calculates a set of reducers incrementally, and adds the intermediate result to each row.  */
 private class RankTransformer: Transformer {
 	let ranks: [Column: Aggregator]
@@ -515,19 +804,25 @@ private class RankTransformer: Transformer {
 				var newColumns = sourceColumns
 				newColumns.append(contentsOf: self.ranks.keys)
 
+				let compiledRanks = self.ranks.map { (k, agg) -> (Column, Int, CompiledExpression) in
+					return (k, newColumns.firstIndex(of: k)!, agg.map.compile(columns: sourceColumns))
+				}
+
 				let outRows = self.mutex.locked { () -> [Tuple] in
 					let outRows = self.rows.map { row -> Tuple in
-						let sourceRow = Row(row, columns: sourceColumns)
-						var destRow = sourceRow
+						var destRow = row
+						for _ in 0..<max(0, newColumns.count - destRow.count) {
+							destRow.append(Value.empty)
+						}
 
 						// Update counters
-						for (k, agg) in self.ranks {
-							let value = agg.map.apply(sourceRow, foreign: nil, inputValue: nil)
+						for (k, index, map) in compiledRanks {
+							let value = map(row, nil, nil)
 							self.counters[k]!.add([value])
-							destRow[k] = self.counters[k]!.result
+							destRow[index] = self.counters[k]!.result
 						}
 
-						return destRow.values
+						return destRow
 					}
 					self.rows = []
 					return outRows
@@ -546,226 +841,70 @@ private class RankTransformer: Transformer {
 	}
 }
 
-private class ColumnsTransformer: Transformer {
-	let columns: OrderedSet<Column>
-	var indexes: Future<Fallible<[Int]>>
-
-	init(source: Stream, selectColumns: OrderedSet<Column>) {
-		self.columns = selectColumns
-
-		self.indexes = Future({ (job, callback) in
-			var idxs: [Int] = []
-			source.columns(job) { (sourceColumnNames: Fallible<OrderedSet<Column>>) -> () in
-				switch sourceColumnNames {
-				case .success(let sourceCols):
-					for column in selectColumns {
-						if let idx = sourceCols.firstIndex(of: column) {
-							idxs.append(idx)
-						}
-					}
-
-					callback(.success(idxs))
-
-				case .failure(let error):
-					callback(.failure(error))
-				}
-			}
-		})
-
-		super.init(source: source)
-	}
-
-	override fileprivate func columns(_ job: Job, callback: @escaping (Fallible<OrderedSet<Column>>) -> ()) {
-		source.columns(job) { (sourceColumns) -> () in
-			switch sourceColumns {
-			case .success(let cns):
-				self.indexes.get(job) { result in
-					switch result {
-					case .success(let idxs):
-						let names = OrderedSet(idxs.map({ return cns[$0] }))
-						callback(.success(names))
-
-					case .failure(let e):
-						callback(.failure(e))
-					}
-				}
-
-			case .failure(let error):
-				callback(.failure(error))
-			}
-		}
-	}
-
-	override fileprivate func transform(_ rows: Array<Tuple>, streamStatus: StreamStatus, job: Job, callback: @escaping Sink) {
-		self.indexes.get(job) { result in
-			switch result {
-			case .success(let idxs):
-				var result: [Tuple] = []
-
-				for row in rows {
-					var newRow: Tuple = []
-					newRow.reserveCapacity(idxs.count)
-					for idx in idxs {
-						newRow.append(row[idx])
-					}
-					result.append(newRow)
-				}
-				callback(.success(Array(result)), streamStatus)
-
-			case .failure(let error):
-				callback(.failure(error), .finished)
-			}
-		}
-	}
-
-	fileprivate override func clone() -> Stream {
-		return ColumnsTransformer(source: source.clone(), selectColumns: columns)
-	}
-}
-
-private class CalculateTransformer: Transformer {
-	let calculations: Dictionary<Column, Expression>
-	private var indices: Fallible<Dictionary<Column, Int>>? = nil
-	private var columns: Fallible<OrderedSet<Column>>? = nil
-	private let queue = DispatchQueue(label: "nl.pixelspark.Warp.CalculateTransformer", attributes: [])
-	private var ensureIndexes: Future<Void>! = nil
-
-	init(source: Stream, calculations: Dictionary<Column, Expression>) {
-		var optimizedCalculations = Dictionary<Column, Expression>()
-		for (column, expression) in calculations {
-			if expression.dependsOnForeigns {
-				let msg  = String(format: translationForString("The calculation for column %@ references foreign columns, which can only be referenced when referencing a second data source."), column.name)
-				self.columns = .failure(msg)
-				self.indices = .failure(msg)
-			}
-			optimizedCalculations[column] = expression.prepare()
-		}
+/** The JoinTransformer can perform joins between a stream on the left side and an arbitrary data set on the right
+side. 
+
+When the join expression is an equality between an expression on the left side and an expression on the right side (see
+HashComparison), the right side data set is fetched once and stored in a hash table keyed on the right expression. Each
+chunk of rows from the left side (streamed) is then joined by looking up the left expression in the hash table. This
+requires O(m+n) work for m rows on the left and n rows on the right, but requires the right side to fit in memory.
+
+For other joins, it will call filter() on the right side data set for each chunk of rows from the left side to obtain a
+set that contains at least all rows necessary to join the rows in the chunk. It will then perform the join on the rows
+in the chunk and stream out that result. This is memory-efficient for joins that have a 1:1 relationship between left
+and right, or joins where rows from the left side all map to the same row on the right side (m:n where m>n). It breaks
+down for joins where a single row on the left side maps to a high number of rows on the right side (m:n where n>>m).
+However, there is no good alternative for such joins apart from performing it in-database (which will be tried before
+JoinTransformer is put to work). */
+private class JoinTransformer: Transformer {
+	let join: Join
+	private var leftColumnNames: Future<Fallible<OrderedSet<Column>>>
+	private var columnNamesCached: Fallible<OrderedSet<Column>>? = nil
+	private var isIneffectiveJoin: Bool = false
+	private let hashTable: Future<Fallible<JoinHashTable>>?
 
-		self.calculations = optimizedCalculations
-		super.init(source: source)
+	init(source: Stream, join: Join) {
+		let leftColumnNames = Future(source.columns)
+		self.leftColumnNames = leftColumnNames
+		self.join = join
 
-		weak var s: CalculateTransformer? = self
-		self.ensureIndexes = Future({ (job, callback) -> () in
-			if let s = s {
-				s.mutex.locked {
-					if s.indices == nil {
-						source.columns(job) { (columns) -> () in
-							switch columns {
-							case .success(let cns):
-								var columns = cns
-
-								// Check whether referenced columns exist
-								for (col, expression) in calculations {
-									let deps = expression.siblingDependencies
-									if !columns.isSuperset(of: deps) {
-										let missing = Array(deps.subtracting(columns)).map { return $0.name }.joined(separator: ", ")
-										s.mutex.locked {
-											let msg = String(format: translationForString("The following referenced columns are missing: %@ in calculation for column %@"), missing, col.name)
-											s.columns = .failure(msg)
-											s.indices = .failure(msg)
-										}
-									}
+		if let hc = HashComparison(expression: join.expression), hc.comparisonOperator == Binary.equal {
+			// The right side is fetched only once (when the first rows arrive) and shared by all chunks
+			let foreignDataset = join.foreignDataset
+			self.hashTable = Future({ (job, callback) in
+				leftColumnNames.get(job) { leftColumnsFallible in
+					switch leftColumnsFallible {
+					case .success(let leftColumns):
+						foreignDataset.raster(job) { foreignRasterFallible in
+							switch foreignRasterFallible {
+							case .success(let foreignRaster):
+								var table: JoinHashTable! = nil
+								job.time("Build join hash table", items: foreignRaster.rowCount, itemType: "rows") {
+									table = JoinHashTable(comparison: hc, leftColumns: leftColumns, rightRaster: foreignRaster)
 								}
 
-								var indices = Dictionary<Column, Int>()
-
-								// Create newly calculated columns
-								for (targetColumn, _) in s.calculations {
-									var columnIndex = cns.firstIndex(of: targetColumn) ?? -1
-									if columnIndex == -1 {
-										columns.append(targetColumn)
-										columnIndex = columns.count-1
-									}
-									indices[targetColumn] = columnIndex
+								if let t = table {
+									callback(.success(t))
 								}
-
-								s.mutex.locked {
-									s.indices = .success(indices)
-									s.columns = .success(columns)
+								else {
+									callback(.failure("The join was cancelled"))
 								}
 
-							case .failure(let error):
-								s.mutex.locked {
-									s.columns = .failure(error)
-									s.indices = .failure(error)
-								}
+							case .failure(let e):
+								callback(.failure(e))
 							}
-
-							callback(())
 						}
-					}
-					else {
-						callback(())
-					}
-				}
-			}
-		})
-	}
 
-	fileprivate override func columns(_ job: Job, callback: @escaping (Fallible<OrderedSet<Column>>) -> ()) {
-		self.ensureIndexes.get(job) {
-			callback(self.columns!)
-		}
-	}
-
-	fileprivate override func transform(_ rows: Array<Tuple>, streamStatus: StreamStatus, job: Job, callback: @escaping Sink) {
-		self.ensureIndexes.get(job) {
-			job.time("Stream calculate", items: rows.count, itemType: "row") {
-				switch self.columns! {
-				case .success(let cns):
-					switch self.indices! {
-					case .success(let idcs):
-						let newDataset = Array(rows.map({ (inRow: Tuple) -> Tuple in
-							var row = inRow
-							for _ in 0..<max(0, cns.count - row.count) {
-								row.append(Value.empty)
-							}
-
-							for (targetColumn, formula) in self.calculations {
-								let columnIndex = idcs[targetColumn]!
-								let inputValue: Value = row[columnIndex]
-								let newValue = formula.apply(Row(row, columns: cns), foreign: nil, inputValue: inputValue)
-								row[columnIndex] = newValue
-							}
-							return row
-						}))
-
-						callback(.success(Array(newDataset)), streamStatus)
-
-					case .failure(let error):
-						callback(.failure(error), .finished)
+					case .failure(let e):
+						callback(.failure(e))
 					}
-
-				case .failure(let error):
-					callback(.failure(error), .finished)
 				}
-			}
+			})
+		}
+		else {
+			self.hashTable = nil
 		}
-	}
-
-	fileprivate override func clone() -> Stream {
-		return CalculateTransformer(source: source.clone(), calculations: calculations)
-	}
-}
-
-/** The JoinTransformer can perform joins between a stream on the left side and an arbitrary data set on the right
-side. For each chunk of rows from the left side (streamed), it will call filter() on the right side data set to obtain
-a set that contains at least all rows necessary to join the rows in the chunk. It will then perform the join on the rows
-in the chunk and stream out that result.
-
-This is memory-efficient for joins that have a 1:1 relationship between left and right, or joins where rows from the left
-side all map to the same row on the right side (m:n where m>n). It breaks down for joins where a single row on the left
-side maps to a high number of rows on the right side (m:n where n>>m). However, there is no good alternative for such
-joins apart from performing it in-database (which will be tried before JoinTransformer is put to work). */
-private class JoinTransformer: Transformer {
-	let join: Join
-	private var leftColumnNames: Future<Fallible<OrderedSet<Column>>>
-	private var columnNamesCached: Fallible<OrderedSet<Column>>? = nil
-	private var isIneffectiveJoin: Bool = false
 
-	init(source: Stream, join: Join) {
-		self.leftColumnNames = Future(source.columns)
-		self.join = join
 		super.init(source: source)
 	}
 
@@ -823,6 +962,21 @@ private class JoinTransformer: Transformer {
 						if self.isIneffectiveJoin {
 							callback(.success(rows), streamStatus)
 						}
+						else if let hashTable = self.hashTable {
+							hashTable.get(job) { hashTableFallible in
+								switch hashTableFallible {
+								case .success(let table):
+									var joinedTuples: [Tuple] = []
+									job.time("Hash join", items: rows.count, itemType: "rows") {
+										joinedTuples = table.join(rows, inner: self.join.type == .innerJoin)
+									}
+									callback(.success(joinedTuples), streamStatus)
+
+								case .failure(let e):
+									callback(.failure(e), .finished)
+								}
+							}
+						}
 						else {
 							// We need to do work
 							let foreignDataset = self.join.foreignDataset
@@ -845,13 +999,13 @@ private class JoinTransformer: Transformer {
 									switch self.join.type {
 									case .leftJoin:
 										ourRaster.leftJoin(joinExpression, raster: foreignRaster, job: job) { (joinedRaster) in
-											let joinedTuples = Array<Tuple>(joinedRaster.raster)
+											let joinedTuples = joinedRaster.tuples
 											callback(.success(joinedTuples), streamStatus)
 										}
 
 									case .innerJoin:
 										ourRaster.innerJoin(joinExpression, raster: foreignRaster, job: job) { (joinedRaster) in
-											let joinedTuples = Array<Tuple>(joinedRaster.raster)
+											let joinedTuples = joinedRaster.tuples
 											callback(.success(joinedTuples), streamStatus)
 										}
 									}
@@ -874,12 +1028,115 @@ private class JoinTransformer: Transformer {
 	}
 }
 
+extension JoinTransformer: MorselPlannable {
+	/** Hash joins are planned as an operator that probes the hash table. The hash table is built from the raster of the
+	right side, which is itself executed as a separate pipeline when it is a stream. Other joins filter the right side
+	for each batch, and are fetched from as a source. */
+	func plan(_ job: Job, callback: @escaping (Fallible<OpenPipeline>) -> ()) {
+		guard let hashTable = self.hashTable else {
+			MorselExecutor.source(self, job: job, callback: callback)
+			return
+		}
+
+		MorselExecutor.plan(self.source, job: job) { pipelineFallible in
+			switch pipelineFallible {
+			case .success(let pipeline):
+				// The columns function checks whether this join will actually add columns to the result
+				self.columns(job) { columnsFallible in
+					switch columnsFallible {
+					case .success(let columns):
+						if self.isIneffectiveJoin {
+							callback(.success(pipeline))
+							return
+						}
+
+						hashTable.get(job) { tableFallible in
+							switch tableFallible {
+							case .success(let table):
+								let inner = self.join.type == .innerJoin
+								callback(.success(pipeline.appending({ rows in
+									rows = table.join(rows, inner: inner)
+								}, columns: columns)))
+
+							case .failure(let e):
+								callback(.failure(e))
+							}
+						}
+
+					case .failure(let e):
+						callback(.failure(e))
+					}
+				}
+
+			case .failure(let e):
+				callback(.failure(e))
+			}
+		}
+	}
+}
+
+/** A hash table built from the right side of a join, for joins based on an equality HashComparison. The table maps
+values of the comparison's right expression to the (projected) rows on the right side that have that value. Rows from
+the left side are joined by looking up the value of the comparison's left expression. */
+private final class JoinHashTable {
+	/** The rows on the right side, containing only the columns that will end up in the join result. */
+	private let rightRows: [Tuple]
+	private let rightHash: [Value: [Int]]
+	private let rightColumnCount: Int
+	private let leftKey: CompiledBatchExpression
+
+	init(comparison: HashComparison, leftColumns: OrderedSet<Column>, rightRaster: Raster) {
+		assert(comparison.comparisonOperator == Binary.equal, "JoinHashTable does not support comparisons based on non-equality")
+		let rightColumns = rightRaster.columns
+		let rightIndicesInResult = rightColumns.filter({ return !leftColumns.contains($0) }).map({ return rightColumns.firstIndex(of: $0)! })
+		let rightKey = comparison.rightExpression.prepare().compileBatch(columns: rightColumns)
+
+		var rightRows: [Tuple] = []
+		var rightHash: [Value: [Int]] = [:]
+		rightRaster.mutex.locked {
+			let tuples = rightRaster.tuples
+			let keys = rightKey(tuples, nil)
+			rightRows.reserveCapacity(tuples.count)
+
+			for (rowNumber, rightTuple) in tuples.enumerated() {
+				rightRows.append(rightIndicesInResult.map { $0 < rightTuple.count ? rightTuple[$0] : Value.empty })
+				rightHash[keys[rowNumber], default: []].append(rowNumber)
+			}
+		}
+
+		self.rightRows = rightRows
+		self.rightHash = rightHash
+		self.rightColumnCount = rightIndicesInResult.count
+		self.leftKey = comparison.leftExpression.prepare().compileBatch(columns: leftColumns)
+	}
+
+	/** Joins the given rows from the left side with the matching rows in this table. For an inner join, left rows that
+	do not match any row on the right are omitted; otherwise they are padded with empty values. */
+	func join(_ leftRows: [Tuple], inner: Bool) -> [Tuple] {
+		let keys = self.leftKey(leftRows, nil)
+		let emptyRight = Tuple(repeating: Value.empty, count: self.rightColumnCount)
+		var joined: [Tuple] = []
+		joined.reserveCapacity(leftRows.count)
+
+		for (rowNumber, leftTuple) in leftRows.enumerated() {
+			if let rightMatches = self.rightHash[keys[rowNumber]] {
+				for rightRowNumber in rightMatches {
+					joined.append(leftTuple + self.rightRows[rightRowNumber])
+				}
+			}
+			else if !inner {
+				joined.append(leftTuple + emptyRight)
+			}
+		}
+		return joined
+	}
+}
+
 private class AggregateTransformer: Transformer {
 	let groups: OrderedDictionary<Column, Expression>
 	let values: OrderedDictionary<Column, Aggregator>
 
 	private var groupExpressions: [Expression]
-	private var reducers = Catalog<Reducer>()
 	private var sourceColumnNames: Future<Fallible<OrderedSet<Column>>>! = nil
 
 	init(source: Stream, groups: OrderedDictionary<Column, Expression>, values: OrderedDictionary<Column, Aggregator>) {
@@ -902,7 +1159,7 @@ private class AggregateTransformer: Transformer {
 
 		self.groups = groups
 		self.values = values
-		self.groupExpressions = groups.map { (_, e) in return e }
+		self.groupExpressions = groups.map { (_, e) in return e.prepare() }
 		super.init(source: source)
 
 		self.sourceColumnNames = Future<Fallible<OrderedSet<Column>>>({ [unowned self] (job: Job, callback: @escaping (Fallible<OrderedSet<Column>>) -> ()) in
@@ -914,41 +1171,68 @@ private class AggregateTransformer: Transformer {
 		self.init(source: source, groups: OrderedDictionary(dictionaryInAnyOrder: groups), values: OrderedDictionary(dictionaryInAnyOrder: values))
 	}
 
+	/** Partial aggregation tables. Each concurrent call to transform aggregates its rows into a table that no other
+	call is using at the same time, so that no locking is required while aggregating. All tables are merged in finish. */
+	private var tables: [AggregateTable] = []
+	private var availableTables: [AggregateTable] = []
+
+	private func checkOutTable() -> AggregateTable {
+		return self.mutex.locked { () -> AggregateTable in
+			if let table = self.availableTables.popLast() {
+				return table
+			}
+
+			let table = AggregateTable(template: self.values.map { (_, aggregator) in return aggregator.reducer! })
+			self.tables.append(table)
+			return table
+		}
+	}
+
+	private func checkInTable(_ table: AggregateTable) {
+		self.mutex.locked {
+			self.availableTables.append(table)
+		}
+	}
+
+	/** The group and map expressions compiled against the source columns (see AggregateMorselSink). These are compiled
+	once, by the first batch that is transformed, and shared by all subsequent batches. */
+	private typealias CompiledExpressions = (groups: [CompiledBatchExpression], values: [CompiledBatchExpression])
+	private var compiledExpressions: CompiledExpressions? = nil
+
+	private func compile(columns: OrderedSet<Column>) -> CompiledExpressions {
+		return self.mutex.locked { () -> CompiledExpressions in
+			if let compiled = self.compiledExpressions {
+				return compiled
+			}
+
+			let compiled: CompiledExpressions = (
+				groups: self.groupExpressions.map { $0.compileBatch(columns: columns) },
+				values: self.values.map { (_, aggregator) in return aggregator.map.prepare().compileBatch(columns: columns) }
+			)
+			self.compiledExpressions = compiled
+			return compiled
+		}
+	}
+
 	fileprivate override func transform(_ rows: Array<Tuple>, streamStatus: StreamStatus, job: Job, callback: @escaping Sink) {
-		let reducerTemplate = self.values.mapDictionary { (c,a) in return (c, a.reducer!) }
 		self.sourceColumnNames.get(job) { sourceColumnsFallible in
 			switch sourceColumnsFallible {
 			case .success(let sourceColumns):
 				job.async {
 					job.time("Stream reduce collect", items: rows.count, itemType: "rows") {
-						var leafs: [Catalog<Reducer>: [Row]] = [:]
-
-						for row in rows {
-							let namedRow = Row(row, columns: sourceColumns)
-							let leaf = self.reducers.leafForRow(namedRow, groups: self.groupExpressions)
-
-							leaf.mutex.locked {
-								if leaf.values == nil {
-									leaf.values = reducerTemplate
-								}
-							}
-
-							if leafs[leaf] == nil {
-								leafs[leaf] = []
-							}
-							leafs[leaf]!.append(namedRow)
-						}
-
-						for (leaf, namedRows) in leafs {
-							leaf.mutex.locked {
-								for namedRow in namedRows {
-									// Add values to the reducers
-									for (column, aggregation) in self.values {
-										leaf.values![column]!.add([aggregation.map.apply(namedRow, foreign: nil, inputValue: nil)])
-									}
-								}
+						// Evaluate group and value expressions for the whole batch at once
+						let compiled = self.compile(columns: sourceColumns)
+						let groupValues = compiled.groups.map { $0(rows, nil) }
+						let mapValues = compiled.values.map { $0(rows, nil) }
+
+						let table = self.checkOutTable()
+						for rowIndex in 0..<rows.count {
+							let slot = table.slot(for: groupValues.map { $0[rowIndex] })
+							for aggregationIndex in 0..<mapValues.count {
+								table.add(mapValues[aggregationIndex][rowIndex], slot: slot, aggregation: aggregationIndex)
 							}
 						}
+						self.checkInTable(table)
 					}
 
 					callback(.success([]), streamStatus)
@@ -966,10 +1250,16 @@ private class AggregateTransformer: Transformer {
 			var rows: [Tuple] = []
 
 			job.time("stream aggregate reduce", items: 1, itemType: "result") {
-				self.reducers.mutex.locked {
-					self.reducers.visit(block: { (path, bucket) -> () in
-						rows.append(path + self.values.keys.map { k in return bucket[k]!.result })
-					})
+				let tables = self.mutex.locked { () -> [AggregateTable] in
+					assert(self.availableTables.count == self.tables.count, "all partial aggregation tables should have been checked in")
+					return self.tables
+				}
+
+				if let result = tables.first {
+					for table in tables.dropFirst() {
+						result.merge(table)
+					}
+					rows = result.rows
 				}
 			}
 
@@ -985,3 +1275,146 @@ private class AggregateTransformer: Transformer {
 		return AggregateTransformer(source: source.clone(), groups: groups, values: values)
 	}
 }
+
+extension AggregateTransformer: MorselPlannable {
+	/** The pipeline of the source is aggregated by an AggregateMorselSink (a pipeline breaker); the resulting groups are
+	the source of the next pipeline. */
+	func plan(_ job: Job, callback: @escaping (Fallible<OpenPipeline>) -> ()) {
+		MorselExecutor.plan(self.source, job: job) { pipelineFallible in
+			switch pipelineFallible {
+			case .success(let pipeline):
+				let sink = AggregateMorselSink(groups: self.groupExpressions, values: self.values.map { (_, aggregator) in return aggregator }, columns: pipeline.columns)
+				MorselExecutor.run(pipeline, into: sink, job: job) { result in
+					switch result {
+					case .success(_):
+						let columns = OrderedSet(self.groups.keys).union(with: OrderedSet(self.values.keys))
+						callback(.success(OpenPipeline(source: RowsMorselSource(sink.rows), columns: columns, operators: [])))
+
+					case .failure(let e):
+						callback(.failure(e))
+					}
+				}
+
+			case .failure(let e):
+				callback(.failure(e))
+			}
+		}
+	}
+}
+
+/** Aggregates the morsels of a pipeline (see MorselExecutor). Each push aggregates into a partial table that no other
+worker is using at the same time. When the pipeline has finished, the partial tables are merged pairwise, in parallel. */
+private final class AggregateMorselSink: MorselSink {
+	private let groupExpressions: [CompiledBatchExpression]
+	private let mapExpressions: [CompiledBatchExpression]
+	private let template: [Reducer]
+	private let mutex = Mutex()
+	private var tables: [AggregateTable] = []
+	private var availableTables: [AggregateTable] = []
+	private(set) var rows: [Tuple] = []
+
+	init(groups: [Expression], values: [Aggregator], columns: OrderedSet<Column>) {
+		self.groupExpressions = groups.map { $0.compileBatch(columns: columns) }
+		self.mapExpressions = values.map { $0.map.prepare().compileBatch(columns: columns) }
+		self.template = values.map { $0.reducer! }
+	}
+
+	func push(_ morsel: Morsel, job: Job) {
+		let rows = morsel.rows
+		if rows.isEmpty {
+			return
+		}
+
+		job.time("Aggregate morsel", items: rows.count, itemType: "rows") {
+			let groupValues = self.groupExpressions.map { $0(rows, nil) }
+			let mapValues = self.mapExpressions.map { $0(rows, nil) }
+
+			let table = self.mutex.locked { () -> AggregateTable in
+				if let table = self.availableTables.popLast() {
+					return table
+				}
+				let table = AggregateTable(template: self.template)
+				self.tables.append(table)
+				return table
+			}
+
+			for rowIndex in 0..<rows.count {
+				let slot = table.slot(for: groupValues.map { $0[rowIndex] })
+				for aggregationIndex in 0..<mapValues.count {
+					table.add(mapValues[aggregationIndex][rowIndex], slot: slot, aggregation: aggregationIndex)
+				}
+			}
+
+			self.mutex.locked {
+				self.availableTables.append(table)
+			}
+		}
+	}
+
+	func finish(_ job: Job, callback: @escaping (Fallible<Void>) -> ()) {
+		var level = self.mutex.locked { return self.tables }
+
+		job.time("Merge aggregates", items: level.count, itemType: "tables") {
+			while level.count > 1 {
+				let current = level
+				DispatchQueue.concurrentPerform(iterations: current.count / 2) { i in
+					current[2 * i].merge(current[2 * i + 1])
+				}
+				level = stride(from: 0, to: current.count, by: 2).map { current[$0] }
+			}
+			self.rows = level.first?.rows ?? []
+		}
+
+		callback(.success(()))
+	}
+}
+
+/** A hash table that maps group values to the reducers for that group. The reducers for all groups are stored in a
+single array; the reducers of a group are found at its 'slot' (see slot(for:)). */
+private final class AggregateTable {
+	private let template: [Reducer]
+	private var keys: [[Value]] = []
+	private var slots: [[Value]: Int] = [:]
+	private var reducers: [Reducer] = []
+
+	init(template: [Reducer]) {
+		self.template = template
+	}
+
+	/** Returns the index of the first reducer for the group with the given group values, creating the group when it
+	does not exist yet. */
+	func slot(for key: [Value]) -> Int {
+		if let slot = self.slots[key] {
+			return slot
+		}
+
+		let slot = self.reducers.count
+		self.keys.append(key)
+		self.slots[key] = slot
+		self.reducers.append(contentsOf: self.template)
+		return slot
+	}
+
+	func add(_ value: Value, slot: Int, aggregation: Int) {
+		self.reducers[slot + aggregation].add([value])
+	}
+
+	/** Merges the groups from the other table into this table. */
+	func merge(_ other: AggregateTable) {
+		for (index, key) in other.keys.enumerated() {
+			let slot = self.slot(for: key)
+			let otherSlot = index * self.template.count
+			for aggregation in 0..<self.template.count {
+				self.reducers[slot + aggregation].merge(other.reducers[otherSlot + aggregation])
+			}
+		}
+	}
+
+	/** The result rows: for each group, the group values followed by the result of each reducer. */
+	var rows: [Tuple] {
+		return self.keys.enumerated().map { (index, key) -> Tuple in
+			let slot = index * self.template.count
+			return key + (0..<self.template.count).map { self.reducers[slot + $0].result }
+		}
+	}
+}
@@ -783,7 +783,58 @@ class WarpCoreTests: XCTestCase {
 		
 		let f = Formula(formula: "(1+[@x])<>([@x]+2)", locale: locale)!.root.prepare()
 		XCTAssert(f is Comparison, "Equivalence is NOT optimized away for '<>' operator in x+1 > x+2")
-		
+
+		// Compiled expressions should yield the same result as applying the expression
+		let cols = OrderedSet<Column>([Column("a"), Column("x")])
+		let foreignCols = OrderedSet<Column>([Column("y")])
+		let row = Row([Value("foo"), Value(41)], columns: cols)
+		let foreignRow = Row([Value(42)], columns: foreignCols)
+		let compiledExpressions: [Expression] = [
+			f,
+			Formula(formula: "LEFT([@a];2)&([@X]+1)", locale: locale)!.root,
+			Comparison(first: Sibling(Column("x")), second: Foreign(Column("y")), type: .lesser),
+			Identity()
+		]
+		for expression in compiledExpressions {
+			let compiled = expression.compile(columns: cols, foreignColumns: foreignCols)
+			XCTAssert(compiled(row.values, foreignRow.values, Value(1337)) == expression.apply(row, foreign: foreignRow, inputValue: Value(1337)), "Compiled expression should equal applied expression")
+		}
+		XCTAssert(!Sibling(Column("doesNotExist")).compile(columns: cols)(row.values, nil, nil).isValid, "Compiled reference to a non-existing column should return an invalid value")
+
+		// Batch evaluation should yield the same results as applying the expression row by row
+		let batch: [Tuple] = [
+			[Value("foo"), Value(41)], [Value("Bar"), Value(-3)], [Value.empty, Value(0)],
+			[Value("baz"), Value(2.5)], [Value(12), Value.empty], [Value("qux"), Value("7")]
+		]
+		let batchInputs = batch.map { $0[1] }
+		let sa = Sibling(Column("a")), sx = Sibling(Column("x"))
+		let batchExpressions: [Expression] = [
+			Comparison(first: sx, second: Literal(Value(1)), type: .addition),
+			Comparison(first: sx, second: sx, type: .multiplication),
+			Comparison(first: sx, second: Literal(Value(1)), type: .division),
+			Comparison(first: Literal(Value(2)), second: sx, type: .greater),
+			Comparison(first: Literal(Value(41)), second: sx, type: .equal),
+			Comparison(first: sx, second: sx, type: .lesserEqual),
+			Comparison(first: Literal(Value("A")), second: sa, type: .containsString),
+			Comparison(first: sx, second: sa, type: .concatenation),
+			Call(arguments: [sa], type: .uppercase),
+			Call(arguments: [sa], type: .lowercase),
+			Call(arguments: [sa], type: .length),
+			Call(arguments: [sa, Literal(Value(2))], type: .left),
+			Call(arguments: [sa, Literal(Value(1))], type: .right),
+			Call(arguments: [sa, sx, Literal(Value("!"))], type: .concat),
+			Call(arguments: [sx], type: .absolute),
+			Identity()
+		]
+
+		for expression in batchExpressions {
+			let batchResult = expression.compileBatch(columns: cols)(batch, batchInputs)
+			for (index, tuple) in batch.enumerated() {
+				let rowResult = expression.apply(Row(tuple, columns: cols), foreign: nil, inputValue: batchInputs[index])
+				XCTAssert(batchResult[index] == rowResult || (!batchResult[index].isValid && !rowResult.isValid), "Batch result for \(expression) at row \(index) should equal row result")
+			}
+		}
+
 		// Optimizer is not smart enough to do the following
 		//let e = Formula(formula: "(1+2+[@x])>(2+[@x]+1)", locale: locale)!.root.prepare()
 		//XCTAssert(e is Literal && e.apply(Row(), foreign: nil, inputValue: nil) == Value.bool(false), "Equivalence is optimized away for '>' operator in 1+2+x > 2+x+1")
@@ -865,7 +916,23 @@ class WarpCoreTests: XCTestCase {
 		compareDataset(job, inDataset.sort(aSorts).sort(bSorts), inOptDataset.sort(aSorts).sort(bSorts)) { (equal) -> () in
 			XCTAssert(equal, "Coalescer result for sort().sort() should equal normal result")
 		}
-		
+
+		// Sort followed by limit is fused into a top-K operation
+		let streamOptDataset = StreamDataset(source: inDataset.stream()).coalesced
+		compareDataset(job, inDataset.sort(bSorts.map { Order(expression: $0.expression!, ascending: false, numeric: true) }).limit(2), streamOptDataset.sort(bSorts.map { Order(expression: $0.expression!, ascending: false, numeric: true) }).limit(5).limit(2)) { (equal) -> () in
+			XCTAssert(equal, "Coalescer result for sort().limit() should equal normal result")
+		}
+
+		var topData: [[Value]] = []
+		for i in 0..<2000 {
+			topData.append([Value((i * 7919) % 2003), Value(i)])
+		}
+		let topDataset = RasterDataset(data: topData, columns: [Column("x"), Column("y")])
+		let topOrders = [Order(expression: Sibling("x"), ascending: false, numeric: true)]
+		compareDataset(job, topDataset.sort(topOrders).limit(100), StreamDataset(source: topDataset.stream()).sort(topOrders, limit: 100)) { (equal) -> () in
+			XCTAssert(equal, "Top-K should equal sort followed by limit")
+		}
+
 		// Verify coalesced transpose
 		compareDataset(job, inDataset.transpose().transpose(), inOptDataset.transpose().transpose()) { (equal) -> () in
 			XCTAssert(equal, "Coalescer result for transpose().transpose() should equal normal result")
@@ -953,7 +1020,31 @@ class WarpCoreTests: XCTestCase {
 			assertRaster($0, message: "Join returns the appropriate number of rows in a self-join one-to-one scenario", condition: { $0.rowCount == 1000 })
 			assertRaster($0, message: "Join returns the appropriate number of columns in a self-join", condition: { $0.columns.count == 3 })
 		}
-		
+
+		// Streaming hash join (one-to-many)
+		let manyDataset = RasterDataset(data: (0..<50).map { [Value($0 % 10), Value($0)] }, columns: [Column("X"), Column("W")])
+		let streamedData = StreamDataset(source: data.stream())
+		streamedData.join(Join(type: .innerJoin, foreignDataset: manyDataset, expression: Comparison(first: Sibling("X"), second: Foreign("X"), type: .equal))).raster(job) {
+			assertRaster($0, message: "Streaming inner join returns all matching rows", condition: { $0.rowCount == 50 })
+			assertRaster($0, message: "Streaming inner join returns the appropriate number of columns", condition: { $0.columns.count == 4 })
+		}
+		streamedData.join(Join(type: .leftJoin, foreignDataset: manyDataset, expression: Comparison(first: Sibling("X"), second: Foreign("X"), type: .equal))).raster(job) {
+			assertRaster($0, message: "Streaming left join keeps unmatched rows", condition: { $0.rowCount == 990 + 50 })
+			assertRaster($0, message: "Streaming left join pads unmatched rows", condition: { $0.rows.filter { $0.values[3] == Value.empty }.count == 990 })
+		}
+
+		// Fused pipeline of row-local operations (filter, calculate, select columns)
+		streamedData
+			.filter(Comparison(first: Literal(Value(100)), second: Sibling("X"), type: .lesser))
+			.calculate([Column("W"): Comparison(first: Sibling("X"), second: Literal(Value(2)), type: .multiplication)])
+			.filter(Comparison(first: Literal(Value(50)), second: Sibling("W"), type: .greaterEqual))
+			.selectColumns([Column("W"), Column("X")])
+			.raster(job) {
+				assertRaster($0, message: "Pipeline filters rows in each stage", condition: { $0.rowCount == 75 })
+				assertRaster($0, message: "Pipeline selects the calculated column", condition: { $0.columns == [Column("W"), Column("X")] })
+				assertRaster($0, message: "Pipeline calculates values", condition: { $0.rows.allSatisfy { $0.values[0] == $0.values[1] * Value(2) } })
+			}
+
 		// Select columns
 		data.selectColumns(["THIS_DOESNT_EXIST"]).columns(job) { (r) -> () in
 			switch r {
@@ -1048,6 +1139,161 @@ class WarpCoreTests: XCTestCase {
 		}
     }
 
+	func testColumnarRaster() {
+		let job = Job(.userInitiated)
+		let cols = OrderedSet<Column>([Column("I"), Column("S"), Column("M")])
+		var d: [[Value]] = []
+		for i in 0..<300 {
+			d.append([i % 7 == 0 ? Value.empty : Value(i % 13), Value("s\(i % 5)"), i % 2 == 0 ? Value(i) : Value("x")])
+		}
+
+		let columnar = ColumnarRaster(data: d, columns: cols)
+		XCTAssert(columnar.rowCount == d.count, "Row count matches")
+		XCTAssert(WarpCoreTests.rasterEquals(columnar.raster, grid: d), "Columnar raster round-trips to a raster")
+
+		if case .int(_, nulls: let nulls) = columnar.buffers[0] { XCTAssert(nulls.hasNulls, "Empty cells are recorded") } else { XCTFail("Integer column should be typed") }
+		if case .string(codes: _, dictionary: let dict, nulls: _) = columnar.buffers[1] { XCTAssert(dict.count == 5, "Strings are dictionary-encoded") } else { XCTFail("String column should be dictionary-encoded") }
+		if case .values(_) = columnar.buffers[2] { } else { XCTFail("Mixed column should fall back to values") }
+
+		// Columnar operations should yield the same results as their raster counterparts
+		let filter = Comparison(first: Sibling(Column("I")), second: Literal(Value(5)), type: Binary.lesser)
+		let orders = [Order(expression: Sibling(Column("S")), ascending: false, numeric: false), Order(expression: Sibling(Column("I")), ascending: true, numeric: true)]
+		let columnarDataset = ColumnarDataset(columnar: columnar)
+		let rasterDataset = RasterDataset(data: d, columns: cols)
+		compareDataset(job, columnarDataset.filter(filter), rasterDataset.filter(filter)) { (equal) -> () in
+			XCTAssert(equal, "Columnar filter should equal raster filter")
+		}
+
+		compareDataset(job, columnarDataset.filter(filter).sort(orders).selectColumns(["S", "I"]), rasterDataset.filter(filter).sort(orders).selectColumns(["S", "I"])) { (equal) -> () in
+			XCTAssert(equal, "Columnar sort should equal raster sort")
+		}
+
+		compareDataset(job, columnarDataset.offset(10).limit(20), rasterDataset.offset(10).limit(20)) { (equal) -> () in
+			XCTAssert(equal, "Columnar offset/limit should equal raster offset/limit")
+		}
+
+		// A raster backed by columnar storage is read without conversion, and converted to rows when it is modified
+		let backed = Raster(columnar: columnar)
+		XCTAssert(backed.columnar != nil && backed.rowCount == d.count && backed[3, 1] == d[3][1], "Raster reads from columnar storage")
+		backed.addRows([[Value(1), Value("new"), Value(2)]])
+		XCTAssert(backed.columnar == nil && backed.rowCount == d.count + 1 && backed[d.count, 1] == Value("new"), "Modifying a columnar raster converts it to rows")
+		XCTAssert(WarpCoreTests.rasterEquals(Raster(columnar: columnar).clone(true), grid: d), "Cloned columnar raster has the same contents")
+
+		// The complete result of a stream is stored in columnar form
+		StreamDataset(source: rasterDataset.stream()).raster(job) { result in
+			result.require { r in
+				XCTAssert(r.columnar != nil, "Stream results are stored in columnar form")
+				XCTAssert(WarpCoreTests.rasterEquals(r, grid: d), "Stream result in columnar form has the same contents")
+			}
+		}
+
+		// Collecting a stream into a columnar raster
+		rasterDataset.columnar(job) { result in
+			switch result {
+			case .success(let c):
+				XCTAssert(WarpCoreTests.rasterEquals(c.raster, grid: d), "Stream collected into columnar raster")
+			case .failure(let e): XCTFail(e)
+			}
+		}
+	}
+
+	func testExternalSort() {
+		let job = Job(.userInitiated)
+		let cols = OrderedSet<Column>([Column("I"), Column("S"), Column("D")])
+		var d: [[Value]] = []
+		for i in 0..<5000 {
+			d.append([Value(i % 37), Value("s\(i % 11)"), i % 5 == 0 ? Value.empty : Value(Double(i) / 3.0)])
+		}
+
+		let rasterDataset = RasterDataset(data: d, columns: cols)
+		let orders = [Order(expression: Sibling(Column("I")), ascending: false, numeric: true), Order(expression: Sibling(Column("S")), ascending: true, numeric: false)]
+
+		// A tiny memory budget forces the sort to write runs to disk and merge them
+		let spillingSort = StreamDataset(source: ExternalSortStream(source: rasterDataset.stream(), orders: orders, memoryBudget: 16 * 1024))
+		compareDataset(job, spillingSort, rasterDataset.sort(orders)) { (equal) -> () in
+			XCTAssert(equal, "External sort with spilled runs should equal raster sort")
+		}
+
+		compareDataset(job, StreamDataset(source: rasterDataset.stream()).sort(orders), rasterDataset.sort(orders)) { (equal) -> () in
+			XCTAssert(equal, "In-memory external sort should equal raster sort")
+		}
+
+		compareDataset(job, StreamDataset(source: EmptyStream()).sort(orders), RasterDataset(raster: Raster())) { (equal) -> () in
+			XCTAssert(equal, "Sorting an empty stream yields an empty data set")
+		}
+	}
+
+	func testSortEmptyKeys() {
+		let job = Job(.userInitiated)
+		let cols = OrderedSet<Column>([Column("K"), Column("N")])
+		var d: [[Value]] = []
+		for i in 0..<3000 {
+			d.append([i % 3 == 0 ? Value.empty : Value(i % 7), Value(i)])
+		}
+		let rasterDataset = RasterDataset(data: d, columns: cols)
+
+		// Empty keys sort before all other values and compare equal to each other, so rows with empty keys keep their order
+		for ascending in [true, false] {
+			let orders = [Order(expression: Sibling(Column("K")), ascending: ascending, numeric: true)]
+			let rank = { (row: [Value]) -> Int in
+				let key = row[0].isEmpty ? -1 : row[0].intValue!
+				return ascending ? key : -key
+			}
+			let expected = d.sorted { a, b in
+				return rank(a) < rank(b) || (rank(a) == rank(b) && a[1].intValue! < b[1].intValue!)
+			}
+
+			let sorted: [(String, Dataset)] = [
+				("Raster sort", rasterDataset.sort(orders)),
+				("In-memory external sort", StreamDataset(source: rasterDataset.stream()).sort(orders)),
+				("External sort with spilled runs", StreamDataset(source: ExternalSortStream(source: rasterDataset.stream(), orders: orders, memoryBudget: 16 * 1024)))
+			]
+
+			for (name, dataset) in sorted {
+				asyncTest { callback in
+					dataset.raster(job) { result in
+						switch result {
+						case .success(let raster):
+							XCTAssertEqual(raster.rowCount, expected.count, "\(name) returns all rows")
+							XCTAssert(raster.rows.map { $0.values[1] } == expected.map { $0[1] }, "\(name) keeps the order of rows with equal (empty) keys, ascending: \(ascending)")
+
+						case .failure(let e):
+							XCTFail(e)
+						}
+						callback()
+					}
+				}
+			}
+		}
+	}
+
+	func testMorselExecutor() {
+		let job = Job(.userInitiated)
+		let cols = OrderedSet<Column>([Column("a"), Column("b")])
+		var d: [[Value]] = []
+		for i in 0..<20000 {
+			d.append([Value(i), Value(i % 7)])
+		}
+		let rasterDataset = RasterDataset(data: d, columns: cols)
+
+		// Filter, calculate, aggregate and sort are executed as pipelines; the result should equal that of the raster
+		let chain = { (data: WarpCore.Dataset) -> WarpCore.Dataset in
+			return data
+				.filter(Comparison(first: Literal(Value(100)), second: Sibling(Column("a")), type: .greater))
+				.calculate([Column("c"): Comparison(first: Literal(Value(2)), second: Sibling(Column("a")), type: .multiplication)])
+				.aggregate([Column("b"): Sibling(Column("b"))], values: [Column("s"): Aggregator(map: Sibling(Column("c")), reduce: .sum)])
+				.sort([Order(expression: Sibling(Column("b")), ascending: true, numeric: true)])
+		}
+
+		compareDataset(job, chain(StreamDataset(source: rasterDataset.stream())), chain(rasterDataset)) { (equal) -> () in
+			XCTAssert(equal, "Pipelines executed by the morsel executor should yield the same result as the raster")
+		}
+
+		compareDataset(job, StreamDataset(source: EmptyStream()).filter(Literal(Value(true))), RasterDataset(raster: Raster())) { (equal) -> () in
+			XCTAssert(equal, "Executing an empty stream yields an empty data set")
+		}
+	}
+
 	func testNormalDistribution() {
 		XCTAssert(NormalDistribution().inverse(0.0).isInfinite)
 		XCTAssert(NormalDistribution().inverse(1.0).isInfinite)
@@ -1061,21 +1307,19 @@ class WarpCoreTests: XCTestCase {
 		let expectFinish = self.expectation(description: "Parallel map finishes in time")
 		
 		let future = data.parallel(
-			{ (slice: Array<Int>) -> [Int] in
+			{ (slice: ArraySlice<Int>) -> [Int] in
 				return Array(slice.map({return $0 * 2}))
 			},
-			reduce: {(s, r: Int?) -> (Int) in
-				var r = r
-				for number in s {
-					r = (r == nil || number > r!) ? number : r
-				}
-				return r ?? 0
+			combine: { (a: [Int], b: [Int]) -> [Int] in
+				return a + b
 			}
 		)
 
 		let job = Job(.userInitiated)
 		future.get(job) { result in
-			XCTAssert(result != nil && result! == 1000000, "Parallel M/R delivers the correct result")
+			XCTAssert(result != nil && result!.count == data.count, "Parallel map returns a result for each item")
+			XCTAssert(result != nil && result!.last == 1000000, "Parallel M/R delivers the correct result")
+			XCTAssert(result != nil && result! == data.map { $0 * 2 }, "Parallel map results are combined in order")
 			expectFinish.fulfill()
 		}
 		
@@ -1086,6 +1330,65 @@ class WarpCoreTests: XCTestCase {
 		})
 	}
 
+	func testBatchSizer() {
+		// Narrow rows that are produced quickly should lead to larger batches
+		let narrow = BatchSizer()
+		let narrowRows = Array(repeating: [Value.int(1), Value.double(2.0)], count: narrow.size)
+		for _ in 0..<10 {
+			narrow.observe(narrowRows, duration: 0.0001)
+		}
+		XCTAssert(narrow.size > StreamDefaultBatchSize, "Batch size grows for narrow rows")
+		XCTAssert(narrow.size <= BatchSizer.maximumSize, "Batch size does not exceed the maximum")
+		XCTAssert(BatchSizer.maximumSize * 4 <= StreamPuller.defaultMaximumBufferedRows, "Pullers can buffer several batches of the maximum size")
+
+		// Wide rows should lead to smaller batches
+		let wide = BatchSizer()
+		let wideRows = Array(repeating: [Value.blob(Data(count: 64 * 1024))], count: wide.size)
+		for _ in 0..<10 {
+			wide.observe(wideRows, duration: 0.0001)
+		}
+		XCTAssert(wide.size < StreamDefaultBatchSize, "Batch size shrinks for wide rows")
+		XCTAssert(wide.size >= BatchSizer.minimumSize, "Batch size does not go below the minimum")
+
+		// Slow rows should lead to smaller batches
+		let slow = BatchSizer()
+		for _ in 0..<10 {
+			slow.observe(narrowRows, duration: 1.0)
+		}
+		XCTAssert(slow.size < StreamDefaultBatchSize, "Batch size shrinks when batches take long to produce")
+	}
+
+	func testStreamPullerBackpressure() {
+		let job = Job(.userInitiated)
+
+		// Narrow rows: the number of rows buffered by the puller is limited
+		let narrow = (0..<60000).map { [Value($0)] }
+		let rowLimit = BatchSizer.maximumSize * 2
+		asyncTest { callback in
+			let stream = RasterDataset(data: narrow, columns: [Column("i")]).stream()
+			let puller = SlowTestPuller(stream: stream, job: job, maximumBufferedRows: rowLimit, maximumBufferedBytes: Int.max) { p in
+				XCTAssert(p.rows == narrow, "All rows arrive, in order")
+				XCTAssert(p.maximumObservedRows <= rowLimit + p.largestBatchRows, "Buffered rows stay bounded")
+				callback()
+			}
+			puller.start()
+		}
+
+		// Wide rows: the estimated size of the buffered rows is limited
+		let blob = Value.blob(Data(count: 64 * 1024))
+		let wide = (0..<2000).map { [Value($0), blob] }
+		let byteLimit = 32 * 1024 * 1024
+		asyncTest { callback in
+			let stream = RasterDataset(data: wide, columns: [Column("i"), Column("b")]).stream()
+			let puller = SlowTestPuller(stream: stream, job: job, maximumBufferedRows: Int.max, maximumBufferedBytes: byteLimit) { p in
+				XCTAssert(p.rows == wide, "All rows arrive, in order")
+				XCTAssert(p.maximumObservedBytes <= byteLimit + p.largestBatchBytes, "Buffered bytes stay bounded")
+				callback()
+			}
+			puller.start()
+		}
+	}
+
 	func testAggregation() {
 		let n = 10000
 		let rows = (0..<n).map { i in
@@ -1107,6 +1410,37 @@ class WarpCoreTests: XCTestCase {
 				}
 			}
 		}
+
+		// Merging two reducers should yield the same result as reducing all values with a single reducer
+		let values: [Value] = [Value(1), Value(3.5), Value.empty, Value("7"), Value(-2), Value(3.5), Value(12)]
+		for fun in Function.allReducingFunctions {
+			var single = fun.reducer!
+			single.add(values)
+
+			var first = fun.reducer!
+			var second = fun.reducer!
+			first.add(Array(values[0..<3]))
+			second.add(Array(values[3...]))
+			first.merge(second)
+
+			let (a, b) = (single.result, first.result)
+			XCTAssert(a == b || (!a.isValid && !b.isValid) || fun == .list, "Merged reducer result for \(fun) should equal unmerged result")
+		}
+
+		// Grouped aggregation over many batches (partial aggregation tables are merged at the end)
+		asyncTest { callback in
+			StreamDataset(source: rasterDataset.stream()).aggregate(["g": Comparison(first: Literal(Value(10)), second: Sibling(Column("a")), type: .modulus)], values: [
+				"n": Aggregator(map: Sibling(Column("c")), reduce: .sum),
+				"m": Aggregator(map: Sibling(Column("a")), reduce: .max)
+			]).sort([Order(expression: Sibling(Column("g")), ascending: true, numeric: true)]).raster(job) { result in
+				result.require { outRaster in
+					XCTAssert(outRaster.rowCount == 10, "Grouped aggregation yields one row per group")
+					XCTAssert(outRaster[0, "n"] == Value(n / 10), "Grouped aggregation counts all rows in a group")
+					XCTAssert(outRaster[9, "m"] == Value(n - 1), "Grouped aggregation finds maximum of group")
+					callback()
+				}
+			}
+		}
 	}
 
 	func testFunctionDocumentation() {
@@ -1174,3 +1508,41 @@ class WarpCoreTests: XCTestCase {
 		return true
 	}
 }
+
+/** Collects the rows of a stream with a slow consumer, and records how many rows (and bytes) the puller buffers. */
+private class SlowTestPuller: StreamPuller {
+	private(set) var rows: [Tuple] = []
+	private(set) var maximumObservedRows = 0
+	private(set) var maximumObservedBytes = 0
+	private(set) var largestBatchRows = 0
+	private(set) var largestBatchBytes = 0
+	private let done: (SlowTestPuller) -> ()
+
+	init(stream: WarpCore.Stream, job: Job, maximumBufferedRows: Int, maximumBufferedBytes: Int, done: @escaping (SlowTestPuller) -> ()) {
+		self.done = done
+		super.init(stream: stream, job: job, maximumBufferedRows: maximumBufferedRows, maximumBufferedBytes: maximumBufferedBytes)
+	}
+
+	override func onReceiveRows(_ rows: [Tuple], callback: @escaping (Fallible<Void>) -> ()) {
+		self.mutex.locked {
+			self.maximumObservedRows = max(self.maximumObservedRows, self.bufferedRows)
+			self.maximumObservedBytes = max(self.maximumObservedBytes, self.bufferedBytes)
+			self.largestBatchRows = max(self.largestBatchRows, rows.count)
+			self.largestBatchBytes = max(self.largestBatchBytes, BatchSizer.estimatedSize(of: rows))
+			self.rows.append(contentsOf: rows)
+		}
+
+		self.job.async {
+			usleep(2000)
+			callback(.success(()))
+		}
+	}
+
+	override func onDoneReceiving() {
+		self.done(self)
+	}
+
+	override func onError(_ error: String) {
+		XCTFail(error)
+	}
+}